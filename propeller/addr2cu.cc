@@ -14,33 +14,47 @@
 
 #include "propeller/addr2cu.h"
 
+#include <cstddef>
 #include <cstdint>
+#include <iterator>
 #include <memory>
 #include <optional>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/algorithm/container.h"
+#include "absl/container/btree_set.h"
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
 #include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/DebugInfo/DWARF/DWARFAddressRange.h"
 #include "llvm/DebugInfo/DWARF/DWARFCompileUnit.h"
 #include "llvm/DebugInfo/DWARF/DWARFContext.h"
 #include "llvm/DebugInfo/DWARF/DWARFDie.h"
 #include "llvm/DebugInfo/DWARF/DWARFFormValue.h"
+#include "llvm/DebugInfo/DWARF/DWARFUnit.h"
 #include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/WithColor.h"
 
 namespace propeller {
 
 absl::StatusOr<std::unique_ptr<llvm::DWARFContext>> CreateDWARFContext(
-    const llvm::object::ObjectFile& obj, absl::string_view dwp_file) {
+    const llvm::object::ObjectFile& obj, absl::string_view dwp_file,
+    bool thread_safe) {
   std::unique_ptr<llvm::DWARFContext> dwarf_context =
       llvm::DWARFContext::create(
           obj, llvm::DWARFContext::ProcessDebugRelocations::Process,
-          /*const LoadedObjectInfo *L=*/nullptr, std::string(dwp_file));
+          /*const LoadedObjectInfo *L=*/nullptr, std::string(dwp_file),
+          llvm::WithColor::defaultErrorHandler,
+          llvm::WithColor::defaultWarningHandler, thread_safe);
   CHECK(dwarf_context != nullptr);
   if (dwp_file.empty() &&
       absl::c_any_of(dwarf_context->compile_units(),
@@ -58,18 +72,112 @@ absl::StatusOr<std::unique_ptr<llvm::DWARFContext>> CreateDWARFContext(
   return dwarf_context;
 }
 
+namespace {
+// Returns the file name of the compile unit `unit`.
+absl::string_view GetCompileUnitFileName(llvm::DWARFUnit& unit) {
+  llvm::DWARFDie die = unit.getNonSkeletonUnitDIE();
+  std::optional<llvm::DWARFFormValue> form_value =
+      die.findRecursively({llvm::dwarf::DW_AT_name});
+  llvm::StringRef name = llvm::dwarf::toStringRef(form_value, "");
+  return absl::string_view(name.data(), name.size());
+}
+}  // namespace
+
+Addr2Cu::Addr2Cu(llvm::DWARFContext& dwarf_context, bool parallel)
+    : dwarf_context_(dwarf_context) {
+  std::vector<llvm::DWARFUnit*> units;
+  for (const std::unique_ptr<llvm::DWARFUnit>& unit :
+       dwarf_context_.compile_units()) {
+    units.push_back(unit.get());
+  }
+
+  // Extracting the ranges and the name requires parsing each unit's DIE, which
+  // is independent across units.
+  std::vector<llvm::DWARFAddressRangesVector> ranges_by_cu(units.size());
+  file_names_.resize(units.size());
+  auto parse_unit = [&](size_t cu_index) {
+    llvm::Expected<llvm::DWARFAddressRangesVector> ranges =
+        units[cu_index]->collectAddressRanges();
+    if (!ranges) {
+      LOG(WARNING) << "Failed to collect address ranges for compile unit at "
+                   << "offset 0x" << absl::Hex(units[cu_index]->getOffset())
+                   << ": " << llvm::toString(ranges.takeError());
+      return;
+    }
+    ranges_by_cu[cu_index] = *std::move(ranges);
+    file_names_[cu_index] = GetCompileUnitFileName(*units[cu_index]);
+  };
+  if (parallel) {
+    llvm::parallelFor(0, units.size(), parse_unit);
+  } else {
+    for (size_t cu_index = 0; cu_index != units.size(); ++cu_index)
+      parse_unit(cu_index);
+  }
+
+  // Resolves overlapping ranges the same way as `llvm::DWARFDebugAranges`: each
+  // address is mapped to the first compile unit covering it. This sweeps over
+  // the sorted range endpoints while tracking the set of covering units.
+  struct RangeEndpoint {
+    uint64_t address;
+    int cu_index;
+    bool is_begin;
+  };
+  std::vector<RangeEndpoint> endpoints;
+  for (int cu_index = 0; cu_index < ranges_by_cu.size(); ++cu_index) {
+    for (const llvm::DWARFAddressRange& range : ranges_by_cu[cu_index]) {
+      if (range.LowPC >= range.HighPC) continue;
+      endpoints.push_back(
+          {.address = range.LowPC, .cu_index = cu_index, .is_begin = true});
+      endpoints.push_back(
+          {.address = range.HighPC, .cu_index = cu_index, .is_begin = false});
+    }
+  }
+  llvm::parallelSort(endpoints, [](const RangeEndpoint& a,
+                                   const RangeEndpoint& b) {
+    return a.address < b.address;
+  });
+  absl::btree_multiset<int> covering_cus;
+  for (int i = 0; i < endpoints.size(); ++i) {
+    if (endpoints[i].is_begin) {
+      covering_cus.insert(endpoints[i].cu_index);
+    } else {
+      covering_cus.erase(covering_cus.find(endpoints[i].cu_index));
+    }
+    if (covering_cus.empty() || i + 1 == endpoints.size() ||
+        endpoints[i + 1].address == endpoints[i].address) {
+      continue;
+    }
+    const int cu_index = *covering_cus.begin();
+    if (!cu_address_ranges_.empty() &&
+        cu_address_ranges_.back().end == endpoints[i].address &&
+        cu_address_ranges_.back().cu_index == cu_index) {
+      cu_address_ranges_.back().end = endpoints[i + 1].address;
+      continue;
+    }
+    cu_address_ranges_.push_back({.begin = endpoints[i].address,
+                                  .end = endpoints[i + 1].address,
+                                  .cu_index = cu_index});
+  }
+}
+
 absl::StatusOr<absl::string_view> Addr2Cu::GetCompileUnitFileNameForCodeAddress(
     uint64_t code_address) const {
+  auto it = absl::c_upper_bound(
+      cu_address_ranges_, code_address,
+      [](uint64_t address, const CuAddressRange& range) {
+        return address < range.begin;
+      });
+  if (it != cu_address_ranges_.begin() && code_address < std::prev(it)->end)
+    return file_names_[std::prev(it)->cu_index];
+
+  // Addresses which are only described by .debug_aranges fall back to LLVM's
+  // lookup.
   llvm::DWARFCompileUnit* unit =
       dwarf_context_.getCompileUnitForCodeAddress(code_address);
   if (unit == nullptr) {
     return absl::FailedPreconditionError(
         absl::StrFormat("no compile unit found on address 0x%x", code_address));
   }
-  llvm::DWARFDie die = unit->getNonSkeletonUnitDIE();
-  std::optional<llvm::DWARFFormValue> form_value =
-      die.findRecursively({llvm::dwarf::DW_AT_name});
-  llvm::StringRef name = llvm::dwarf::toStringRef(form_value, "");
-  return absl::string_view(name.data(), name.size());
+  return GetCompileUnitFileName(*unit);
 }
 }  // namespace propeller
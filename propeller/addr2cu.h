@@ -17,6 +17,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
@@ -26,17 +27,21 @@
 
 namespace propeller {
 
-// Creates an `llvm::DWARFContext` instance, which can then be used to create
-// an `Addr2Cu` instance.
+// Creates a `llvm::DWARFContext` instance, which can then be used to create an
+// `Addr2Cu` instance. The context guards its lazily parsed state with locks
+// only if `thread_safe` is true, which is required for a parallel `Addr2Cu`.
 absl::StatusOr<std::unique_ptr<llvm::DWARFContext>> CreateDWARFContext(
-    const llvm::object::ObjectFile& obj, absl::string_view dwp_file = "");
+    const llvm::object::ObjectFile& obj, absl::string_view dwp_file = "",
+    bool thread_safe = false);
 
 // Utility class that gets the module name for a code address with
-// the help of debug information.
+// the help of debug information. On construction, the address ranges of all
+// compile units are extracted into a sorted interval map, so each lookup is a
+// binary search. If `parallel` is true, the compile units are parsed in
+// parallel and `dwarf_context` must have been created as thread-safe.
 class Addr2Cu {
  public:
-  explicit Addr2Cu(llvm::DWARFContext& dwarf_context)
-      : dwarf_context_(dwarf_context) {}
+  explicit Addr2Cu(llvm::DWARFContext& dwarf_context, bool parallel = false);
 
   Addr2Cu(const Addr2Cu&) = delete;
   Addr2Cu& operator=(const Addr2Cu&) = delete;
@@ -50,7 +55,20 @@ class Addr2Cu {
       uint64_t code_address) const;
 
  private:
+  // A half-open address range [begin, end) covered by the compile unit with
+  // file name `file_names_[cu_index]`.
+  struct CuAddressRange {
+    uint64_t begin;
+    uint64_t end;
+    int cu_index;
+  };
+
   llvm::DWARFContext& dwarf_context_;
+  // Non-overlapping compile unit address ranges, sorted by address.
+  std::vector<CuAddressRange> cu_address_ranges_;
+  // File names of all compile units, indexed by the compile unit's index in
+  // `dwarf_context_.compile_units()`.
+  std::vector<absl::string_view> file_names_;
 };
 }  // namespace propeller
 #endif  // PROPELLER_ADDR2CU_H_
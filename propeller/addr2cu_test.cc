@@ -21,6 +21,7 @@
 #include <string>
 #include <utility>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/log/check.h"
 #include "absl/status/status.h"
 #include "absl/status/status_matchers.h"
@@ -30,7 +31,11 @@
 #include "absl/strings/string_view.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/DebugInfo/DWARF/DWARFCompileUnit.h"
 #include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/DebugInfo/DWARF/DWARFDie.h"
+#include "llvm/DebugInfo/DWARF/DWARFFormValue.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/ErrorOr.h"
@@ -44,6 +49,7 @@ using ::absl_testing::StatusIs;
 using ::propeller::Addr2Cu;
 using ::propeller::CreateDWARFContext;
 using ::testing::HasSubstr;
+using ::testing::UnorderedElementsAre;
 
 uint64_t GetSymbolAddress(const std::string& symmap, absl::string_view symbol) {
   std::ifstream fin(symmap.c_str());
@@ -99,6 +105,22 @@ TEST(Addr2CuTest, ComdatFunc) {
               IsOkAndHolds("propeller/testdata/test_comdat_1.cc"));
 }
 
+TEST(Addr2CuTest, NoCompileUnitForAddress) {
+  const std::string binary = absl::StrCat(::testing::SrcDir(),
+                                          "_main/propeller/testdata/"
+                                          "test_comdat.bin");
+
+  ASSERT_OK_AND_ASSIGN(BinaryData binary_data, SetupBinaryData(binary));
+
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<llvm::DWARFContext> context,
+                       CreateDWARFContext(*binary_data.object_file));
+
+  EXPECT_THAT(Addr2Cu(*context).GetCompileUnitFileNameForCodeAddress(
+                  0xfffffffffffff000),
+              StatusIs(absl::StatusCode::kFailedPrecondition,
+                       HasSubstr("no compile unit found")));
+}
+
 TEST(Addr2CuTest, ComdatFuncHasNoDwp) {
   const std::string binary = absl::StrCat(::testing::SrcDir(),
                                           "_main/propeller/testdata/"
@@ -131,4 +153,55 @@ TEST(Addr2CuTest, ComdatFuncHasDwp) {
                   GetSymbolAddress(symmap, "_ZN3Foo7do_workEv")),
               IsOkAndHolds("propeller/testdata/test_comdat_1.cc"));
 }
+
+// Tests that the compile unit ranges extracted in parallel from a binary with a
+// dwp file map every function to the same compile unit as LLVM's sequential
+// lookup.
+TEST(Addr2CuTest, ParallelRangesMatchSequentialLookupWithDwp) {
+  const std::string binary = absl::StrCat(::testing::SrcDir(),
+                                          "_main/propeller/testdata/"
+                                          "test_comdat_with_dwp.bin");
+  const std::string symmap = absl::StrCat(::testing::SrcDir(),
+                                          "_main/propeller/testdata/"
+                                          "test_comdat_with_dwp.symmap");
+  const std::string dwp = absl::StrCat(::testing::SrcDir(),
+                                       "_main/propeller/testdata/"
+                                       "test_comdat_with_dwp.dwp");
+
+  ASSERT_OK_AND_ASSIGN(BinaryData binary_data, SetupBinaryData(binary));
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<llvm::DWARFContext> context,
+                       CreateDWARFContext(*binary_data.object_file, dwp,
+                                          /*thread_safe=*/true));
+  Addr2Cu addr2cu(*context, /*parallel=*/true);
+
+  std::unique_ptr<llvm::DWARFContext> sequential_context =
+      llvm::DWARFContext::create(
+          *binary_data.object_file,
+          llvm::DWARFContext::ProcessDebugRelocations::Process,
+          /*const LoadedObjectInfo *L=*/nullptr, dwp);
+  ASSERT_NE(sequential_context, nullptr);
+
+  absl::flat_hash_set<std::string> file_names;
+  std::ifstream fin(symmap.c_str());
+  int64_t addr;
+  std::string sym_type;
+  std::string sym_name;
+  while (fin >> std::dec >> addr >> sym_type >> sym_name) {
+    if (sym_type != "T" && sym_type != "t" && sym_type != "W") continue;
+    llvm::DWARFCompileUnit* unit =
+        sequential_context->getCompileUnitForCodeAddress(addr);
+    if (unit == nullptr) continue;
+    const std::string file_name(llvm::dwarf::toStringRef(
+        unit->getNonSkeletonUnitDIE().findRecursively(
+            {llvm::dwarf::DW_AT_name}),
+        ""));
+    EXPECT_THAT(addr2cu.GetCompileUnitFileNameForCodeAddress(addr),
+                IsOkAndHolds(file_name))
+        << "for symbol " << sym_name;
+    file_names.insert(file_name);
+  }
+  EXPECT_THAT(file_names,
+              UnorderedElementsAre("propeller/testdata/test_comdat_1.cc",
+                                   "propeller/testdata/test_comdat_2.cc"));
+}
 }  // namespace
@@ -16,10 +16,11 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <functional>
+#include <future>
 #include <iterator>
 #include <memory>
 #include <optional>
-#include <stack>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -30,6 +31,7 @@
 #include "absl/container/btree_set.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/functional/function_ref.h"
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/status/statusor.h"
@@ -42,6 +44,7 @@
 #include "llvm/Object/ELFTypes.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/Error.h"
+#include "llvm/Support/Parallel.h"
 #include "propeller/bb_handle.h"
 #include "propeller/binary_address_branch.h"
 #include "propeller/binary_address_branch_path.h"
@@ -83,43 +86,77 @@ std::vector<BbRangeHandle> GetBbRangeHandles(
   } else {
     for (int i = 0; i != bb_addr_map.size(); ++i) add_bb_range_handles(i);
   }
-  absl::c_sort(bb_range_handles,
-               [&](const BbRangeHandle& a, const BbRangeHandle& b) {
-                 return bb_addr_map[a.function_index]
-                            .getBBRanges()[a.range_index]
-                            .BaseAddress < bb_addr_map[b.function_index]
-                                               .getBBRanges()[b.range_index]
-                                               .BaseAddress;
-               });
+  // Ties are broken by the handle so that the order is deterministic.
+  llvm::parallelSort(
+      bb_range_handles, [&](const BbRangeHandle& a, const BbRangeHandle& b) {
+        return std::forward_as_tuple(bb_addr_map[a.function_index]
+                                         .getBBRanges()[a.range_index]
+                                         .BaseAddress,
+                                     a.function_index, a.range_index) <
+               std::forward_as_tuple(bb_addr_map[b.function_index]
+                                         .getBBRanges()[b.range_index]
+                                         .BaseAddress,
+                                     b.function_index, b.range_index);
+      });
   return bb_range_handles;
 }
 
 // Returns the BB handles for BBs in `selected_functions` in `bb_addr_map`,
-// sorted by their address.
+// sorted by their address. Only the BB ranges need to be sorted since the BBs
+// of each range are already sorted; the ranges are then expanded into BB
+// handles in parallel.
 std::vector<BbHandle> GetBbHandles(
     absl::Span<const BBAddrMap> bb_addr_map,
     const absl::btree_set<int>& selected_functions) {
-  std::vector<BbHandle> bb_handles;
   std::vector<BbRangeHandle> selected_bb_range_handles =
       GetBbRangeHandles(bb_addr_map, &selected_functions);
-  std::optional<uint64_t> last_bb_range_address;
+  // Offset of every BB range's first BB handle in the returned vector.
+  std::vector<int64_t> bb_handle_offsets;
+  bb_handle_offsets.reserve(selected_bb_range_handles.size() + 1);
+  bb_handle_offsets.push_back(0);
   for (const BbRangeHandle& bb_range_handle : selected_bb_range_handles) {
+    bb_handle_offsets.push_back(bb_handle_offsets.back() +
+                                bb_addr_map[bb_range_handle.function_index]
+                                    .getBBRanges()[bb_range_handle.range_index]
+                                    .BBEntries.size());
+  }
+  std::vector<BbHandle> bb_handles(bb_handle_offsets.back());
+  llvm::parallelFor(0, selected_bb_range_handles.size(), [&](size_t r) {
+    const BbRangeHandle& bb_range_handle = selected_bb_range_handles[r];
     const BBAddrMap::BBRangeEntry& bb_range =
         bb_addr_map[bb_range_handle.function_index]
             .getBBRanges()[bb_range_handle.range_index];
-    if (last_bb_range_address.has_value())
-      CHECK_GE(bb_range.BaseAddress, *last_bb_range_address);
+    if (r != 0) {
+      CHECK_GE(bb_range.BaseAddress,
+               bb_addr_map[selected_bb_range_handles[r - 1].function_index]
+                   .getBBRanges()[selected_bb_range_handles[r - 1].range_index]
+                   .BaseAddress);
+    }
     for (int i = 0; i != bb_range.BBEntries.size(); ++i) {
-      bb_handles.push_back(
+      bb_handles[bb_handle_offsets[r] + i] =
           BbHandle{.function_index = bb_range_handle.function_index,
                    .range_index = bb_range_handle.range_index,
-                   .bb_index = i});
+                   .bb_index = i};
     }
-    last_bb_range_address = bb_range.BaseAddress;
-  }
+  });
   return bb_handles;
 }
 
+// Removes the functions in `selected_functions` for which `should_drop`
+// returns true. `should_drop` is evaluated for all functions in parallel and
+// must be thread-safe.
+void DropFunctionsIf(absl::btree_set<int>& selected_functions,
+                     absl::FunctionRef<bool(int)> should_drop) {
+  std::vector<int> functions(selected_functions.begin(),
+                             selected_functions.end());
+  std::vector<char> dropped(functions.size());
+  llvm::parallelFor(0, functions.size(), [&](size_t i) {
+    dropped[i] = should_drop(functions[i]);
+  });
+  for (int i = 0; i != functions.size(); ++i)
+    if (dropped[i]) selected_functions.erase(functions[i]);
+}
+
 // Returns a map from function indexes to their symbol info, given a map from
 // function addresses to their symbol info and a list of BBAddrMap for all
 // functions. It takes the symbol info map by value so that its values can be
@@ -213,16 +250,18 @@ class BinaryAddressMapperBuilder {
   const PropellerOptions* options_;
 };
 
-// Helper class for extracting intra-function paths from binary-address paths.
+// Helper class for extracting intra-function paths from binary-address paths
+// into an `IntraFunctionPathBuffer`.
 // Example usage:
-//   IntraFunctionPathsExtractor(&binary_address_mapper).Extract();
+//   IntraFunctionPathsExtractor(&binary_address_mapper, &buffer).Extract();
 class IntraFunctionPathsExtractor {
  public:
-  // Does not take ownership of `address_mapper` which should point to a valid
-  // object which outlives the constructed `IntraFunctionPathsExtractor`.
-  explicit IntraFunctionPathsExtractor(
-      const BinaryAddressMapper* address_mapper)
-      : address_mapper_(address_mapper) {}
+  // Does not take ownership of `address_mapper` and `buffer` which should
+  // point to valid objects which outlive the constructed
+  // `IntraFunctionPathsExtractor`.
+  IntraFunctionPathsExtractor(const BinaryAddressMapper* address_mapper,
+                              IntraFunctionPathBuffer* buffer)
+      : address_mapper_(address_mapper), buffer_(buffer) {}
 
   IntraFunctionPathsExtractor(const IntraFunctionPathsExtractor&) = delete;
   IntraFunctionPathsExtractor& operator=(const IntraFunctionPathsExtractor&) =
@@ -231,35 +270,11 @@ class IntraFunctionPathsExtractor {
   IntraFunctionPathsExtractor& operator=(IntraFunctionPathsExtractor&&) =
       default;
 
-  // Merges adjacent callsite branches by merging all of their calls into the
-  // first one, while keeping the order.
-  void MergeCallsites(std::vector<FlatBbHandleBranchPath>& paths) {
-    for (auto& path : paths) {
-      FlatBbHandleBranch* prev_branch = &*path.branches.begin();
-      path.branches.erase(
-          std::remove_if(
-              path.branches.begin() + 1, path.branches.end(),
-              [&](FlatBbHandleBranch& branch) {
-                if (prev_branch->is_callsite() && branch.is_callsite() &&
-                    prev_branch->from_bb == branch.from_bb) {
-                  CHECK(prev_branch->from_bb == prev_branch->to_bb)
-                      << prev_branch
-                      << " is not a callsite in a single "
-                         "block.";
-                  absl::c_move(branch.call_rets,
-                               std::back_inserter(prev_branch->call_rets));
-                  return true;
-                }
-                prev_branch = &branch;
-                return false;
-              }),
-          path.branches.end());
-    }
-  }
-
-  // Extracts and returns the intra-function paths in `address_path`.
-  std::vector<FlatBbHandleBranchPath> Extract(
+  // Extracts the intra-function paths in `address_path` into `buffer_` and
+  // returns them.
+  absl::Span<const FlatBbHandleBranchPath> Extract(
       const BinaryAddressBranchPath& address_path) && {
+    buffer_->Clear();
     pid_ = address_path.pid;
     sample_time_ = address_path.sample_time;
 
@@ -314,8 +329,8 @@ class IntraFunctionPathsExtractor {
       CHECK(from_bb_handle.has_value());
       HandleRegularBranch(*from_flat_bb_handle, *to_flat_bb_handle);
     }
-    MergeCallsites(paths_);
-    return std::move(paths_);
+    buffer_->MergeCallsites();
+    return buffer_->paths();
   }
 
  private:
@@ -346,9 +361,9 @@ class IntraFunctionPathsExtractor {
       // call located in a block ending with a tail call. However, popping off
       // the stack will make the paths shorter, but won't affect correctness.
       if (address_mapper_->GetBBEntry(*from_bb_handle).hasTailCall())
-        call_stack_[current_function_index_].pop();
-      GetCurrentLastBranch().call_rets.push_back(
-          {.callee = to_bb_handle.function_index});
+        buffer_->GetOrInsertCallStack(current_function_index_).pop_back();
+      buffer_->AppendCallRet(current_path_index_,
+                             {.callee = to_bb_handle.function_index});
     }
     AddNewPath({.to_bb = to_flat_bb_handle});
   }
@@ -381,21 +396,22 @@ class IntraFunctionPathsExtractor {
     // Set the returns_to block and pop off the call stack if the return is from
     // a known BB.
     if (from_bb_handle.has_value()) {
-      paths_[current_path_index_].returns_to = return_to_flat_bb;
-      call_stack_[current_function_index_].pop();
+      buffer_->path(current_path_index_).returns_to = return_to_flat_bb;
+      buffer_->GetOrInsertCallStack(current_function_index_).pop_back();
     }
     // Find the path corresponding to the callsite.
-    auto it = call_stack_.find(to_bb_handle.function_index);
-    if (it == call_stack_.end() || it->second.empty()) {
+    std::vector<int>* call_stack =
+        buffer_->FindCallStack(to_bb_handle.function_index);
+    if (call_stack == nullptr || call_stack->empty()) {
       // The callsite path doesn't exist in this trace.
-      AddNewPath(
-          {.from_bb =
-               to_bb_handle == return_to_bb ? std::nullopt : return_to_flat_bb,
-           .to_bb = to_flat_bb_handle,
-           .call_rets = {CallRetInfo{.return_bb = from_flat_bb_handle}}});
+      AddNewPath({.from_bb = to_bb_handle == return_to_bb ? std::nullopt
+                                                          : return_to_flat_bb,
+                  .to_bb = to_flat_bb_handle});
+      buffer_->AppendCallRet(current_path_index_,
+                             CallRetInfo{.return_bb = from_flat_bb_handle});
       return;
     }
-    current_path_index_ = it->second.top();
+    current_path_index_ = call_stack->back();
     FlatBbHandleBranch& callsite_branch = GetCurrentLastBranch();
 
     if (callsite_branch.to_bb.has_value()) {
@@ -403,7 +419,7 @@ class IntraFunctionPathsExtractor {
           << "Found corrupt callsite path while assigning sink: "
           << to_bb_handle << " branched-to from: " << from_bb_handle
           << " (path's last branch already has a sink): "
-          << paths_[current_path_index_];
+          << buffer_->path(current_path_index_);
       AddNewPath({.from_bb = to_bb_handle == return_to_bb ? std::nullopt
                                                           : return_to_flat_bb,
                   .to_bb = to_flat_bb_handle});
@@ -424,7 +440,7 @@ class IntraFunctionPathsExtractor {
           << "Found corrupt callsite path while assigning sink: "
           << to_bb_handle << " branched-to from: " << from_bb_handle
           << " (return address does not fall immediately after the call): "
-          << paths_[current_path_index_];
+          << buffer_->path(current_path_index_);
       AddNewPath({.from_bb = to_bb_handle == return_to_bb ? std::nullopt
                                                           : return_to_flat_bb,
                   .to_bb = to_flat_bb_handle});
@@ -432,12 +448,12 @@ class IntraFunctionPathsExtractor {
     }
     // Insert a new `CallRetInfo` or assign `return_bb` of the last one.
     if (callsite_branch.call_rets.empty()) {
-      callsite_branch.call_rets.push_back(
-          CallRetInfo{.return_bb = from_flat_bb_handle});
+      buffer_->AppendCallRet(current_path_index_,
+                             CallRetInfo{.return_bb = from_flat_bb_handle});
     } else {
       if (callsite_branch.call_rets.back().return_bb.has_value()) {
-        callsite_branch.call_rets.push_back(
-            CallRetInfo{.return_bb = from_flat_bb_handle});
+        buffer_->AppendCallRet(current_path_index_,
+                               CallRetInfo{.return_bb = from_flat_bb_handle});
       } else {
         callsite_branch.call_rets.back().return_bb = from_flat_bb_handle;
       }
@@ -451,40 +467,36 @@ class IntraFunctionPathsExtractor {
 
   // Inserts `bb_branch` at the end of the current path.
   void AugmentCurrentPath(const FlatBbHandleBranch& bb_branch) {
-    paths_[current_path_index_].branches.push_back(bb_branch);
+    buffer_->AppendBranch(current_path_index_, bb_branch);
   }
 
   // Adds a new path with a single branch `bb_branch` and updates
-  // `current_path_index_` and `call_stack_`.
+  // `current_path_index_` and the call stack in `buffer_`.
   void AddNewPath(const FlatBbHandleBranch& bb_branch) {
     current_function_index_ = bb_branch.from_bb.has_value()
                                   ? bb_branch.from_bb->function_index
                                   : bb_branch.to_bb->function_index;
-    paths_.push_back(
-        {.pid = pid_, .sample_time = sample_time_, .branches = {bb_branch}});
-    current_path_index_ = paths_.size() - 1;
-    call_stack_[current_function_index_].push(current_path_index_);
+    current_path_index_ = buffer_->AddPath(pid_, sample_time_, bb_branch);
+    buffer_->PushCallStack(current_function_index_, current_path_index_);
   }
 
   FlatBbHandleBranch& GetCurrentLastBranch() {
     CHECK_GE(current_path_index_, 0);
-    CHECK(!paths_[current_path_index_].branches.empty());
-    return paths_[current_path_index_].branches.back();
+    CHECK(!buffer_->path(current_path_index_).branches.empty());
+    return buffer_->path(current_path_index_).branches.back();
   }
 
   const BinaryAddressMapper* address_mapper_ = nullptr;
+  // Storage for the extracted paths and the call stacks.
+  IntraFunctionPathBuffer* buffer_ = nullptr;
   // Process id associated with the path.
   int64_t pid_ = -1;
   // Sample time associated with the path.
   absl::Time sample_time_ = absl::InfinitePast();
   // Index of the current function in address_mapper_->bb_addr_map().
   int current_function_index_ = -1;
-  std::vector<FlatBbHandleBranchPath> paths_;
-  // Index of the current path in `paths_`.
+  // Index of the current path in `buffer_`.
   int current_path_index_ = -1;
-  // Call stack map indexed by function index, mapping to path indices in
-  // `paths_` in the calling stack order.
-  absl::flat_hash_map<int, std::stack<int>> call_stack_;
 };
 }  // namespace
 
@@ -640,8 +652,13 @@ bool BinaryAddressMapper::CanFallThrough(int from, int to) const {
 // and add function1/2's index into the returned set.
 absl::btree_set<int> BinaryAddressMapperBuilder::CalculateHotFunctions(
     const absl::flat_hash_set<uint64_t>& hot_addresses) {
-  absl::btree_set<int> hot_functions;
-  auto add_to_hot_functions = [this, &hot_functions](uint64_t binary_address) {
+  // Number of addresses mapped to their functions by a single task.
+  constexpr int kAddressesPerChunk = 1 << 14;
+
+  // Returns the index of the function containing `binary_address` or
+  // `std::nullopt` if no function contains it.
+  auto get_function_index =
+      [this](uint64_t binary_address) -> std::optional<int> {
     auto it = absl::c_upper_bound(
         bb_range_handles_, binary_address,
         [this](uint64_t addr, const BbRangeHandle& bb_range_handle) {
@@ -649,7 +666,7 @@ absl::btree_set<int> BinaryAddressMapperBuilder::CalculateHotFunctions(
                             .getBBRanges()[bb_range_handle.range_index]
                             .BaseAddress;
         });
-    if (it == bb_range_handles_.begin()) return;
+    if (it == bb_range_handles_.begin()) return std::nullopt;
     it = std::prev(it);
     const auto& bb_range =
         bb_addr_map_[it->function_index].getBBRanges()[it->range_index];
@@ -658,10 +675,36 @@ absl::btree_set<int> BinaryAddressMapperBuilder::CalculateHotFunctions(
     if (binary_address >= bb_range.BaseAddress +
                               bb_range.BBEntries.back().Offset +
                               bb_range.BBEntries.back().Size)
-      return;
-    hot_functions.insert(it->function_index);
+      return std::nullopt;
+    return it->function_index;
   };
-  for (uint64_t address : hot_addresses) add_to_hot_functions(address);
+
+  // Map addresses to functions in parallel chunks, and deduplicate within
+  // each chunk before merging.
+  std::vector<uint64_t> addresses(hot_addresses.begin(), hot_addresses.end());
+  const int num_chunks =
+      (addresses.size() + kAddressesPerChunk - 1) / kAddressesPerChunk;
+  std::vector<std::vector<int>> hot_functions_by_chunk(num_chunks);
+  llvm::parallelFor(0, num_chunks, [&](size_t chunk) {
+    std::vector<int>& chunk_hot_functions = hot_functions_by_chunk[chunk];
+    for (size_t i = chunk * kAddressesPerChunk;
+         i < std::min((chunk + 1) * kAddressesPerChunk, addresses.size());
+         ++i) {
+      if (std::optional<int> function_index = get_function_index(addresses[i]))
+        chunk_hot_functions.push_back(*function_index);
+    }
+    absl::c_sort(chunk_hot_functions);
+    chunk_hot_functions.erase(absl::c_unique(chunk_hot_functions),
+                              chunk_hot_functions.end());
+  });
+  std::vector<int> hot_function_indices;
+  for (const std::vector<int>& chunk_hot_functions : hot_functions_by_chunk)
+    absl::c_copy(chunk_hot_functions, std::back_inserter(hot_function_indices));
+  llvm::parallelSort(hot_function_indices);
+  hot_function_indices.erase(absl::c_unique(hot_function_indices),
+                             hot_function_indices.end());
+  absl::btree_set<int> hot_functions(hot_function_indices.begin(),
+                                     hot_function_indices.end());
   stats_->bbaddrmap_stats.hot_functions = hot_functions.size();
   return hot_functions;
 }
@@ -676,35 +719,29 @@ void BinaryAddressMapperBuilder::DropNonSelectedFunctions(
 
 void BinaryAddressMapperBuilder::FilterNoNameFunctions(
     absl::btree_set<int>& selected_functions) const {
-  for (auto it = selected_functions.begin(); it != selected_functions.end();) {
-    if (!symbol_info_map_.contains(*it)) {
-      LOG(WARNING) << "Hot function at address: 0x"
-                   << absl::StrCat(
-                          absl::Hex(bb_addr_map_[*it].getFunctionAddress()))
-                   << " does not have an associated symbol name.";
-      it = selected_functions.erase(it);
-    } else {
-      ++it;
-    }
-  }
+  DropFunctionsIf(selected_functions, [this](int function_index) {
+    if (symbol_info_map_.contains(function_index)) return false;
+    LOG(WARNING) << "Hot function at address: 0x"
+                 << absl::StrCat(absl::Hex(
+                        bb_addr_map_[function_index].getFunctionAddress()))
+                 << " does not have an associated symbol name.";
+    return true;
+  });
 }
 
 void BinaryAddressMapperBuilder::FilterNonTextFunctions(
     absl::btree_set<int>& selected_functions) const {
-  for (auto func_it = selected_functions.begin();
-       func_it != selected_functions.end();) {
-    int function_index = *func_it;
+  DropFunctionsIf(selected_functions, [this](int function_index) {
     const auto& symbol_info = symbol_info_map_.at(function_index);
-    if (!symbol_info.section_name.starts_with(".text.") &&
-        symbol_info.section_name != ".text") {
-      LOG_EVERY_N(WARNING, 1000) << "Skipped symbol in non-'.text.*' section '"
-                                 << symbol_info.section_name.str()
-                                 << "': " << symbol_info.aliases.front().str();
-      func_it = selected_functions.erase(func_it);
-    } else {
-      ++func_it;
+    if (symbol_info.section_name.starts_with(".text.") ||
+        symbol_info.section_name == ".text") {
+      return false;
     }
-  }
+    LOG_EVERY_N(WARNING, 1000) << "Skipped symbol in non-'.text.*' section '"
+                               << symbol_info.section_name.str()
+                               << "': " << symbol_info.aliases.front().str();
+    return true;
+  });
 }
 
 // Without '-funique-internal-linkage-names', if multiple functions have the
@@ -779,7 +816,135 @@ absl::btree_set<int> BinaryAddressMapperBuilder::SelectFunctions(
 std::vector<FlatBbHandleBranchPath>
 BinaryAddressMapper::ExtractIntraFunctionPaths(
     const BinaryAddressBranchPath& address_path) const {
-  return IntraFunctionPathsExtractor(this).Extract(address_path);
+  IntraFunctionPathBuffer buffer;
+  absl::Span<const FlatBbHandleBranchPath> paths =
+      ExtractIntraFunctionPaths(address_path, buffer);
+  return std::vector<FlatBbHandleBranchPath>(paths.begin(), paths.end());
+}
+
+absl::Span<const FlatBbHandleBranchPath>
+BinaryAddressMapper::ExtractIntraFunctionPaths(
+    const BinaryAddressBranchPath& address_path,
+    IntraFunctionPathBuffer& buffer) const {
+  return IntraFunctionPathsExtractor(this, &buffer).Extract(address_path);
+}
+
+int IntraFunctionPathBuffer::AddPath(int64_t pid, absl::Time sample_time,
+                                     const FlatBbHandleBranch& bb_branch) {
+  if (num_paths_ == paths_.size()) {
+    if (paths_.size() == paths_.capacity()) ++allocations_;
+    paths_.emplace_back();
+    if (call_rets_storage_.size() == call_rets_storage_.capacity())
+      ++allocations_;
+    call_rets_storage_.emplace_back();
+  }
+  const int path_index = num_paths_++;
+  FlatBbHandleBranchPath& path = paths_[path_index];
+  path.pid = pid;
+  path.sample_time = sample_time;
+  TruncateBranches(path_index, 0);
+  path.returns_to = std::nullopt;
+  AppendBranch(path_index, bb_branch);
+  return path_index;
+}
+
+void IntraFunctionPathBuffer::AppendBranch(
+    int path_index, const FlatBbHandleBranch& bb_branch) {
+  CHECK(bb_branch.call_rets.empty());
+  std::vector<FlatBbHandleBranch>& branches = path(path_index).branches;
+  std::vector<std::vector<CallRetInfo>>& storage =
+      call_rets_storage_[path_index];
+  if (branches.size() == storage.size()) {
+    if (storage.size() == storage.capacity()) ++allocations_;
+    storage.emplace_back();
+  }
+  if (branches.size() == branches.capacity()) ++allocations_;
+  branches.push_back(bb_branch);
+  branches.back().call_rets.swap(storage[branches.size() - 1]);
+}
+
+void IntraFunctionPathBuffer::AppendCallRet(int path_index,
+                                            CallRetInfo call_ret) {
+  std::vector<FlatBbHandleBranch>& branches = path(path_index).branches;
+  CHECK(!branches.empty());
+  AppendCallRet(branches.back(), call_ret);
+}
+
+void IntraFunctionPathBuffer::AppendCallRet(FlatBbHandleBranch& bb_branch,
+                                            CallRetInfo call_ret) {
+  if (bb_branch.call_rets.size() == bb_branch.call_rets.capacity())
+    ++allocations_;
+  bb_branch.call_rets.push_back(call_ret);
+}
+
+void IntraFunctionPathBuffer::MergeCallsites() {
+  for (int path_index = 0; path_index < num_paths_; ++path_index) {
+    std::vector<FlatBbHandleBranch>& branches = paths_[path_index].branches;
+    // Kept branches are copied into the storage of their new position, rather
+    // than moved, so that every position keeps its own `call_rets` storage.
+    int last_kept = 0;
+    for (int i = 1; i < branches.size(); ++i) {
+      FlatBbHandleBranch& prev_branch = branches[last_kept];
+      const FlatBbHandleBranch& branch = branches[i];
+      if (prev_branch.is_callsite() && branch.is_callsite() &&
+          prev_branch.from_bb == branch.from_bb) {
+        CHECK(prev_branch.from_bb == prev_branch.to_bb)
+            << prev_branch << " is not a callsite in a single block.";
+        for (const CallRetInfo& call_ret : branch.call_rets)
+          AppendCallRet(prev_branch, call_ret);
+        continue;
+      }
+      if (++last_kept == i) continue;
+      FlatBbHandleBranch& kept_branch = branches[last_kept];
+      kept_branch.from_bb = branch.from_bb;
+      kept_branch.from_bb_flat_index = branch.from_bb_flat_index;
+      kept_branch.to_bb = branch.to_bb;
+      kept_branch.to_bb_flat_index = branch.to_bb_flat_index;
+      kept_branch.call_rets.clear();
+      for (const CallRetInfo& call_ret : branch.call_rets)
+        AppendCallRet(kept_branch, call_ret);
+    }
+    TruncateBranches(path_index, last_kept + 1);
+  }
+}
+
+void IntraFunctionPathBuffer::TruncateBranches(int path_index, int size) {
+  std::vector<FlatBbHandleBranch>& branches = paths_[path_index].branches;
+  std::vector<std::vector<CallRetInfo>>& storage =
+      call_rets_storage_[path_index];
+  for (int i = size; i < branches.size(); ++i) {
+    branches[i].call_rets.clear();
+    branches[i].call_rets.swap(storage[i]);
+  }
+  branches.erase(branches.begin() + size, branches.end());
+}
+
+std::vector<int>& IntraFunctionPathBuffer::GetOrInsertCallStack(
+    int function_index) {
+  if (std::vector<int>* call_stack = FindCallStack(function_index))
+    return *call_stack;
+  if (num_call_stacks_ == call_stacks_.size()) {
+    if (call_stacks_.size() == call_stacks_.capacity()) ++allocations_;
+    call_stacks_.emplace_back();
+  }
+  auto& [stack_function_index, call_stack] = call_stacks_[num_call_stacks_++];
+  stack_function_index = function_index;
+  call_stack.clear();
+  return call_stack;
+}
+
+void IntraFunctionPathBuffer::PushCallStack(int function_index,
+                                            int path_index) {
+  std::vector<int>& call_stack = GetOrInsertCallStack(function_index);
+  if (call_stack.size() == call_stack.capacity()) ++allocations_;
+  call_stack.push_back(path_index);
+}
+
+std::vector<int>* IntraFunctionPathBuffer::FindCallStack(int function_index) {
+  for (int i = 0; i < num_call_stacks_; ++i) {
+    if (call_stacks_[i].first == function_index) return &call_stacks_[i].second;
+  }
+  return nullptr;
 }
 
 BinaryAddressMapperBuilder::BinaryAddressMapperBuilder(
@@ -806,16 +971,36 @@ BinaryAddressMapper::BinaryAddressMapper(
       bb_addr_map_(std::move(bb_addr_map)),
       symbol_info_map_(std::move(symbol_info_map)) {}
 
-absl::StatusOr<std::unique_ptr<BinaryAddressMapper>> BuildBinaryAddressMapper(
-    const PropellerOptions& options, const BinaryContent& binary_content,
-    PropellerStats& stats, const absl::flat_hash_set<uint64_t>* hot_addresses) {
+absl::StatusOr<BinaryAddressMapperInputs> ReadBinaryAddressMapperInputs(
+    const BinaryContent& binary_content) {
   LOG(INFO) << "Started reading the binary content from: "
             << binary_content.file_name;
+  // The symbol table and the BB address map are independent, so the symbol
+  // table is read on a separate thread.
+  std::future<absl::flat_hash_map<uint64_t, FunctionSymbolInfo>>
+      symbol_info_map = std::async(std::launch::async, GetSymbolInfoMap,
+                                   std::cref(binary_content));
   BbAddrMapData bb_addr_map;
   ASSIGN_OR_RETURN(bb_addr_map, ReadBbAddrMap(binary_content));
+  return BinaryAddressMapperInputs{
+      .symbol_info_map = symbol_info_map.get(),
+      .bb_addr_maps = std::move(bb_addr_map.bb_addr_maps)};
+}
+
+absl::StatusOr<std::unique_ptr<BinaryAddressMapper>> BuildBinaryAddressMapper(
+    const PropellerOptions& options, const BinaryContent& binary_content,
+    PropellerStats& stats, const absl::flat_hash_set<uint64_t>* hot_addresses) {
+  ASSIGN_OR_RETURN(BinaryAddressMapperInputs inputs,
+                   ReadBinaryAddressMapperInputs(binary_content));
+  return BuildBinaryAddressMapper(options, std::move(inputs), stats,
+                                  hot_addresses);
+}
 
-  return BinaryAddressMapperBuilder(GetSymbolInfoMap(binary_content),
-                                    std::move(bb_addr_map.bb_addr_maps), stats,
+absl::StatusOr<std::unique_ptr<BinaryAddressMapper>> BuildBinaryAddressMapper(
+    const PropellerOptions& options, BinaryAddressMapperInputs inputs,
+    PropellerStats& stats, const absl::flat_hash_set<uint64_t>* hot_addresses) {
+  return BinaryAddressMapperBuilder(std::move(inputs.symbol_info_map),
+                                    std::move(inputs.bb_addr_maps), stats,
                                     &options)
       .Build(hot_addresses);
 }
@@ -19,17 +19,20 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/container/btree_set.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/log/check.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_join.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Object/ELFTypes.h"
@@ -118,6 +121,96 @@ struct FlatBbHandleBranchPath {
   }
 };
 
+// Reusable storage for the intra-function paths extracted from LBR samples.
+// Paths, their branch vectors, the `call_rets` vectors of their branches and
+// call stacks are recycled across calls to
+// `BinaryAddressMapper::ExtractIntraFunctionPaths`. `call_rets` storage is
+// kept per path and branch position, so extracting the paths of a sample does
+// not allocate once the buffer has seen samples of the same shape.
+class IntraFunctionPathBuffer {
+ public:
+  IntraFunctionPathBuffer() = default;
+
+  IntraFunctionPathBuffer(const IntraFunctionPathBuffer&) = delete;
+  IntraFunctionPathBuffer& operator=(const IntraFunctionPathBuffer&) = delete;
+  IntraFunctionPathBuffer(IntraFunctionPathBuffer&&) = default;
+  IntraFunctionPathBuffer& operator=(IntraFunctionPathBuffer&&) = default;
+
+  // Returns the paths currently stored in the buffer.
+  absl::Span<const FlatBbHandleBranchPath> paths() const {
+    return absl::MakeConstSpan(paths_.data(), num_paths_);
+  }
+
+  // Returns the number of times the buffer had to allocate memory because its
+  // recycled storage was not large enough. Every growth of the paths, their
+  // branches, the branches' `call_rets` and the call stacks is counted.
+  int64_t allocations() const { return allocations_; }
+
+  // Removes all paths and call stacks, while keeping their storage for reuse.
+  void Clear() {
+    num_paths_ = 0;
+    num_call_stacks_ = 0;
+  }
+
+  FlatBbHandleBranchPath& path(int path_index) {
+    CHECK_LT(path_index, num_paths_);
+    return paths_[path_index];
+  }
+
+  // Adds a new path with a single branch `bb_branch` and returns its index.
+  // `bb_branch` must not have any `call_rets`.
+  int AddPath(int64_t pid, absl::Time sample_time,
+              const FlatBbHandleBranch& bb_branch);
+
+  // Inserts `bb_branch` at the end of the path with index `path_index`.
+  // `bb_branch` must not have any `call_rets`.
+  void AppendBranch(int path_index, const FlatBbHandleBranch& bb_branch);
+
+  // Inserts `call_ret` at the end of the `call_rets` of the last branch of the
+  // path with index `path_index`.
+  void AppendCallRet(int path_index, CallRetInfo call_ret);
+
+  // Merges adjacent callsite branches of every path by merging all of their
+  // calls into the first one, while keeping the order.
+  void MergeCallsites();
+
+  // Returns the call stack (indices of the calling paths) of the function with
+  // index `function_index`, inserting an empty one if it does not exist.
+  std::vector<int>& GetOrInsertCallStack(int function_index);
+
+  // Pushes `path_index` onto the call stack of the function with index
+  // `function_index`, inserting the call stack if it does not exist.
+  void PushCallStack(int function_index, int path_index);
+
+  // Returns the call stack of the function with index `function_index`, or
+  // `nullptr` if it does not exist.
+  std::vector<int>* FindCallStack(int function_index);
+
+ private:
+  // Inserts `call_ret` at the end of `bb_branch.call_rets`.
+  void AppendCallRet(FlatBbHandleBranch& bb_branch, CallRetInfo call_ret);
+
+  // Removes the branches of the path with index `path_index` from position
+  // `size` on, keeping their `call_rets` storage.
+  void TruncateBranches(int path_index, int size);
+
+  // Only the first `num_paths_` paths are valid; the rest are kept for their
+  // storage.
+  std::vector<FlatBbHandleBranchPath> paths_;
+  int num_paths_ = 0;
+  // `call_rets` storage of every path in `paths_`, indexed by branch position.
+  // The storage of position `i` of a path is moved into its branch at position
+  // `i` while the branch exists, and moved back when the branch is removed.
+  // This way, each position always reuses the same storage.
+  std::vector<std::vector<std::vector<CallRetInfo>>> call_rets_storage_;
+  // Call stacks as (function index, path indices) pairs. There are only a few
+  // functions in every sample, so these are searched linearly. Only the first
+  // `num_call_stacks_` are valid.
+  std::vector<std::pair<int, std::vector<int>>> call_stacks_;
+  int num_call_stacks_ = 0;
+  int64_t allocations_ = 0;
+};
+
 // Finds basic block entries from binary addresses.
 class BinaryAddressMapper {
  public:
@@ -275,6 +368,13 @@ class BinaryAddressMapper {
   std::vector<FlatBbHandleBranchPath> ExtractIntraFunctionPaths(
       const BinaryAddressBranchPath& address_path) const;
 
+  // Same as above, but extracts the paths into `buffer`, reusing its storage,
+  // and returns them. The returned paths are valid until `buffer` is used
+  // again.
+  absl::Span<const FlatBbHandleBranchPath> ExtractIntraFunctionPaths(
+      const BinaryAddressBranchPath& address_path,
+      IntraFunctionPathBuffer& buffer) const;
+
  private:
   absl::btree_set<int> selected_functions_;
 
@@ -299,6 +399,20 @@ class BinaryAddressMapper {
   absl::flat_hash_map<int, FunctionSymbolInfo> symbol_info_map_;
 };
 
+// The function symbols and BB address maps of a binary, which is all that
+// `BuildBinaryAddressMapper` needs to read from it.
+struct BinaryAddressMapperInputs {
+  absl::flat_hash_map<uint64_t, FunctionSymbolInfo> symbol_info_map;
+  std::vector<llvm::object::BBAddrMap> bb_addr_maps;
+};
+
+// Reads the `BinaryAddressMapperInputs` of the binary represented by
+// `binary_content`. The symbol table and the BB address map are read
+// concurrently. This only needs the object file in `binary_content`, so it can
+// run concurrently with perf data reading.
+absl::StatusOr<BinaryAddressMapperInputs> ReadBinaryAddressMapperInputs(
+    const BinaryContent& binary_content);
+
 // Builds a `BinaryAddressMapper` for binary represented by `binary_content` and
 // functions with addresses in `hot_addresses`. If `hot_addresses ==
 // nullptr` all functions will be included. Does not take ownership of
@@ -308,6 +422,13 @@ absl::StatusOr<std::unique_ptr<BinaryAddressMapper>> BuildBinaryAddressMapper(
     PropellerStats& stats,
     const absl::flat_hash_set<uint64_t>* hot_addresses = nullptr);
 
+// Same as above, but builds the `BinaryAddressMapper` from `inputs` which have
+// already been read by `ReadBinaryAddressMapperInputs`.
+absl::StatusOr<std::unique_ptr<BinaryAddressMapper>> BuildBinaryAddressMapper(
+    const PropellerOptions& options, BinaryAddressMapperInputs inputs,
+    PropellerStats& stats,
+    const absl::flat_hash_set<uint64_t>* hot_addresses = nullptr);
+
 }  // namespace propeller
 
 #endif  // PROPELLER_BINARY_ADDRESS_MAPPER_H_
@@ -45,16 +45,19 @@ using ::testing::_;
 using ::testing::AllOf;
 using ::testing::Contains;
 using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
 using ::testing::Eq;
 using ::testing::FieldsAre;
 using ::testing::IsEmpty;
 using ::testing::Key;
+using ::testing::Matcher;
 using ::testing::Not;
 using ::testing::Optional;
 using ::testing::Pair;
 using ::testing::ResultOf;
 using ::testing::SizeIs;
 using ::testing::UnorderedElementsAre;
+using ::testing::UnorderedElementsAreArray;
 
 using ::llvm::object::BBAddrMap;
 
@@ -124,6 +127,31 @@ TEST(BinaryAddressMapper, BbAddrMapReadSymbolTable) {
       Contains(Pair(_, FieldsAre(ElementsAre("sample1_func"), ".text"))));
 }
 
+// Tests that reading the symbol table and the BB address map concurrently
+// gives the same inputs as reading them one after the other.
+TEST(BinaryAddressMapper, ReadsInputsConcurrently) {
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryContent> binary_content,
+      GetBinaryContent(GetPropellerTestDataFilePath("sample_section.bin")));
+  ASSERT_OK_AND_ASSIGN(BinaryAddressMapperInputs inputs,
+                       ReadBinaryAddressMapperInputs(*binary_content));
+
+  absl::flat_hash_map<uint64_t, FunctionSymbolInfo> symbol_info_map =
+      GetSymbolInfoMap(*binary_content);
+  std::vector<Matcher<std::pair<const uint64_t, FunctionSymbolInfo>>>
+      symbol_info_matchers;
+  for (const auto& [address, symbol_info] : symbol_info_map) {
+    symbol_info_matchers.push_back(
+        Pair(address, FieldsAre(ElementsAreArray(symbol_info.aliases),
+                                symbol_info.section_name)));
+  }
+  EXPECT_THAT(inputs.symbol_info_map,
+              UnorderedElementsAreArray(symbol_info_matchers));
+  ASSERT_OK_AND_ASSIGN(BbAddrMapData bb_addr_map_data,
+                       ReadBbAddrMap(*binary_content));
+  EXPECT_EQ(inputs.bb_addr_maps, bb_addr_map_data.bb_addr_maps);
+}
+
 TEST(BinaryAddressMapper, SkipEntryIfSymbolNotInSymtab) {
   ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
                        GetBinaryContent(GetPropellerTestDataFilePath(
@@ -633,6 +661,32 @@ TEST(BinaryAddressMapper, ExtractsPathsWithReturnsToBasicBlockAddress) {
                         {.function_index = 3, .flat_bb_index = 2}}}}})));
 }
 
+TEST(BinaryAddressMapper, ExtractsPathsIntoReusedBuffer) {
+  BinaryAddressBranchPath path(
+      {.pid = 123456, .branches = {{0x18cc, 0x18fa}, {0x1906, 0xFFFFFF}}});
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryContent> binary_content,
+      GetBinaryContent(GetPropellerTestDataFilePath("bimodal_sample.bin")));
+  PropellerStats stats;
+  PropellerOptions options;
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryAddressMapper> binary_address_mapper,
+      BuildBinaryAddressMapper(options, *binary_content, stats,
+                               /*hot_addresses=*/nullptr));
+
+  std::vector<FlatBbHandleBranchPath> expected_paths =
+      binary_address_mapper->ExtractIntraFunctionPaths(path);
+  IntraFunctionPathBuffer buffer;
+  EXPECT_THAT(binary_address_mapper->ExtractIntraFunctionPaths(path, buffer),
+              ElementsAreArray(expected_paths));
+  const int64_t allocations = buffer.allocations();
+  EXPECT_GT(allocations, 0);
+  // Extracting the same path again reuses the buffer's storage.
+  EXPECT_THAT(binary_address_mapper->ExtractIntraFunctionPaths(path, buffer),
+              ElementsAreArray(expected_paths));
+  EXPECT_EQ(buffer.allocations(), allocations);
+}
+
 TEST(BinaryAddressMapper, ExtractPathsSeparatesPathsWithCorruptBranches) {
   BinaryAddressBranchPath path(
       {.pid = 123456, .branches = {{0x189a, 0xFFFFF0}, {0x18c4, 0x1890}}});
@@ -709,5 +763,40 @@ TEST(BinaryAddressMapper, ExtractPathsCoalescesCallees) {
                     {.from_bb = {{.function_index = 1, .flat_bb_index = 0}}}},
                .returns_to = {{.function_index = 2, .flat_bb_index = 0}}})));
 }
+
+TEST(BinaryAddressMapper, ExtractsPathsWithCallsIntoReusedBuffer) {
+  // The path from `ExtractPathsCoalescesCallees`, whose callsites are merged.
+  BinaryAddressBranchPath path = {.pid = 7654321,
+                                  .branches = {{0x1840, 0xFFFFF0},
+                                               {0xFFFFF2, 0x1844},
+                                               {0x1845, 0x1790},
+                                               {0x17df, 0x1849},
+                                               {0x184a, 0x17e0},
+                                               {0x1833, 0x184e}}};
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryContent> binary_content,
+      GetBinaryContent(GetPropellerTestDataFilePath("bimodal_sample.x.bin")));
+  PropellerStats stats;
+  PropellerOptions options;
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryAddressMapper> binary_address_mapper,
+      BuildBinaryAddressMapper(options, *binary_content, stats,
+                               /*hot_addresses=*/nullptr));
+
+  std::vector<FlatBbHandleBranchPath> expected_paths =
+      binary_address_mapper->ExtractIntraFunctionPaths(path);
+  IntraFunctionPathBuffer buffer;
+  EXPECT_THAT(binary_address_mapper->ExtractIntraFunctionPaths(path, buffer),
+              ElementsAreArray(expected_paths));
+  const int64_t allocations = buffer.allocations();
+  EXPECT_GT(allocations, 0);
+  // Extracting the same path again reuses the storage of the paths, their
+  // branches, the branches' call_rets and the call stacks.
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_THAT(binary_address_mapper->ExtractIntraFunctionPaths(path, buffer),
+                ElementsAreArray(expected_paths));
+    EXPECT_EQ(buffer.allocations(), allocations);
+  }
+}
 }  // namespace
 }  // namespace propeller
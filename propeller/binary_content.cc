@@ -14,14 +14,18 @@
 
 #include "propeller/binary_content.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <iterator>
 #include <memory>
 #include <optional>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "absl/algorithm/container.h"
 #include "absl/container/btree_map.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/log/check.h"
@@ -49,6 +53,7 @@
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/MemoryBufferRef.h"
+#include "llvm/Support/Parallel.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/TargetParser/Triple.h"
 #include "propeller/addr2cu.h"
@@ -117,6 +122,9 @@ class ELFFileUtil : public ::propeller::ELFFileUtilBase {
 
   absl::Status InitializeKernelModule(BinaryContent& binary_content) override;
 
+  absl::StatusOr<propeller::BbAddrMapData> ReadBbAddrMapSections(
+      const propeller::BbAddrMapReadOptions& options) override;
+
  private:
   const llvm::object::ELFFile<ELFT>* elf_file_ = nullptr;
 
@@ -256,6 +264,89 @@ absl::Status ELFFileUtil<ELFT>::InitializeKernelModule(
   return absl::OkStatus();
 }
 
+template <class ELFT>
+absl::StatusOr<propeller::BbAddrMapData>
+ELFFileUtil<ELFT>::ReadBbAddrMapSections(
+    const propeller::BbAddrMapReadOptions& options) {
+  CHECK(elf_file_);
+  llvm::Expected<typename ELFT::ShdrRange> sections = elf_file_->sections();
+  if (!sections) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Failed to get sections from the ELF file: ",
+                     llvm::toString(sections.takeError())));
+  }
+  std::vector<const typename ELFT::Shdr*> bb_addr_map_sections;
+  for (const typename ELFT::Shdr& shdr : *sections) {
+    if (shdr.sh_type == llvm::ELF::SHT_LLVM_BB_ADDR_MAP)
+      bb_addr_map_sections.push_back(&shdr);
+  }
+
+  // Every section is decoded into its own slot, so tasks share no state.
+  const int num_sections = bb_addr_map_sections.size();
+  std::vector<std::vector<llvm::object::BBAddrMap>> bb_addr_maps_by_section(
+      num_sections);
+  std::vector<std::vector<llvm::object::PGOAnalysisMap>>
+      pgo_analyses_by_section(num_sections);
+  std::vector<std::string> errors_by_section(num_sections);
+  llvm::parallelFor(0, num_sections, [&](size_t i) {
+    llvm::Expected<std::vector<llvm::object::BBAddrMap>> bb_addr_map =
+        elf_file_->decodeBBAddrMap(
+            *bb_addr_map_sections[i], /*RelaSec=*/nullptr,
+            options.read_pgo_analyses ? &pgo_analyses_by_section[i]
+                                      : nullptr);
+    if (!bb_addr_map) {
+      errors_by_section[i] = llvm::toString(bb_addr_map.takeError());
+      return;
+    }
+    bb_addr_maps_by_section[i] = *std::move(bb_addr_map);
+  });
+
+  propeller::BbAddrMapData bb_addr_map_data;
+  if (options.read_pgo_analyses) bb_addr_map_data.pgo_analyses.emplace();
+  for (int i = 0; i < num_sections; ++i) {
+    if (!errors_by_section[i].empty()) {
+      return absl::InternalError(absl::StrFormat(
+          "unable to read SHT_LLVM_BB_ADDR_MAP section with index %d: %s",
+          bb_addr_map_sections[i] - sections->begin(), errors_by_section[i]));
+    }
+    absl::c_move(bb_addr_maps_by_section[i],
+                 std::back_inserter(bb_addr_map_data.bb_addr_maps));
+    if (options.read_pgo_analyses) {
+      absl::c_move(pgo_analyses_by_section[i],
+                   std::back_inserter(*bb_addr_map_data.pgo_analyses));
+    }
+  }
+  return bb_addr_map_data;
+}
+
+// A function symbol which passed the per-symbol filters in `ReadSymbolTable`.
+struct FunctionSymbol {
+  uint64_t address;
+  uint64_t size;
+  llvm::object::SymbolRef symbol_ref;
+};
+
+// Returns the function symbols in `symbols` with non-zero address and size, in
+// their original order.
+std::vector<FunctionSymbol> FilterFunctionSymbols(
+    llvm::ArrayRef<llvm::object::SymbolRef> symbols) {
+  std::vector<FunctionSymbol> function_symbols;
+  for (llvm::object::SymbolRef sr : symbols) {
+    llvm::object::ELFSymbolRef symbol(sr);
+    uint8_t stt = symbol.getELFType();
+    if (stt != llvm::ELF::STT_FUNC) continue;
+    llvm::Expected<uint64_t> address = sr.getAddress();
+    if (!address || !*address) continue;
+    llvm::Expected<llvm::StringRef> func_name = symbol.getName();
+    if (!func_name) continue;
+    const uint64_t func_size = symbol.getSize();
+    if (func_size == 0) continue;
+    function_symbols.push_back(
+        {.address = *address, .size = func_size, .symbol_ref = sr});
+  }
+  return function_symbols;
+}
+
 // Returns an AArch64 binary's thunk symbols by reading from its symbol table.
 // These are returned as a map from the thunk's address to the thunk symbol.
 absl::btree_map<uint64_t, llvm::object::ELFSymbolRef> ReadAArch64ThunkSymbols(
@@ -279,38 +370,54 @@ absl::btree_map<uint64_t, llvm::object::ELFSymbolRef> ReadAArch64ThunkSymbols(
 
 namespace propeller {
 absl::flat_hash_map<uint64_t, llvm::SmallVector<llvm::object::ELFSymbolRef>>
-ReadSymbolTable(const BinaryContent& binary_content) {
+ReadSymbolTable(const BinaryContent& binary_content,
+                int symbols_per_chunk) {
+  CHECK_GT(symbols_per_chunk, 0);
+  std::vector<llvm::object::SymbolRef> symbols;
+  for (llvm::object::SymbolRef sr : binary_content.object_file->symbols())
+    symbols.push_back(sr);
+
+  // Filtering (which needs to look up the symbol's section and name) is done
+  // in parallel. The results are merged sequentially in symbol table order so
+  // that aliases and dropped symbols are the same as for a sequential scan.
+  const int num_chunks =
+      (symbols.size() + symbols_per_chunk - 1) / symbols_per_chunk;
+  std::vector<std::vector<FunctionSymbol>> function_symbols_by_chunk(
+      num_chunks);
+  llvm::parallelFor(0, num_chunks, [&](size_t chunk) {
+    function_symbols_by_chunk[chunk] =
+        FilterFunctionSymbols(llvm::ArrayRef(symbols).slice(
+            chunk * symbols_per_chunk,
+            std::min<size_t>(symbols_per_chunk,
+                             symbols.size() - chunk * symbols_per_chunk)));
+  });
+
   absl::flat_hash_map<uint64_t, llvm::SmallVector<llvm::object::ELFSymbolRef>>
       symtab;
-  for (llvm::object::SymbolRef sr : binary_content.object_file->symbols()) {
-    llvm::object::ELFSymbolRef symbol(sr);
-    uint8_t stt = symbol.getELFType();
-    if (stt != llvm::ELF::STT_FUNC) continue;
-    llvm::Expected<uint64_t> address = sr.getAddress();
-    if (!address || !*address) continue;
-    llvm::Expected<llvm::StringRef> func_name = symbol.getName();
-    if (!func_name) continue;
-    const uint64_t func_size = symbol.getSize();
-    if (func_size == 0) continue;
-
-    auto& addr_sym_list = symtab[*address];
-    // Check whether there are already symbols on the same address, if so make
-    // sure they have the same size and thus they can be aliased.
-    bool check_size_ok = true;
-    for (auto& sym_ref : addr_sym_list) {
-      uint64_t sym_size = llvm::object::ELFSymbolRef(sym_ref).getSize();
-      if (func_size != sym_size) {
-        LOG(WARNING) << "Multiple function symbols on the same address with "
-                        "different size: "
-                     << absl::StrCat(absl::Hex(*address)) << ": '"
-                     << func_name->str() << "(" << func_size << ")' and '"
-                     << llvm::cantFail(sym_ref.getName()).str() << "("
-                     << sym_size << ")', the former will be dropped.";
-        check_size_ok = false;
-        break;
+  for (const std::vector<FunctionSymbol>& function_symbols :
+       function_symbols_by_chunk) {
+    for (const FunctionSymbol& function_symbol : function_symbols) {
+      auto& addr_sym_list = symtab[function_symbol.address];
+      // Check whether there are already symbols on the same address, if so
+      // make sure they have the same size and thus they can be aliased.
+      bool check_size_ok = true;
+      for (auto& sym_ref : addr_sym_list) {
+        uint64_t sym_size = llvm::object::ELFSymbolRef(sym_ref).getSize();
+        if (function_symbol.size != sym_size) {
+          LOG(WARNING)
+              << "Multiple function symbols on the same address with "
+                 "different size: "
+              << absl::StrCat(absl::Hex(function_symbol.address)) << ": '"
+              << llvm::cantFail(function_symbol.symbol_ref.getName()).str()
+              << "(" << function_symbol.size << ")' and '"
+              << llvm::cantFail(sym_ref.getName()).str() << "(" << sym_size
+              << ")', the former will be dropped.";
+          check_size_ok = false;
+          break;
+        }
       }
+      if (check_size_ok) addr_sym_list.push_back(function_symbol.symbol_ref);
     }
-    if (check_size_ok) addr_sym_list.push_back(sr);
   }
   return symtab;
 }
@@ -324,6 +431,27 @@ absl::btree_map<uint64_t, llvm::object::ELFSymbolRef> ReadThunkSymbols(
 
 absl::StatusOr<BbAddrMapData> ReadBbAddrMap(
     const BinaryContent& binary_content, const BbAddrMapReadOptions& options) {
+  if (!binary_content.is_relocatable) {
+    std::unique_ptr<ELFFileUtilBase> elf_file_util =
+        CreateELFFileUtil(binary_content.object_file.get());
+    CHECK(elf_file_util != nullptr);
+    absl::StatusOr<BbAddrMapData> bb_addr_map_data =
+        elf_file_util->ReadBbAddrMapSections(options);
+    if (!bb_addr_map_data.ok()) {
+      return absl::InternalError(absl::StrFormat(
+          "Failed to read the LLVM_BB_ADDR_MAP section from %s: %s.",
+          binary_content.file_name, bb_addr_map_data.status().message()));
+    }
+    if (bb_addr_map_data->bb_addr_maps.empty()) {
+      return absl::FailedPreconditionError(absl::StrFormat(
+          "'%s' does not have a non-empty LLVM_BB_ADDR_MAP section.",
+          binary_content.file_name));
+    }
+    return bb_addr_map_data;
+  }
+
+  // Relocatable objects (kernel modules) need their relocation sections to be
+  // applied, so they are decoded by LLVM sequentially.
   auto* elf_object = llvm::dyn_cast<llvm::object::ELFObjectFileBase>(
       binary_content.object_file.get());
   CHECK_NE(elf_object, nullptr);
@@ -450,10 +578,11 @@ std::unique_ptr<ELFFileUtilBase> CreateELFFileUtil(
 // Initializes BinaryContent object:
 //  - setup file content memory buffer
 //  - setup object file pointer
+//  - setup DWARF context, thread-safe if `thread_safe_dwarf_context`
 //  - setup "PIE" bit
 //  - read loadable and executable segments
 absl::StatusOr<std::unique_ptr<BinaryContent>> GetBinaryContent(
-    absl::string_view binary_file_name) {
+    absl::string_view binary_file_name, bool thread_safe_dwarf_context) {
   auto binary_content = std::make_unique<BinaryContent>();
   llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> file =
       llvm::MemoryBuffer::getFile(binary_file_name);
@@ -488,9 +617,11 @@ absl::StatusOr<std::unique_ptr<BinaryContent>> GetBinaryContent(
   if (!llvm::sys::fs::exists(dwp_file)) dwp_file = "";
   binary_content->dwp_file_name = dwp_file;
   absl::StatusOr<std::unique_ptr<llvm::DWARFContext>> dwarf_context =
-      CreateDWARFContext(*binary_content->object_file, dwp_file);
+      CreateDWARFContext(*binary_content->object_file, dwp_file,
+                         thread_safe_dwarf_context);
   if (dwarf_context.ok()) {
     binary_content->dwarf_context = std::move(*dwarf_context);
+    binary_content->thread_safe_dwarf_context = thread_safe_dwarf_context;
   } else {
     LOG(WARNING) << "Failed to create DWARF context: " << dwarf_context.status()
                  << "\nNo module names wil be available";
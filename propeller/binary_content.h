@@ -87,6 +87,9 @@ struct BinaryContent {
   std::unique_ptr<llvm::MemoryBuffer> file_content = nullptr;
   std::unique_ptr<llvm::object::ObjectFile> object_file = nullptr;
   std::unique_ptr<llvm::DWARFContext> dwarf_context = nullptr;
+  // Whether `dwarf_context` was created as thread-safe, so that it can be
+  // parsed concurrently.
+  bool thread_safe_dwarf_context = false;
   bool is_pie = false;
   // Propeller accepts relocatable object files as input only if it is a kernel
   // module.
@@ -119,6 +122,12 @@ class ELFFileUtilBase {
   virtual absl::Status InitializeKernelModule(
       BinaryContent& binary_content) = 0;
 
+  // Decodes all SHT_LLVM_BB_ADDR_MAP sections of a non-relocatable binary.
+  // Sections are decoded in parallel and their entries are concatenated in
+  // section header order, matching `ELFObjectFileBase::readBBAddrMap`.
+  virtual absl::StatusOr<BbAddrMapData> ReadBbAddrMapSections(
+      const BbAddrMapReadOptions& options) = 0;
+
   // Parses (key, value) pairs in `section_content` and store them in `modinfo`.
   static absl::StatusOr<
       absl::flat_hash_map<absl::string_view, absl::string_view>>
@@ -140,17 +149,22 @@ class ELFFileUtilBase {
 std::unique_ptr<ELFFileUtilBase> CreateELFFileUtil(
     const llvm::object::ObjectFile* object_file);
 
+// Reads the binary `binary_file_name`. If `thread_safe_dwarf_context` is true,
+// the DWARF context is created as thread-safe.
 absl::StatusOr<std::unique_ptr<BinaryContent>> GetBinaryContent(
-    absl::string_view binary_file_name);
+    absl::string_view binary_file_name, bool thread_safe_dwarf_context = false);
 
 // Returns the binary address of the symbol named `symbol_name`, or
 // `absl::NotFoundError` if the symbol is not found.
 absl::StatusOr<int64_t> GetSymbolAddress(
     const llvm::object::ObjectFile& object_file, absl::string_view symbol_name);
 
-// Returns the binary's function symbols by reading from its symbol table.
+// Returns the binary's function symbols by reading from its symbol table. The
+// symbol table is scanned in parallel chunks of `symbols_per_chunk` symbols;
+// the result is identical to a sequential scan.
 absl::flat_hash_map<uint64_t, llvm::SmallVector<llvm::object::ELFSymbolRef>>
-ReadSymbolTable(const BinaryContent& binary_content);
+ReadSymbolTable(const BinaryContent& binary_content,
+                int symbols_per_chunk = 1 << 16);
 
 // Returns the binary's thunk symbols by reading from its symbol table.
 // These are returned as a map from the thunk's address to the thunk symbol.
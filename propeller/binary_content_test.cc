@@ -14,11 +14,15 @@
 
 #include "propeller/binary_content.h"
 
+#include <cstdint>
+#include <iterator>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <string>
 #include <vector>
 
+#include "absl/algorithm/container.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/status/status_matchers.h"
 #include "absl/status/statusor.h"
@@ -26,6 +30,12 @@
 #include "absl/strings/string_view.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Object/ELFTypes.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/Casting.h"
+#include "llvm/Support/Error.h"
 #include "propeller/status_testing_macros.h"
 
 namespace propeller {
@@ -40,6 +50,7 @@ using ::testing::Not;
 using ::testing::Optional;
 using ::testing::Pair;
 using ::testing::SizeIs;
+using ::testing::UnorderedElementsAreArray;
 
 // google3-only(Using a constant makes path translation easier for Copybara.)
 constexpr absl::string_view kTestDataDir = "_main/propeller/testdata/";
@@ -94,6 +105,74 @@ TEST(ReadBbAddrMapTest, ReadBbAddrMap) {
   EXPECT_THAT(bb_addr_map_data->pgo_analyses, Optional(SizeIs(4)));
 }
 
+// Tests that the parallel decoding of the BB address map sections gives the
+// same result as LLVM's sequential decoding.
+TEST(ReadBbAddrMapTest, MatchesSequentialRead) {
+  const std::string binary = absl::StrCat(::testing::SrcDir(), kTestDataDir,
+                                          "sample_pgo_analysis_map.bin");
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(binary));
+  ASSERT_OK_AND_ASSIGN(
+      BbAddrMapData bb_addr_map_data,
+      ReadBbAddrMap(*binary_content, {.read_pgo_analyses = true}));
+
+  auto* elf_object = llvm::dyn_cast<llvm::object::ELFObjectFileBase>(
+      binary_content->object_file.get());
+  ASSERT_NE(elf_object, nullptr);
+  std::vector<llvm::object::PGOAnalysisMap> pgo_analyses;
+  std::vector<llvm::object::BBAddrMap> bb_addr_maps = llvm::cantFail(
+      elf_object->readBBAddrMap(/*TextSectionIndex=*/std::nullopt,
+                                &pgo_analyses));
+  EXPECT_EQ(bb_addr_map_data.bb_addr_maps, bb_addr_maps);
+  EXPECT_THAT(bb_addr_map_data.pgo_analyses, Optional(Eq(pgo_analyses)));
+}
+
+// Tests that the parallel decoding of a binary with functions in several text
+// sections gives the union of LLVM's decodings filtered by each text section.
+TEST(ReadBbAddrMapTest, MatchesSequentialReadFilteredBySection) {
+  const std::string binary =
+      absl::StrCat(::testing::SrcDir(), kTestDataDir, "sample_section.bin");
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(binary));
+  ASSERT_OK_AND_ASSIGN(BbAddrMapData bb_addr_map_data,
+                       ReadBbAddrMap(*binary_content));
+
+  auto* elf_object = llvm::dyn_cast<llvm::object::ELFObjectFileBase>(
+      binary_content->object_file.get());
+  ASSERT_NE(elf_object, nullptr);
+  std::vector<llvm::object::BBAddrMap> bb_addr_maps;
+  int num_text_sections_with_bb_addr_map = 0;
+  for (const llvm::object::SectionRef& section : elf_object->sections()) {
+    if (!section.isText()) continue;
+    std::vector<llvm::object::BBAddrMap> section_bb_addr_maps =
+        llvm::cantFail(elf_object->readBBAddrMap(section.getIndex()));
+    if (section_bb_addr_maps.empty()) continue;
+    ++num_text_sections_with_bb_addr_map;
+    absl::c_move(section_bb_addr_maps, std::back_inserter(bb_addr_maps));
+  }
+  EXPECT_GT(num_text_sections_with_bb_addr_map, 1);
+  EXPECT_THAT(bb_addr_map_data.bb_addr_maps,
+              UnorderedElementsAreArray(bb_addr_maps));
+  EXPECT_EQ(bb_addr_map_data.pgo_analyses, std::nullopt);
+}
+
+// Tests that scanning the symbol table in many chunks gives the same result as
+// scanning it in a single chunk.
+TEST(ReadSymbolTableTest, ChunkedReadMatchesSequentialRead) {
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryContent> binary_content,
+      GetBinaryContent(absl::StrCat(::testing::SrcDir(), kTestDataDir,
+                                    "propeller_sample_1.bin")));
+  absl::flat_hash_map<uint64_t, llvm::SmallVector<llvm::object::ELFSymbolRef>>
+      symtab = ReadSymbolTable(
+          *binary_content,
+          /*symbols_per_chunk=*/std::numeric_limits<int>::max());
+  EXPECT_THAT(symtab, Not(IsEmpty()));
+  EXPECT_EQ(ReadSymbolTable(*binary_content, /*symbols_per_chunk=*/1), symtab);
+  EXPECT_EQ(ReadSymbolTable(*binary_content, /*symbols_per_chunk=*/7), symtab);
+  EXPECT_EQ(ReadSymbolTable(*binary_content), symtab);
+}
+
 TEST(ThunkSymbolsTest, X86NoThunks) {
   ASSERT_OK_AND_ASSIGN(
       std::unique_ptr<BinaryContent> binary_content,
@@ -26,6 +26,7 @@
 #include "absl/base/nullability.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/functional/function_ref.h"
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/strings/str_cat.h"
@@ -62,6 +63,23 @@ CFGEdge* ControlFlowGraph::CreateOrUpdateEdge(CFGNode* from, CFGNode* to,
   return edge;
 }
 
+void ControlFlowGraph::RemoveInterEdgesIf(
+    absl::FunctionRef<bool(const CFGEdge& edge)> should_remove) {
+  auto new_end = std::stable_partition(
+      inter_edges_.begin(), inter_edges_.end(),
+      [&](const std::unique_ptr<CFGEdge>& edge) {
+        return !should_remove(*edge);
+      });
+  for (auto it = new_end; it != inter_edges_.end(); ++it) {
+    CFGEdge* edge = it->get();
+    std::vector<CFGEdge*>& src_outs = edge->src()->inter_outs_;
+    src_outs.erase(absl::c_find(src_outs, edge));
+    std::vector<CFGEdge*>& sink_ins = edge->sink()->inter_ins_;
+    sink_ins.erase(absl::c_find(sink_ins, edge));
+  }
+  inter_edges_.erase(new_end, inter_edges_.end());
+}
+
 CFGEdge* ControlFlowGraph::CreateEdge(CFGNode* from, CFGNode* to,
                                       int64_t weight, CFGEdgeKind kind,
                                       bool inter_section) {
@@ -256,6 +256,12 @@ class ControlFlowGraph {
   CFGEdge* CreateOrUpdateEdge(CFGNode* from, CFGNode* to, int64_t weight,
                               CFGEdgeKind kind, bool inter_section);
 
+  // Removes and destroys the inter-function edges of this CFG for which
+  // `should_remove` returns true, and detaches them from their src and sink
+  // nodes. The sink nodes may belong to other CFGs.
+  void RemoveInterEdgesIf(
+      absl::FunctionRef<bool(const CFGEdge& edge)> should_remove);
+
   // Returns the frequencies of nodes in this CFG in a vector, in the same order
   // as in `nodes_`.
   std::vector<int64_t> GetNodeFrequencies() const {
@@ -20,6 +20,7 @@
 #include "absl/container/flat_hash_map.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "propeller/cfg_edge.h"
 #include "propeller/cfg_edge_kind.h"
 #include "propeller/cfg_id.h"
 #include "propeller/cfg_matchers.h"
@@ -249,6 +250,31 @@ TEST(LlvmPropellerCfg, CloneCfg) {
           CfgInterEdgesMatcher())));
 }
 
+TEST(LlvmPropellerCfg, RemoveInterEdgesIf) {
+  absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs =
+      TestCfgBuilder(
+          {.cfg_args = {{".section", 0, "foo", {{0x1000, 0, 0x10}}, {}},
+                        {".section", 1, "bar", {{0x2000, 0, 0x20}}, {}},
+                        {".section", 2, "baz", {{0x3000, 0, 0x10}}, {}}},
+           .inter_edge_args = {{0, 0, 1, 0, 10, CFGEdgeKind::kCall},
+                               {0, 0, 2, 0, 7, CFGEdgeKind::kCall}}})
+          .Build();
+  ASSERT_THAT(cfgs, UnorderedElementsAre(Key(0), Key(1), Key(2)));
+  cfgs.at(0)->RemoveInterEdgesIf([](const CFGEdge& edge) {
+    return edge.sink()->function_index() == 1;
+  });
+  auto edge_to_baz = IsCfgEdge(
+      NodeInterIdIs(InterCfgId{.function_index = 0, .intra_cfg_id = {0, 0}}),
+      NodeInterIdIs(InterCfgId{.function_index = 2, .intra_cfg_id = {0, 0}}),
+      7, CFGEdgeKind::kCall);
+  EXPECT_THAT(cfgs.at(0)->inter_edges(), ElementsAre(Pointee(edge_to_baz)));
+  EXPECT_THAT(cfgs.at(0)->GetEntryNode()->inter_outs(),
+              ElementsAre(Pointee(edge_to_baz)));
+  EXPECT_THAT(cfgs.at(1)->GetEntryNode()->inter_ins(), IsEmpty());
+  EXPECT_THAT(cfgs.at(2)->GetEntryNode()->inter_ins(),
+              ElementsAre(Pointee(edge_to_baz)));
+}
+
 TEST(LlvmPropellerCfg, GetNodeFrequencyStats) {
   absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs =
       TestCfgBuilder(
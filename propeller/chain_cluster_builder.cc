@@ -14,6 +14,7 @@
 
 #include "propeller/chain_cluster_builder.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <tuple>
@@ -23,10 +24,13 @@
 #include "absl/algorithm/container.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/log/check.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "propeller/cfg_edge.h"
 #include "propeller/cfg_node.h"
 #include "propeller/node_chain.h"
+#include "propeller/propeller_statistics.h"
 
 namespace propeller {
 
@@ -40,6 +44,9 @@ constexpr int64_t kExecutionDensityDegradationThreshold = 8;
 // We avoid clustering chains with less than kChainExecutionDensityThreshold
 // execution density.
 constexpr double kChainExecutionDensityThreshold = 0.005;
+// Maximum number of following clusters considered for filling the remaining
+// space of a page in `PackClustersIntoPages`.
+constexpr int kPagePackingLookahead = 64;
 
 absl::flat_hash_map<const CFGNode*, const NodeChain*> BuildNodeToChainMap(
     absl::Span<const std::unique_ptr<const NodeChain>> chains) {
@@ -54,9 +61,12 @@ absl::flat_hash_map<const CFGNode*, const NodeChain*> BuildNodeToChainMap(
 
 ChainClusterBuilder::ChainClusterBuilder(
     const PropellerCodeLayoutParameters& code_layout_params,
-    std::vector<std::unique_ptr<const NodeChain>> chains)
+    std::vector<std::unique_ptr<const NodeChain>> chains,
+    PropellerStats::CodeLayoutStats& stats, absl::Time deadline)
     : code_layout_params_(code_layout_params),
-      node_to_chain_map_(BuildNodeToChainMap(chains)) {
+      node_to_chain_map_(BuildNodeToChainMap(chains)),
+      stats_(stats),
+      deadline_(deadline) {
   for (auto& chain : chains) {
     const NodeChain* chain_ptr = chain.get();
     // Transfer the ownership of chains to clusters.
@@ -197,6 +207,10 @@ ChainClusterBuilder::BuildClusters() && {
                });
 
   for (const NodeChain* chain : chains_sorted_by_incoming_weight) {
+    if (deadline_ != absl::InfiniteFuture() && absl::Now() >= deadline_) {
+      ++stats_.n_cluster_builds_over_budget;
+      break;
+    }
     // Do not merge clusters when the execution density is negligible.
     if (chain->exec_density() < kChainExecutionDensityThreshold) continue;
     MergeWithBestPredecessorCluster(*chain);
@@ -212,4 +226,65 @@ ChainClusterBuilder::BuildClusters() && {
   return built_clusters;
 }
 
+int CountHotPages(
+    absl::Span<const std::unique_ptr<const ChainCluster>> clusters,
+    uint64_t page_size) {
+  CHECK_GT(page_size, 0);
+  int n_hot_pages = 0;
+  // The pages of hot nodes are visited in increasing order, so every page is
+  // counted once by only counting the pages after the last counted one.
+  int64_t last_hot_page = -1;
+  uint64_t address = 0;
+  for (const std::unique_ptr<const ChainCluster>& cluster : clusters) {
+    cluster->VisitEachNodeRef([&](const CFGNode& node) {
+      if (node.CalculateFrequency() != 0) {
+        int64_t first_page = address / page_size;
+        int64_t last_page =
+            (address + std::max(node.size(), 1) - 1) / page_size;
+        first_page = std::max(first_page, last_hot_page + 1);
+        if (last_page >= first_page) {
+          n_hot_pages += last_page - first_page + 1;
+          last_hot_page = last_page;
+        }
+      }
+      address += node.size();
+    });
+  }
+  return n_hot_pages;
+}
+
+std::vector<std::unique_ptr<const ChainCluster>> PackClustersIntoPages(
+    std::vector<std::unique_ptr<const ChainCluster>> clusters,
+    uint64_t page_size) {
+  CHECK_GT(page_size, 0);
+  std::vector<std::unique_ptr<const ChainCluster>> packed_clusters;
+  packed_clusters.reserve(clusters.size());
+  uint64_t address = 0;
+  auto place = [&](std::unique_ptr<const ChainCluster>& cluster) {
+    address += cluster->size();
+    packed_clusters.push_back(std::move(cluster));
+  };
+  for (int i = 0; i != clusters.size(); ++i) {
+    // Skip the clusters already placed to fill a page.
+    if (clusters[i] == nullptr) continue;
+    uint64_t remaining_size = page_size - address % page_size;
+    // Nothing is gained by moving a cluster which fits in the current page or
+    // which already starts at a page boundary.
+    if (static_cast<uint64_t>(clusters[i]->size()) > remaining_size &&
+        remaining_size != page_size) {
+      for (int j = i + 1;
+           j != clusters.size() && j <= i + kPagePackingLookahead; ++j) {
+        if (clusters[j] == nullptr || clusters[j]->freq() == 0 ||
+            static_cast<uint64_t>(clusters[j]->size()) > remaining_size) {
+          continue;
+        }
+        remaining_size -= clusters[j]->size();
+        place(clusters[j]);
+      }
+    }
+    place(clusters[i]);
+  }
+  return packed_clusters;
+}
+
 }  // namespace propeller
@@ -16,6 +16,7 @@
 #define PROPELLER_CHAIN_CLUSTER_BUILDER_H_
 
 #include <algorithm>
+#include <cstdint>
 #include <iterator>
 #include <memory>
 #include <utility>
@@ -24,10 +25,13 @@
 #include "absl/algorithm/container.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/functional/function_ref.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "propeller/cfg_id.h"
 #include "propeller/cfg_node.h"
 #include "propeller/node_chain.h"
 #include "propeller/propeller_options.pb.h"
+#include "propeller/propeller_statistics.h"
 
 namespace propeller {
 
@@ -97,16 +101,19 @@ class ChainClusterBuilder {
  public:
   // ChainClusterBuilder constructor: This initializes one cluster per each
   // chain and transfers the ownership of the NodeChain pointer to their
-  // associated clusters.
-  explicit ChainClusterBuilder(
-      const PropellerCodeLayoutParameters& code_layout_params,
-      std::vector<std::unique_ptr<const NodeChain>> chains);
+  // associated clusters. No more clusters are merged after `deadline`, and
+  // the clustering is then counted as over budget in `stats`.
+  ChainClusterBuilder(const PropellerCodeLayoutParameters& code_layout_params,
+                      std::vector<std::unique_ptr<const NodeChain>> chains,
+                      PropellerStats::CodeLayoutStats& stats,
+                      absl::Time deadline = absl::InfiniteFuture());
 
   // Builds and returns the clusters of chains.
   // This function builds clusters of node chains according to the
   // call-chain-clustering algorithm[1] and returns them in a vector. After this
   // is called, all clusters are moved to the vector and the `clusters_`
-  // map becomes empty.
+  // map becomes empty. If the deadline is reached, the remaining chains are not
+  // merged and the current clusters are ordered greedily by their density.
   // [1] https://dl.acm.org/doi/10.5555/3049832.3049858
   std::vector<std::unique_ptr<const ChainCluster>> BuildClusters() &&;
 
@@ -129,8 +136,31 @@ class ChainClusterBuilder {
 
   // This maps every chain to its containing cluster.
   absl::flat_hash_map<const NodeChain*, ChainCluster*> chain_to_cluster_map_;
+
+  PropellerStats::CodeLayoutStats& stats_;
+
+  // Deadline after which no more clusters are merged.
+  absl::Time deadline_;
 };
 
+// Returns the estimated number of distinct pages of `page_size` bytes which
+// contain hot (non-zero frequency) nodes when `clusters` are laid out
+// contiguously in order, starting at a page boundary.
+int CountHotPages(
+    absl::Span<const std::unique_ptr<const ChainCluster>> clusters,
+    uint64_t page_size);
+
+// Reorders `clusters` so that fewer hot clusters straddle `page_size`
+// boundaries when laid out contiguously, starting at a page boundary. Clusters
+// keep their order, except that when a cluster does not fit in the remaining
+// space of the current page, that space is first filled by the following hot
+// clusters (within a bounded lookahead) which fit in it. Since clusters are
+// ordered by decreasing execution density, this fills every page with the
+// densest clusters which fit in it.
+std::vector<std::unique_ptr<const ChainCluster>> PackClustersIntoPages(
+    std::vector<std::unique_ptr<const ChainCluster>> clusters,
+    uint64_t page_size);
+
 }  // namespace propeller
 
 #endif  //  THIRD_PARTY_LLVM_PROPELLER_CHAIN_CLUSTER_BUILDER_H_
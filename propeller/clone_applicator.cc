@@ -14,6 +14,8 @@
 
 #include "propeller/clone_applicator.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <memory>
@@ -29,6 +31,7 @@
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/status/statusor.h"
+#include "llvm/Support/Parallel.h"
 #include "propeller/cfg.h"
 #include "propeller/cfg_edge.h"
 #include "propeller/cfg_edge_kind.h"
@@ -53,27 +56,213 @@ void SortNodesByFrequency(std::vector<CFGNode*>& nodes) {
   });
 }
 
-// Creates inter-function edges for `clone_cfgs_by_index` based on
-// inter-function edges from `program_cfg` and the inter-function edge changes
-// in `cfg_changes_by_function_index`.
+// Result of applying the clonings of a single function.
+struct FunctionCloningResult {
+  // The CFG with the clonings applied, or `nullptr` if no cloning was applied.
+  std::unique_ptr<ControlFlowGraph> clone_cfg;
+  // CFG changes of the applied clonings, in the order they were applied.
+  std::vector<CfgChangeFromPathCloning> cfg_changes;
+  // Total score gain of the applied clonings.
+  double score_gain = 0;
+  // Number of layouts of the function computed from scratch.
+  int layouts_from_scratch = 0;
+};
+
+// Greedily applies `clonings`, which must be sorted in descending order of
+// their scores, to `cfg`. Every cloning after the first applied one is
+// re-evaluated. Only reads `cfg` and `function_path_profile`, so different
+// functions can be processed concurrently.
+FunctionCloningResult ApplyFunctionClonings(
+    const PropellerCodeLayoutParameters& code_layout_params,
+    const PathProfileOptions& path_profile_options,
+    std::vector<EvaluatedPathCloning> clonings, const ControlFlowGraph& cfg,
+    const FunctionPathProfile& function_path_profile) {
+  FunctionCloningResult result;
+  CfgBuilder cfg_builder(&cfg);
+  auto compute_optimal_layout_info = [&]() {
+    ++result.layouts_from_scratch;
+    std::unique_ptr<ControlFlowGraph> clone_cfg = cfg_builder.Clone().Build();
+    SectionLayoutInfo code_layout_result =
+        CodeLayout(code_layout_params, {clone_cfg.get()},
+                   /*initial_chains=*/{})
+            .GenerateLayout();
+    CHECK_EQ(code_layout_result.layouts_by_function_index.size(), 1);
+    return code_layout_result.layouts_by_function_index.begin()->second;
+  };
+  std::optional<propeller::FunctionLayoutInfo> optimal_layout_info;
+
+  for (EvaluatedPathCloning& cloning : clonings) {
+    auto register_cloning = [&](EvaluatedPathCloning cloning) {
+      result.score_gain += *cloning.score;
+      cfg_builder.AddCfgChange(cloning.cfg_change);
+      result.cfg_changes.push_back(std::move(cloning.cfg_change));
+      // The CFG has changed, so `optimal_layout_info` must be updated. The
+      // layout computed when evaluating this cloning is for exactly the new
+      // CFG and can be used instead when available. Otherwise, reset it so
+      // it's recomputed from scratch.
+      optimal_layout_info = std::move(cloning.layout_info);
+    };
+    // Evaluate clonings again if any clonings have been applied as the score
+    // may have been changed.
+    if (!cfg_builder.cfg_changes().empty() || !cloning.score.has_value()) {
+      if (!optimal_layout_info.has_value())
+        optimal_layout_info = compute_optimal_layout_info();
+      absl::StatusOr<EvaluatedPathCloning> evaluated_cloning =
+          EvaluateCloning(cfg_builder.Clone(), cloning.path_cloning,
+                          code_layout_params, path_profile_options,
+                          path_profile_options.min_final_cloning_score(),
+                          optimal_layout_info.value(), function_path_profile);
+      if (!evaluated_cloning.ok()) continue;
+      register_cloning(std::move(*std::move(evaluated_cloning)));
+    } else if (cloning.score < path_profile_options.min_final_cloning_score()) {
+      // We can skip the rest of the clonings since they will have lower
+      // scores.
+      break;
+    } else {
+      register_cloning(std::move(cloning));
+    }
+  }
+  if (!cfg_builder.cfg_changes().empty())
+    result.clone_cfg = std::move(cfg_builder).Build();
+  return result;
+}
+
+// Returns the size in bytes of the blocks added by applying `path_cloning` to
+// `cfg`.
+int64_t GetClonedBytes(const ControlFlowGraph& cfg,
+                       const PathCloning& path_cloning) {
+  int64_t cloned_bytes = 0;
+  for (const PathNode* path_node = path_cloning.path_node; path_node != nullptr;
+       path_node = path_node->parent()) {
+    cloned_bytes += cfg.nodes().at(path_node->node_bb_index())->size();
+  }
+  return cloned_bytes;
+}
+
+// Returns the code size budget for cloning in bytes as specified by
+// `path_profile_options`, or `std::nullopt` if cloning is not limited.
+std::optional<int64_t> GetClonedBytesBudget(
+    const PathProfileOptions& path_profile_options,
+    const ProgramCfg& program_cfg) {
+  std::optional<int64_t> budget;
+  if (path_profile_options.max_cloned_bytes() > 0)
+    budget = path_profile_options.max_cloned_bytes();
+  if (path_profile_options.max_cloned_bytes_hot_text_percent() > 0) {
+    int64_t hot_text_size = 0;
+    for (const ControlFlowGraph* cfg : program_cfg.GetCfgs()) {
+      for (const std::unique_ptr<CFGNode>& node : cfg->nodes()) {
+        if (node->CalculateFrequency() != 0) hot_text_size += node->size();
+      }
+    }
+    int64_t hot_text_budget = static_cast<int64_t>(
+        hot_text_size *
+        path_profile_options.max_cloned_bytes_hot_text_percent() / 100);
+    budget = std::min(budget.value_or(hot_text_budget), hot_text_budget);
+  }
+  return budget;
+}
+
+// Drops clonings from `clonings_by_function_index` so that their total cloned
+// bytes fit in `byte_budget`. Clonings are picked greedily across all functions
+// in decreasing order of their score per cloned byte, skipping the ones which
+// don't fit in the remaining budget. Ties are broken by the function index and
+// the position of the cloning in its vector. Returns the number of dropped
+// clonings.
+int SelectCloningsWithinBudget(
+    const ProgramCfg& program_cfg, int64_t byte_budget,
+    absl::btree_map<int, std::vector<EvaluatedPathCloning>>&
+        clonings_by_function_index) {
+  struct Candidate {
+    double score_per_byte;
+    int64_t cloned_bytes;
+    EvaluatedPathCloning* cloning;
+  };
+  std::vector<Candidate> candidates;
+  for (auto& [function_index, clonings] : clonings_by_function_index) {
+    const ControlFlowGraph& cfg = *program_cfg.GetCfgByIndex(function_index);
+    for (EvaluatedPathCloning& cloning : clonings) {
+      int64_t cloned_bytes = GetClonedBytes(cfg, cloning.path_cloning);
+      candidates.push_back(
+          {.score_per_byte = cloning.score.value_or(0) /
+                             std::max(cloned_bytes, int64_t{1}),
+           .cloned_bytes = cloned_bytes,
+           .cloning = &cloning});
+    }
+  }
+  absl::c_stable_sort(candidates, [](const Candidate& a, const Candidate& b) {
+    return a.score_per_byte > b.score_per_byte;
+  });
+  absl::flat_hash_set<const EvaluatedPathCloning*> selected_clonings;
+  int64_t remaining_budget = byte_budget;
+  for (const Candidate& candidate : candidates) {
+    if (candidate.cloned_bytes > remaining_budget) continue;
+    remaining_budget -= candidate.cloned_bytes;
+    selected_clonings.insert(candidate.cloning);
+  }
+  int n_dropped = 0;
+  for (auto& [function_index, clonings] : clonings_by_function_index) {
+    // Keep the selected clonings in their original order.
+    std::vector<EvaluatedPathCloning> selected;
+    for (EvaluatedPathCloning& cloning : clonings) {
+      if (selected_clonings.contains(&cloning)) {
+        selected.push_back(std::move(cloning));
+      } else {
+        ++n_dropped;
+      }
+    }
+    clonings = std::move(selected);
+  }
+  return n_dropped;
+}
+
+// Creates inter-function edges for `clone_cfgs_by_index` based on the
+// original inter-function edges and the inter-function edge changes in
+// `cfg_changes_by_function_index`. `clone_cfgs_by_index` holds the clone CFGs
+// of the functions in `replaced_cfgs_by_index` and the original CFGs of all
+// other functions, which still have their original inter-function edges.
+// `replaced_cfgs_by_index` holds the original CFGs which were replaced by
+// their clones. Their inter-function edges are removed.
 void CreateInterFunctionEdges(
-    const ProgramCfg& program_cfg,
+    const absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>>&
+        replaced_cfgs_by_index,
     const absl::btree_map<int, std::vector<CfgChangeFromPathCloning>>&
         cfg_changes_by_function_index,
     absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>>&
         clone_cfgs_by_index) {
-  // Mirror original inter-function edges in `program_cfg` onto
-  // `clone_cfgs_by_index`.
-  for (auto& [function_index, cfg] : program_cfg.cfgs_by_index()) {
-    ControlFlowGraph& src_clone_cfg = *clone_cfgs_by_index.at(function_index);
+  // Mirrors `edge` onto the corresponding nodes in `clone_cfgs_by_index`.
+  auto mirror_edge = [&](const CFGEdge& edge) {
+    ControlFlowGraph& src_clone_cfg =
+        *clone_cfgs_by_index.at(edge.src()->function_index());
+    ControlFlowGraph& sink_clone_cfg =
+        *clone_cfgs_by_index.at(edge.sink()->function_index());
+    src_clone_cfg.CreateEdge(
+        &src_clone_cfg.GetNodeById(edge.src()->intra_cfg_id()),
+        &sink_clone_cfg.GetNodeById(edge.sink()->intra_cfg_id()),
+        edge.weight(), edge.kind(), edge.inter_section());
+  };
+  // Redirect the edges from the original CFGs into the replaced CFGs to their
+  // clones. The edges are mirrored in the order of `inter_edges()` so the
+  // order of the created edges doesn't depend on pointer hashing.
+  for (auto& [function_index, cfg] : clone_cfgs_by_index) {
+    if (replaced_cfgs_by_index.contains(function_index)) continue;
+    std::vector<const CFGEdge*> edges_to_replaced_cfgs;
     for (const std::unique_ptr<CFGEdge>& edge : cfg->inter_edges()) {
-      ControlFlowGraph& sink_clone_cfg =
-          *clone_cfgs_by_index.at(edge->sink()->function_index());
-      src_clone_cfg.CreateEdge(
-          &src_clone_cfg.GetNodeById(edge->src()->intra_cfg_id()),
-          &sink_clone_cfg.GetNodeById(edge->sink()->intra_cfg_id()),
-          edge->weight(), edge->kind(), edge->inter_section());
+      if (replaced_cfgs_by_index.contains(edge->sink()->function_index()))
+        edges_to_replaced_cfgs.push_back(edge.get());
     }
+    if (edges_to_replaced_cfgs.empty()) continue;
+    for (const CFGEdge* edge : edges_to_replaced_cfgs) mirror_edge(*edge);
+    const absl::flat_hash_set<const CFGEdge*> edges_to_remove(
+        edges_to_replaced_cfgs.begin(), edges_to_replaced_cfgs.end());
+    cfg->RemoveInterEdgesIf(
+        [&](const CFGEdge& edge) { return edges_to_remove.contains(&edge); });
+  }
+  // Mirror the edges from the replaced CFGs onto their clones, and detach them
+  // from the original CFGs which are kept.
+  for (const auto& [function_index, cfg] : replaced_cfgs_by_index) {
+    for (const std::unique_ptr<CFGEdge>& edge : cfg->inter_edges())
+      mirror_edge(*edge);
+    cfg->RemoveInterEdgesIf([](const CFGEdge&) { return true; });
   }
 
   // Apply inter-function edge changes.
@@ -83,8 +272,9 @@ void CreateInterFunctionEdges(
     // same order as those clonings have been applied.
     // We use a vector to keep track of the current clone_number of the cloned
     // blocks (mapped by their bb_index).
+    if (function_cfg_changes.empty()) continue;
     std::vector<int> current_clone_numbers(
-        program_cfg.cfgs_by_index().at(function_index)->nodes().size(), 0);
+        replaced_cfgs_by_index.at(function_index)->nodes().size(), 0);
     for (const auto& cfg_change : function_cfg_changes) {
       for (const auto& inter_edge_reroute : cfg_change.inter_edge_reroutes) {
         ControlFlowGraph& src_cfg =
@@ -236,10 +426,11 @@ CloneApplicatorStats ApplyClonings(
     const PathProfileOptions& path_profile_options,
     absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
         clonings_by_function_index,
-    const propeller::ProgramCfg& program_cfg,
+    std::unique_ptr<propeller::ProgramCfg> program_cfg,
     const absl::flat_hash_map<int, FunctionPathProfile>&
         path_profiles_by_function_index) {
   double total_score_gain = 0;
+  int layouts_from_scratch = 0;
 
   LOG(INFO) << "Applying clonings...";
   absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>>
@@ -257,74 +448,69 @@ CloneApplicatorStats ApplyClonings(
     clonings_by_function_index_sorted[function_index] = std::move(clonings);
   }
 
-  for (auto& [function_index, clonings] : clonings_by_function_index_sorted) {
-    absl::c_sort(clonings, std::greater<EvaluatedPathCloning>());
-    const auto& function_path_profile =
-        path_profiles_by_function_index.at(function_index);
-
-    const ControlFlowGraph* cfg = program_cfg.GetCfgByIndex(function_index);
-    CfgBuilder cfg_builder(cfg);
-    auto compute_optimal_layout_info = [&]() {
-      std::unique_ptr<ControlFlowGraph> clone_cfg = cfg_builder.Clone().Build();
-      SectionLayoutInfo code_layout_result =
-          CodeLayout(code_layout_params, {clone_cfg.get()},
-                     /*initial_chains=*/{})
-              .GenerateLayout();
-      CHECK_EQ(code_layout_result.layouts_by_function_index.size(), 1);
-      return code_layout_result.layouts_by_function_index.begin()->second;
-    };
-    std::optional<propeller::FunctionLayoutInfo> optimal_layout_info;
-    auto& current_cfg_changes = cfg_changes_by_function_index[function_index];
+  int clonings_over_budget = 0;
+  if (std::optional<int64_t> byte_budget =
+          GetClonedBytesBudget(path_profile_options, *program_cfg);
+      byte_budget.has_value()) {
+    clonings_over_budget = SelectCloningsWithinBudget(
+        *program_cfg, *byte_budget, clonings_by_function_index_sorted);
+    LOG(INFO) << "Dropped " << clonings_over_budget
+              << " clonings to fit in the code size budget of " << *byte_budget
+              << " bytes.";
+  }
 
-    for (EvaluatedPathCloning& cloning : clonings) {
-      auto register_cloning = [&](EvaluatedPathCloning cloning) {
-        total_score_gain += *cloning.score;
-        cfg_builder.AddCfgChange(cloning.cfg_change);
-        current_cfg_changes.push_back(std::move(cloning.cfg_change));
-        // Reset `optimal_layout_info` as the CFG has changed and it must be
-        // recomputed.
-        optimal_layout_info = std::nullopt;
-      };
-      // Evaluate clonings again if any clonings have been applied as the score
-      // may have been changed.
-      if (!cfg_builder.cfg_changes().empty() || !cloning.score.has_value()) {
-        if (!optimal_layout_info.has_value())
-          optimal_layout_info = compute_optimal_layout_info();
-        absl::StatusOr<EvaluatedPathCloning> evaluated_cloning =
-            EvaluateCloning(cfg_builder.Clone(), cloning.path_cloning,
-                            code_layout_params, path_profile_options,
-                            path_profile_options.min_final_cloning_score(),
-                            optimal_layout_info.value(), function_path_profile);
-        if (!evaluated_cloning.ok()) continue;
-        register_cloning(std::move(*std::move(evaluated_cloning)));
-      } else if (cloning.score <
-                 path_profile_options.min_final_cloning_score()) {
-        // We can skip the rest of the clonings since they will have lower
-        // scores.
-        break;
-      } else {
-        register_cloning(std::move(cloning));
-      }
-    }
-    if (cfg_builder.cfg_changes().empty()) continue;
+  // Apply the clonings of every function independently in parallel. Then
+  // collect the results in the order of function indices so the total score
+  // gain and the CFG changes don't depend on the scheduling.
+  std::vector<std::pair<int, std::vector<EvaluatedPathCloning>*>>
+      function_clonings;
+  function_clonings.reserve(clonings_by_function_index_sorted.size());
+  for (auto& [function_index, clonings] : clonings_by_function_index_sorted)
+    function_clonings.emplace_back(function_index, &clonings);
+  std::vector<FunctionCloningResult> results(function_clonings.size());
+  llvm::parallelFor(0, function_clonings.size(), [&](size_t i) {
+    const auto& [function_index, clonings] = function_clonings[i];
+    results[i] = ApplyFunctionClonings(
+        code_layout_params, path_profile_options, std::move(*clonings),
+        *program_cfg->GetCfgByIndex(function_index),
+        path_profiles_by_function_index.at(function_index));
+  });
+  for (size_t i = 0; i < function_clonings.size(); ++i) {
+    const int function_index = function_clonings[i].first;
+    FunctionCloningResult& result = results[i];
+    total_score_gain += result.score_gain;
+    layouts_from_scratch += result.layouts_from_scratch;
+    cfg_changes_by_function_index[function_index] =
+        std::move(result.cfg_changes);
+    if (result.clone_cfg == nullptr) continue;
     CHECK(clone_cfgs_by_function_index
-              .insert({function_index, std::move(cfg_builder).Build()})
+              .insert({function_index, std::move(result.clone_cfg)})
               .second);
   }
 
-  // Clone the remaining CFGs (those without any clonings applied) into the
-  // clone_cfgs_by_function_index map, so we can recreate the inter-function
-  // edges.
-  for (const auto& [function_index, cfg] : program_cfg.cfgs_by_index()) {
-    clone_cfgs_by_function_index.lazy_emplace(
-        function_index,
-        [&](const auto& ctor) { ctor(function_index, CloneCfg(*cfg)); });
+  // Move the remaining CFGs (those without any clonings applied) into the
+  // clone_cfgs_by_function_index map instead of copying them. The original
+  // CFGs of the cloned functions are only kept until the inter-function edges
+  // are recreated.
+  absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>>
+      replaced_cfgs_by_index;
+  for (auto& [function_index, cfg] :
+       std::move(*program_cfg).release_cfgs_by_index()) {
+    if (clone_cfgs_by_function_index.contains(function_index)) {
+      replaced_cfgs_by_index.emplace(function_index, std::move(cfg));
+    } else {
+      clone_cfgs_by_function_index.emplace(function_index, std::move(cfg));
+    }
   }
-  CreateInterFunctionEdges(program_cfg, cfg_changes_by_function_index,
+  program_cfg.reset();
+  CreateInterFunctionEdges(replaced_cfgs_by_index,
+                           cfg_changes_by_function_index,
                            clone_cfgs_by_function_index);
   return {
       .clone_cfgs_by_function_index = std::move(clone_cfgs_by_function_index),
-      .total_score_gain = total_score_gain};
+      .total_score_gain = total_score_gain,
+      .clonings_over_budget = clonings_over_budget,
+      .layouts_from_scratch = layouts_from_scratch};
 }
 
 std::unique_ptr<propeller::ProgramCfg> ApplyClonings(
@@ -347,10 +533,18 @@ std::unique_ptr<propeller::ProgramCfg> ApplyClonings(
 
   CloneApplicatorStats clone_applicator_stats =
       ApplyClonings(fast_code_layout_params, path_profile_options,
-                    std::move(clonings_by_function_index), *program_cfg,
+                    std::move(clonings_by_function_index),
+                    std::move(program_cfg),
                     program_path_profile.path_profiles_by_function_index());
 
   cloning_stats.score_gain = clone_applicator_stats.total_score_gain;
+  cloning_stats.clonings_over_budget =
+      clone_applicator_stats.clonings_over_budget;
+  for (const auto& [function_index, function_path_profile] :
+       program_path_profile.path_profiles_by_function_index()) {
+    cloning_stats.path_nodes += function_path_profile.path_node_count();
+    cloning_stats.path_profile_bytes += function_path_profile.GetMemoryUsage();
+  }
 
   for (const auto& [function_index, clone_cfg] :
        clone_applicator_stats.clone_cfgs_by_function_index) {
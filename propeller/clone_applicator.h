@@ -36,18 +36,26 @@ struct CloneApplicatorStats {
   absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>>
       clone_cfgs_by_function_index;
   double total_score_gain = 0;
+  // Number of candidate clonings dropped to fit in the code size budget.
+  int clonings_over_budget = 0;
+  // Number of function layouts computed from scratch to evaluate clonings.
+  int layouts_from_scratch = 0;
 };
 
 // Applies all profitable clonings in `clonings_by_function_index` to
 // clones of CFGs in `program_cfg`. Returns a `CloneApplicatorStats` struct
 // containing the resulting CFGs with clonings applied and the total score gain
-// from applying the clonings.
+// from applying the clonings. Consumes `program_cfg`: the CFGs without any
+// clonings applied are moved into the result rather than copied. If
+// `path_profile_options` sets a code size budget, candidate clonings of all
+// functions are first selected in decreasing order of their score per cloned
+// byte until the budget is exhausted.
 CloneApplicatorStats ApplyClonings(
     const PropellerCodeLayoutParameters& code_layout_params,
     const PathProfileOptions& path_profile_options,
     absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
         clonings_by_function_index,
-    const ProgramCfg& program_cfg,
+    std::unique_ptr<ProgramCfg> program_cfg,
     const absl::flat_hash_map<int, FunctionPathProfile>&
         path_profiles_by_function_index);
 
@@ -16,11 +16,13 @@
 
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "propeller/cfg.h"
 #include "propeller/cfg_edge_kind.h"
 #include "propeller/cfg_id.h"
 #include "propeller/cfg_matchers.h"
@@ -39,8 +41,11 @@ namespace {
 using ::propeller_testing::ParseTextProtoOrDie;
 using ::testing::_;
 using ::testing::Contains;
+using ::testing::Key;
 using ::testing::Pair;
 using ::testing::Pointee;
+using ::testing::SizeIs;
+using ::testing::UnorderedElementsAre;
 
 struct ApplyCloningsTestCase {
   struct PathCloningArg {
@@ -78,12 +83,11 @@ TEST_P(ApplyCloningsTest, TestCloningChangeOnCfgs) {
     const PathNode* path_node = path_profile.path_profiles_by_function_index()
                                     .at(path_arg.function_index)
                                     .path_trees_by_root_bb_index()
-                                    .at(path_arg.path[0])
-                                    .get();
+                                    .at(path_arg.path[0]);
     // Follow the path to find the corresponding `PathNode`.
     for (int i = 1; i < path_arg.path.size(); ++i) {
       int bb_index = path_arg.path[i];
-      path_node = path_node->children().at(bb_index).get();
+      path_node = path_node->GetChild(bb_index);
     }
     clonings[path_arg.function_index].push_back(
         {.path_cloning = {.path_node = path_node,
@@ -93,7 +97,7 @@ TEST_P(ApplyCloningsTest, TestCloningChangeOnCfgs) {
   CloneApplicatorStats clone_applicator_stats = ApplyClonings(
       test_case.propeller_options.code_layout_params(),
       test_case.propeller_options.path_profile_options(), clonings,
-      *program_cfg, path_profile.path_profiles_by_function_index());
+      std::move(program_cfg), path_profile.path_profiles_by_function_index());
 
   for (const auto& [function_index, cfg_matcher] :
        test_case.cfg_matcher_by_function_index) {
@@ -792,5 +796,78 @@ INSTANTIATE_TEST_SUITE_P(
     [](const ::testing::TestParamInfo<ApplyCloningsTest::ParamType>& info) {
       return info.param.test_name;
     });
+
+TEST(IncrementalCloningRelayoutTest, AppliesSameClonings) {
+  ProgramPathProfile path_profile(GetDefaultPathProfileArg());
+  const FunctionPathProfile& function_path_profile =
+      path_profile.path_profiles_by_function_index().at(6);
+  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>> clonings;
+  clonings[6] = {
+      {.path_cloning = {.path_node = function_path_profile.GetPathTree(3),
+                        .function_index = 6,
+                        .path_pred_bb_index = 1}},
+      {.path_cloning = {.path_node = function_path_profile.GetPathTree(4),
+                        .function_index = 6,
+                        .path_pred_bb_index = 2}}};
+  PropellerOptions options = ParseTextProtoOrDie(
+      R"pb(code_layout_params { call_chain_clustering: false }
+           path_profile_options { min_final_cloning_score: -50 })pb");
+  CloneApplicatorStats stats = ApplyClonings(
+      options.code_layout_params(), options.path_profile_options(), clonings,
+      BuildFromCfgArg(GetDefaultProgramCfgArg()),
+      path_profile.path_profiles_by_function_index());
+  options.mutable_path_profile_options()->set_incremental_cloning_relayout(
+      true);
+  CloneApplicatorStats incremental_stats = ApplyClonings(
+      options.code_layout_params(), options.path_profile_options(), clonings,
+      BuildFromCfgArg(GetDefaultProgramCfgArg()),
+      path_profile.path_profiles_by_function_index());
+
+  // Both clonings are accepted in both modes, since the minimum score is low.
+  ASSERT_THAT(stats.clone_cfgs_by_function_index, Contains(Key(6)));
+  ASSERT_THAT(incremental_stats.clone_cfgs_by_function_index,
+              Contains(Key(6)));
+  EXPECT_THAT(stats.clone_cfgs_by_function_index.at(6)->clone_paths(),
+              SizeIs(2));
+  EXPECT_EQ(incremental_stats.clone_cfgs_by_function_index.at(6)->clone_paths(),
+            stats.clone_cfgs_by_function_index.at(6)->clone_paths());
+  // The function is laid out from scratch to evaluate the first cloning. Only
+  // without incremental relayout is it laid out again to re-evaluate the
+  // second cloning after the first one is applied.
+  EXPECT_EQ(stats.layouts_from_scratch, 2);
+  EXPECT_EQ(incremental_stats.layouts_from_scratch, 1);
+}
+
+TEST(CloningBudgetTest, DropsCloningsOverBudget) {
+  ProgramPathProfile path_profile(GetDefaultPathProfileArg());
+  const FunctionPathProfile& function_path_profile =
+      path_profile.path_profiles_by_function_index().at(6);
+  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>> clonings;
+  clonings[6] = {
+      {.path_cloning = {.path_node = function_path_profile.GetPathTree(3),
+                        .function_index = 6,
+                        .path_pred_bb_index = 1}},
+      {.path_cloning = {.path_node = function_path_profile.GetPathTree(4),
+                        .function_index = 6,
+                        .path_pred_bb_index = 2}}};
+  // Cloning block #3 adds 8 bytes and cloning block #4 adds 32 bytes, so only
+  // the first one fits in the budget.
+  PropellerOptions options = ParseTextProtoOrDie(
+      R"pb(code_layout_params { call_chain_clustering: false }
+           path_profile_options {
+             min_final_cloning_score: -50
+             max_cloned_bytes: 10
+           })pb");
+  CloneApplicatorStats stats = ApplyClonings(
+      options.code_layout_params(), options.path_profile_options(), clonings,
+      BuildFromCfgArg(GetDefaultProgramCfgArg()),
+      path_profile.path_profiles_by_function_index());
+
+  EXPECT_EQ(stats.clonings_over_budget, 1);
+  ASSERT_THAT(stats.clone_cfgs_by_function_index, Contains(Key(6)));
+  const ControlFlowGraph& cfg = *stats.clone_cfgs_by_function_index.at(6);
+  EXPECT_THAT(cfg.clone_paths(), SizeIs(1));
+  EXPECT_THAT(cfg.clones_by_bb_index(), UnorderedElementsAre(Key(3)));
+}
 }  // namespace
 }  // namespace propeller
@@ -14,6 +14,7 @@
 
 #include "propeller/code_layout.h"
 
+#include <cstddef>
 #include <cstdint>
 #include <iterator>
 #include <memory>
@@ -24,10 +25,14 @@
 #include "absl/algorithm/container.h"
 #include "absl/container/btree_map.h"
 #include "absl/container/flat_hash_map.h"
-#include "absl/functional/function_ref.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Parallel.h"
 #include "propeller/cfg.h"
+#include "propeller/cfg_edge.h"
+#include "propeller/cfg_id.h"
 #include "propeller/cfg_node.h"
 #include "propeller/chain_cluster_builder.h"
 #include "propeller/function_layout_info.h"
@@ -38,51 +43,247 @@
 #include "propeller/propeller_statistics.h"
 
 namespace propeller {
+namespace {
+// Returns the index of the community representative of `cfg_pos` in
+// `community_parent` and compresses its path.
+int FindCommunity(std::vector<int>& community_parent, int cfg_pos) {
+  while (community_parent[cfg_pos] != cfg_pos) {
+    community_parent[cfg_pos] = community_parent[community_parent[cfg_pos]];
+    cfg_pos = community_parent[cfg_pos];
+  }
+  return cfg_pos;
+}
+
+// Partitions `cfgs` into communities of CFGs which can be laid out
+// independently. CFGs are merged greedily along the heaviest inter-function
+// edges first, as long as the merged community has at most
+// `max_community_nodes` nodes. Small communities are then packed together in
+// order up to the same bound. Returns the communities in the order of their
+// first CFG in `cfgs`.
+std::vector<std::vector<const ControlFlowGraph*>> PartitionIntoCommunities(
+    const std::vector<const ControlFlowGraph*>& cfgs,
+    int max_community_nodes) {
+  absl::flat_hash_map<int, int> cfg_pos_by_function_index;
+  for (int i = 0; i != cfgs.size(); ++i)
+    cfg_pos_by_function_index.emplace(cfgs[i]->function_index(), i);
+
+  struct CallGraphEdge {
+    int64_t weight;
+    int src_pos, sink_pos;
+  };
+  std::vector<CallGraphEdge> call_graph_edges;
+  for (int i = 0; i != cfgs.size(); ++i) {
+    for (const std::unique_ptr<CFGEdge>& edge : cfgs[i]->inter_edges()) {
+      if (edge->weight() == 0 || edge->IsReturn() || edge->inter_section())
+        continue;
+      auto it = cfg_pos_by_function_index.find(edge->sink()->function_index());
+      if (it == cfg_pos_by_function_index.end() || it->second == i) continue;
+      call_graph_edges.push_back(
+          {.weight = edge->weight(), .src_pos = i, .sink_pos = it->second});
+    }
+  }
+  absl::c_sort(call_graph_edges,
+               [](const CallGraphEdge& a, const CallGraphEdge& b) {
+                 return std::make_tuple(-a.weight, a.src_pos, a.sink_pos) <
+                        std::make_tuple(-b.weight, b.src_pos, b.sink_pos);
+               });
+
+  std::vector<int> community_parent(cfgs.size());
+  std::vector<int> community_n_nodes(cfgs.size());
+  for (int i = 0; i != cfgs.size(); ++i) {
+    community_parent[i] = i;
+    community_n_nodes[i] = cfgs[i]->nodes().size();
+  }
+  for (const CallGraphEdge& edge : call_graph_edges) {
+    int src_community = FindCommunity(community_parent, edge.src_pos);
+    int sink_community = FindCommunity(community_parent, edge.sink_pos);
+    if (src_community == sink_community) continue;
+    if (community_n_nodes[src_community] + community_n_nodes[sink_community] >
+        max_community_nodes) {
+      continue;
+    }
+    // Keep the lower position as the representative.
+    if (sink_community < src_community)
+      std::swap(src_community, sink_community);
+    community_parent[sink_community] = src_community;
+    community_n_nodes[src_community] += community_n_nodes[sink_community];
+  }
+
+  // Group CFGs by community, in the order of each community's first CFG.
+  std::vector<std::vector<const ControlFlowGraph*>> communities;
+  absl::flat_hash_map<int, int> community_index_by_representative;
+  for (int i = 0; i != cfgs.size(); ++i) {
+    auto [it, inserted] = community_index_by_representative.try_emplace(
+        FindCommunity(community_parent, i), communities.size());
+    if (inserted) communities.emplace_back();
+    communities[it->second].push_back(cfgs[i]);
+  }
+
+  // Pack consecutive communities together to avoid building chains for many
+  // tiny communities separately.
+  std::vector<std::vector<const ControlFlowGraph*>> packed_communities;
+  int packed_n_nodes = 0;
+  for (std::vector<const ControlFlowGraph*>& community : communities) {
+    int n_nodes = 0;
+    for (const ControlFlowGraph* cfg : community)
+      n_nodes += cfg->nodes().size();
+    if (packed_communities.empty() ||
+        packed_n_nodes + n_nodes > max_community_nodes) {
+      packed_communities.emplace_back();
+      packed_n_nodes = 0;
+    }
+    absl::c_move(community, std::back_inserter(packed_communities.back()));
+    packed_n_nodes += n_nodes;
+  }
+  return packed_communities;
+}
+}  // namespace
 
 absl::btree_map<llvm::StringRef, SectionLayoutInfo> GenerateLayoutBySection(
     const ProgramCfg& program_cfg,
     const PropellerCodeLayoutParameters& code_layout_params,
-    PropellerStats::CodeLayoutStats& code_layout_stats) {
+    PropellerStats::CodeLayoutStats& code_layout_stats,
+    const absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>&
+        reused_layouts,
+    absl::Time start_time) {
   absl::btree_map<llvm::StringRef, SectionLayoutInfo>
       layout_info_by_section_name;
-  absl::flat_hash_map<llvm::StringRef, std::vector<const ControlFlowGraph*>>
+  const absl::flat_hash_map<llvm::StringRef,
+                            std::vector<const ControlFlowGraph*>>&
       cfgs_by_section_name = program_cfg.GetCfgsBySectionName();
-  for (const auto& [section_name, cfgs] : cfgs_by_section_name) {
-    CodeLayout code_layout(code_layout_params, cfgs);
-    layout_info_by_section_name.emplace(section_name,
-                                        code_layout.GenerateLayout());
-    code_layout_stats += code_layout.stats();
+  std::vector<
+      std::pair<llvm::StringRef, absl::Span<const ControlFlowGraph* const>>>
+      cfgs_by_section(cfgs_by_section_name.begin(), cfgs_by_section_name.end());
+  absl::c_sort(cfgs_by_section, [](const auto& a, const auto& b) {
+    return a.first < b.first;
+  });
+  std::vector<SectionLayoutInfo> section_layout_infos(cfgs_by_section.size());
+  std::vector<PropellerStats::CodeLayoutStats> section_stats(
+      cfgs_by_section.size());
+  const absl::Time deadline =
+      code_layout_params.layout_time_budget_ms() == 0
+          ? absl::InfiniteFuture()
+          : start_time + absl::Milliseconds(
+                             code_layout_params.layout_time_budget_ms());
+  auto generate_section_layout = [&](size_t i) {
+    absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>
+        section_reused_layouts;
+    for (const ControlFlowGraph* cfg : cfgs_by_section[i].second) {
+      if (auto it = reused_layouts.find(cfg->function_index());
+          it != reused_layouts.end()) {
+        section_reused_layouts.insert(*it);
+      }
+    }
+    CodeLayout code_layout(code_layout_params, cfgs_by_section[i].second,
+                           /*initial_chains=*/{}, deadline,
+                           std::move(section_reused_layouts));
+    section_layout_infos[i] = code_layout.GenerateLayout();
+    section_stats[i] = code_layout.stats();
+  };
+  // Without inter-function reordering, or with community partitioning,
+  // `CodeLayout::GenerateLayout` already lays out each section in parallel.
+  // Since nested parallel regions run sequentially, sections are only
+  // processed in parallel when each section is laid out as a whole.
+  if (code_layout_params.inter_function_reordering() &&
+      code_layout_params.inter_function_community_max_nodes() == 0) {
+    llvm::parallelFor(0, cfgs_by_section.size(), generate_section_layout);
+  } else {
+    for (size_t i = 0; i != cfgs_by_section.size(); ++i)
+      generate_section_layout(i);
+  }
+  for (size_t i = 0; i != cfgs_by_section.size(); ++i) {
+    layout_info_by_section_name.emplace(cfgs_by_section[i].first,
+                                        std::move(section_layout_infos[i]));
+    code_layout_stats += section_stats[i];
   }
   return layout_info_by_section_name;
 }
 
-// Returns the intra-procedural ext-tsp scores for the given CFGs given a
-// function for getting the address of each CFG node.
-// This is called by ComputeOrigLayoutScores and ComputeOptLayoutScores below.
-absl::flat_hash_map<int, CFGScore> CodeLayout::ComputeCfgScores(
-    absl::FunctionRef<uint64_t(const CFGNode*)> get_node_addr) {
-  absl::flat_hash_map<int, CFGScore> score_map;
+void CodeLayout::BuildReusedChains(
+    std::vector<std::unique_ptr<const NodeChain>>& chains) const {
+  for (const ControlFlowGraph* cfg : cfgs_) {
+    auto it = reused_layouts_.find(cfg->function_index());
+    if (it == reused_layouts_.end()) continue;
+    for (const FunctionLayoutInfo::BbChain& bb_chain : it->second) {
+      std::vector<std::vector<const CFGNode*>> chain_nodes;
+      chain_nodes.reserve(bb_chain.bb_bundles.size());
+      for (const FunctionLayoutInfo::BbBundle& bundle : bb_chain.bb_bundles) {
+        std::vector<const CFGNode*>& bundle_nodes = chain_nodes.emplace_back();
+        bundle_nodes.reserve(bundle.full_bb_ids.size());
+        for (const FullIntraCfgId& full_bb_id : bundle.full_bb_ids)
+          bundle_nodes.push_back(&cfg->GetNodeById(full_bb_id.intra_cfg_id));
+      }
+      chains.push_back(std::make_unique<NodeChain>(std::move(chain_nodes)));
+    }
+  }
+}
+
+// Collects the edges which contribute to the ext-tsp scores of `cfgs_`:
+// intra-function edges and (with more than one CFG) intra-section
+// inter-function edges, excluding zero-weight and return edges.
+CodeLayout::ScoredEdges CodeLayout::GetScoredEdges() const {
+  ScoredEdges scored_edges;
+  for (const ControlFlowGraph* cfg : cfgs_) {
+    scored_edges.node_index_offsets.emplace(cfg->function_index(),
+                                            scored_edges.n_nodes);
+    scored_edges.n_nodes += cfg->nodes().size();
+  }
+  absl::flat_hash_map<const CFGNode*, int> external_node_indices;
+  auto get_dense_index = [&](const CFGNode* node) {
+    if (auto it = scored_edges.node_index_offsets.find(node->function_index());
+        it != scored_edges.node_index_offsets.end()) {
+      return it->second + node->node_index();
+    }
+    auto [it, inserted] = external_node_indices.try_emplace(
+        node, scored_edges.n_nodes + scored_edges.external_nodes.size());
+    if (inserted) scored_edges.external_nodes.push_back(node);
+    return it->second;
+  };
+  auto add_edge = [&](const CFGEdge& edge) {
+    scored_edges.view.AddEdge(edge, get_dense_index(edge.src()),
+                              get_dense_index(edge.sink()));
+  };
   for (const ControlFlowGraph* cfg : cfgs_) {
-    double intra_score = 0;
     for (const auto& edge : cfg->intra_edges()) {
       if (edge->weight() == 0 || edge->IsReturn()) continue;
-      // Compute the distance between the end of src and beginning of sink.
-      int64_t distance = static_cast<int64_t>(get_node_addr(edge->sink())) -
-                         get_node_addr(edge->src()) - edge->src()->size();
-      intra_score += code_layout_scorer_.GetEdgeScore(*edge, distance);
+      add_edge(*edge);
     }
-    double inter_out_score = 0;
+    const int intra_end = scored_edges.view.size();
     if (cfgs_.size() > 1) {
       for (const auto& edge : cfg->inter_edges()) {
         if (edge->weight() == 0 || edge->IsReturn() || edge->inter_section()) {
           continue;
         }
-        int64_t distance = static_cast<int64_t>(get_node_addr(edge->sink())) -
-                           get_node_addr(edge->src()) - edge->src()->size();
-        inter_out_score += code_layout_scorer_.GetEdgeScore(*edge, distance);
+        add_edge(*edge);
       }
     }
-    score_map.emplace(cfg->function_index(),
+    scored_edges.edge_ends_by_cfg.emplace_back(intra_end,
+                                               scored_edges.view.size());
+  }
+  return scored_edges;
+}
+
+// Returns the intra-procedural ext-tsp scores for the given CFGs given the
+// address of every node, indexed by the dense indices of `scored_edges`.
+// This is called by ComputeOrigLayoutScores and ComputeOptLayoutScores below.
+absl::flat_hash_map<int, CFGScore> CodeLayout::ComputeCfgScores(
+    const ScoredEdges& scored_edges,
+    absl::Span<const uint64_t> node_addresses) const {
+  std::vector<double> edge_scores(scored_edges.view.size());
+  code_layout_scorer_.GetEdgeScores(scored_edges.view, node_addresses,
+                                    absl::MakeSpan(edge_scores));
+  absl::flat_hash_map<int, CFGScore> score_map;
+  int edges_begin = 0;
+  for (int i = 0; i != cfgs_.size(); ++i) {
+    const auto [intra_end, inter_end] = scored_edges.edge_ends_by_cfg[i];
+    double intra_score = 0;
+    for (int j = edges_begin; j != intra_end; ++j)
+      intra_score += edge_scores[j];
+    double inter_out_score = 0;
+    for (int j = intra_end; j != inter_end; ++j)
+      inter_out_score += edge_scores[j];
+    edges_begin = inter_end;
+    score_map.emplace(cfgs_[i]->function_index(),
                       CFGScore({intra_score, inter_out_score}));
   }
   return score_map;
@@ -90,59 +291,139 @@ absl::flat_hash_map<int, CFGScore> CodeLayout::ComputeCfgScores(
 
 // Returns the intra-procedural ext-tsp scores for the given CFGs under the
 // original layout.
-absl::flat_hash_map<int, CFGScore> CodeLayout::ComputeOrigLayoutScores() {
-  return ComputeCfgScores([](const CFGNode* n) { return n->addr(); });
+absl::flat_hash_map<int, CFGScore> CodeLayout::ComputeOrigLayoutScores(
+    const ScoredEdges& scored_edges) const {
+  std::vector<uint64_t> node_addresses;
+  node_addresses.reserve(scored_edges.n_nodes +
+                         scored_edges.external_nodes.size());
+  for (const ControlFlowGraph* cfg : cfgs_) {
+    for (const auto& node : cfg->nodes())
+      node_addresses.push_back(node->addr());
+  }
+  for (const CFGNode* node : scored_edges.external_nodes)
+    node_addresses.push_back(node->addr());
+  return ComputeCfgScores(scored_edges, node_addresses);
 }
 
 // Returns the intra-procedural ext-tsp scores for the given CFGs under the new
 // layout, which is described by the 'clusters' parameter.
 absl::flat_hash_map<int, CFGScore> CodeLayout::ComputeOptLayoutScores(
-    absl::Span<const std::unique_ptr<const ChainCluster>> clusters) {
+    const ScoredEdges& scored_edges,
+    absl::Span<const std::unique_ptr<const ChainCluster>> clusters) const {
   // First compute the address of each basic block under the given layout.
+  // Nodes outside `cfgs_` are not in `clusters` and are left at address 0.
   uint64_t layout_addr = 0;
-  absl::flat_hash_map<const CFGNode*, uint64_t> layout_address_map;
+  std::vector<uint64_t> node_addresses(scored_edges.n_nodes +
+                                       scored_edges.external_nodes.size());
   for (auto& cluster : clusters) {
     cluster->VisitEachNodeRef([&](const CFGNode& node) {
-      layout_address_map.emplace(&node, layout_addr);
+      node_addresses[scored_edges.node_index_offsets.at(
+                         node.function_index()) +
+                     node.node_index()] = layout_addr;
       layout_addr += node.size();
     });
   }
-
-  return ComputeCfgScores([&layout_address_map](const CFGNode* n) {
-    return layout_address_map.at(n);
-  });
+  return ComputeCfgScores(scored_edges, node_addresses);
 }
 
 SectionLayoutInfo CodeLayout::GenerateLayout() {
-  // Build optimal node chains for each CFG.
+  // Reuse the chains of the functions in `reused_layouts_` and only build
+  // chains for the remaining CFGs.
   std::vector<std::unique_ptr<const NodeChain>> built_chains;
+  BuildReusedChains(built_chains);
+  std::vector<const ControlFlowGraph*> cfgs_to_layout;
+  for (const ControlFlowGraph* cfg : cfgs_) {
+    const bool reused = reused_layouts_.contains(cfg->function_index());
+    if (!reused) cfgs_to_layout.push_back(cfg);
+    if (!cfg->is_hot()) continue;
+    ++stats_.n_hot_functions;
+    if (reused) ++stats_.n_reused_function_layouts;
+  }
+
+  // Build optimal node chains for each CFG.
   if (code_layout_scorer_.code_layout_params().inter_function_reordering()) {
-    absl::c_move(NodeChainBuilder::CreateNodeChainBuilder<
-                     NodeChainAssemblyBalancedTreeQueue>(
-                     code_layout_scorer_, cfgs_, initial_chains_, stats_)
-                     .BuildChains(),
-                 std::back_inserter(built_chains));
+    // Build the chains of every community of CFGs independently in parallel,
+    // and collect them in the order of the communities.
+    const std::vector<std::vector<const ControlFlowGraph*>> communities =
+        code_layout_scorer_.code_layout_params()
+                    .inter_function_community_max_nodes() == 0
+            ? std::vector<std::vector<const ControlFlowGraph*>>{cfgs_to_layout}
+            : PartitionIntoCommunities(
+                  cfgs_to_layout, code_layout_scorer_.code_layout_params()
+                                      .inter_function_community_max_nodes());
+    std::vector<std::vector<std::unique_ptr<NodeChain>>> chains_by_community(
+        communities.size());
+    std::vector<PropellerStats::CodeLayoutStats> stats_by_community(
+        communities.size());
+    llvm::parallelFor(0, communities.size(), [&](size_t i) {
+      if (communities[i].empty()) return;
+      chains_by_community[i] =
+          NodeChainBuilder::CreateNodeChainBuilder<
+              NodeChainAssemblyBalancedTreeQueue>(
+              code_layout_scorer_, communities[i], initial_chains_,
+              stats_by_community[i], deadline_)
+              .BuildChains();
+    });
+    for (int i = 0; i != communities.size(); ++i) {
+      absl::c_move(chains_by_community[i], std::back_inserter(built_chains));
+      stats_ += stats_by_community[i];
+    }
   } else {
-    for (auto* cfg : cfgs_) {
-      if (!cfg->is_hot()) continue;
-      absl::c_move(NodeChainBuilder::CreateNodeChainBuilder<
-                       NodeChainAssemblyIterativeQueue>(
-                       code_layout_scorer_, {cfg}, initial_chains_, stats_)
-                       .BuildChains(),
-                   std::back_inserter(built_chains));
+    // Functions are laid out independently in parallel, each with its own
+    // stats and an assembly queue selected based on its number of chains. The
+    // chains and stats are then collected in the original CFG order to keep
+    // the result deterministic.
+    std::vector<const ControlFlowGraph*> hot_cfgs;
+    absl::c_copy_if(cfgs_to_layout, std::back_inserter(hot_cfgs),
+                    [](const ControlFlowGraph* cfg) { return cfg->is_hot(); });
+    std::vector<std::vector<std::unique_ptr<NodeChain>>> chains_by_cfg(
+        hot_cfgs.size());
+    std::vector<PropellerStats::CodeLayoutStats> stats_by_cfg(hot_cfgs.size());
+    llvm::parallelFor(0, hot_cfgs.size(), [&](size_t i) {
+      const ControlFlowGraph* cfg = hot_cfgs[i];
+      // Only pass the initial chains of this CFG to avoid copying all of them
+      // for every function.
+      absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>
+          cfg_initial_chains;
+      if (auto it = initial_chains_.find(cfg->function_index());
+          it != initial_chains_.end()) {
+        cfg_initial_chains.insert(*it);
+      }
+      chains_by_cfg[i] =
+          NodeChainBuilder::CreateNodeChainBuilder<NodeChainAssemblyQueue>(
+              code_layout_scorer_, {cfg}, cfg_initial_chains, stats_by_cfg[i],
+              deadline_)
+              .BuildChains();
+    });
+    for (int i = 0; i != hot_cfgs.size(); ++i) {
+      absl::c_move(chains_by_cfg[i], std::back_inserter(built_chains));
+      stats_ += stats_by_cfg[i];
     }
   }
 
   // Further cluster the constructed chains to get the global order of all
   // nodes.
-  const std::vector<std::unique_ptr<const ChainCluster>> clusters =
+  std::vector<std::unique_ptr<const ChainCluster>> clusters =
       ChainClusterBuilder(code_layout_scorer_.code_layout_params(),
-                          std::move(built_chains))
+                          std::move(built_chains), stats_, deadline_)
           .BuildClusters();
 
-  absl::flat_hash_map<int, CFGScore> orig_score_map = ComputeOrigLayoutScores();
+  // Reorder the clusters to reduce the number of hot pages. A zero page size
+  // has no pages to pack into, so packing is skipped.
+  const uint64_t page_size =
+      code_layout_scorer_.code_layout_params().hot_page_size();
+  if (code_layout_scorer_.code_layout_params().pack_hot_pages() &&
+      page_size != 0) {
+    stats_.n_hot_pages_before_packing += CountHotPages(clusters, page_size);
+    clusters = PackClustersIntoPages(std::move(clusters), page_size);
+    stats_.n_hot_pages_after_packing += CountHotPages(clusters, page_size);
+  }
+
+  const ScoredEdges scored_edges = GetScoredEdges();
+  absl::flat_hash_map<int, CFGScore> orig_score_map =
+      ComputeOrigLayoutScores(scored_edges);
   absl::flat_hash_map<int, CFGScore> opt_score_map =
-      ComputeOptLayoutScores(clusters);
+      ComputeOptLayoutScores(scored_edges, clusters);
 
   SectionLayoutInfo section_layout_info;
   absl::btree_map<int, FunctionLayoutInfo>& function_layout_info_map =
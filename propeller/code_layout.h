@@ -22,7 +22,8 @@
 
 #include "absl/container/btree_map.h"
 #include "absl/container/flat_hash_map.h"
-#include "absl/functional/function_ref.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "llvm/ADT/StringRef.h"
 #include "propeller/cfg.h"
@@ -30,6 +31,7 @@
 #include "propeller/chain_cluster_builder.h"
 #include "propeller/code_layout_scorer.h"
 #include "propeller/function_layout_info.h"
+#include "propeller/node_chain.h"
 #include "propeller/program_cfg.h"
 #include "propeller/propeller_options.pb.h"
 #include "propeller/propeller_statistics.h"
@@ -43,24 +45,39 @@ struct SectionLayoutInfo {
 
 // Runs `CodeLayout` on every section in `program_cfg` and returns
 // the code layout results as a map keyed by section names, and valued by the
-// `SectionLayoutInfo` of all functions in each section.
+// `SectionLayoutInfo` of all functions in each section. All sections share the
+// `layout_time_budget_ms` budget in `code_layout_params`, measured from
+// `start_time`. The layouts in `reused_layouts` (keyed by function index) are
+// reused verbatim instead of being recomputed.
 absl::btree_map<llvm::StringRef, SectionLayoutInfo> GenerateLayoutBySection(
     const ProgramCfg& program_cfg,
     const PropellerCodeLayoutParameters& code_layout_params,
-    PropellerStats::CodeLayoutStats& code_layout_stats);
+    PropellerStats::CodeLayoutStats& code_layout_stats,
+    const absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>&
+        reused_layouts = {},
+    absl::Time start_time = absl::Now());
 
 // Performs code layout on a set of CFGs that belong to the same output section.
 class CodeLayout {
  public:
   // `initial_chains` describes the cfg nodes that must be placed in single
-  // chains initially to make chain merging faster.
+  // chains initially to make chain merging faster. Chains and clusters are no
+  // longer merged after `deadline`. `reused_layouts` describes the chains of
+  // the functions whose layout is reused from a previous run: these chains are
+  // passed to the cluster builder as they are, without running
+  // `NodeChainBuilder` on their functions.
   CodeLayout(const PropellerCodeLayoutParameters& code_layout_params,
-             const std::vector<const ControlFlowGraph*>& cfgs,
+             absl::Span<const ControlFlowGraph* const> cfgs,
              absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>
-                 initial_chains = {})
+                 initial_chains = {},
+             absl::Time deadline = absl::InfiniteFuture(),
+             absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>
+                 reused_layouts = {})
       : code_layout_scorer_(code_layout_params),
-        cfgs_(cfgs),
-        initial_chains_(std::move(initial_chains)) {}
+        cfgs_(cfgs.begin(), cfgs.end()),
+        initial_chains_(std::move(initial_chains)),
+        reused_layouts_(std::move(reused_layouts)),
+        deadline_(deadline) {}
 
   // This performs code layout on all cfgs in the instance and returns the
   // layout information for all functions.
@@ -77,22 +94,57 @@ class CodeLayout {
   // specified by a vector of bb_indexes of its nodes.
   const absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>
       initial_chains_;
+  // Chains of the functions whose layout is reused, keyed by function index.
+  const absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>
+      reused_layouts_;
+  // Deadline for the layout of all CFGs.
+  const absl::Time deadline_;
   PropellerStats::CodeLayoutStats stats_;
 
-  // Returns the intra-procedural ext-tsp scores for the given CFGs given a
-  // function for getting the address of each CFG node.
+  // The CFG edges which contribute to the scores of `cfgs_`. Nodes are referred
+  // to by dense indices: the nodes of every CFG in `cfgs_` are numbered by
+  // their `node_index()` offset by the number of nodes in the preceding CFGs,
+  // followed by the sink nodes of inter-function edges to other CFGs.
+  struct ScoredEdges {
+    EdgeScoringView view;
+    // Maps the function index of every CFG in `cfgs_` to the dense index of
+    // its first node.
+    absl::flat_hash_map<int, int> node_index_offsets;
+    // Total number of nodes in `cfgs_`.
+    int n_nodes = 0;
+    // Sink nodes outside `cfgs_`, indexed by their dense index minus `n_nodes`.
+    std::vector<const CFGNode*> external_nodes;
+    // The end indices of the intra-function and inter-function edges of every
+    // CFG in `view`. The edges of every CFG start at the end of the previous
+    // CFG's inter-function edges.
+    std::vector<std::pair<int, int>> edge_ends_by_cfg;
+  };
+
+  // Builds the chains of the functions in `reused_layouts_` and appends them
+  // to `chains`.
+  void BuildReusedChains(
+      std::vector<std::unique_ptr<const NodeChain>>& chains) const;
+
+  // Collects the edges which contribute to the ext-tsp scores of `cfgs_`.
+  ScoredEdges GetScoredEdges() const;
+
+  // Returns the intra-procedural ext-tsp scores for the given CFGs given the
+  // address of every node, indexed by the dense indices of `scored_edges`.
   // This is called by ComputeOrigLayoutScores and ComputeOptLayoutScores below.
   absl::flat_hash_map<int, CFGScore> ComputeCfgScores(
-      absl::FunctionRef<uint64_t(const CFGNode*)>);
+      const ScoredEdges& scored_edges,
+      absl::Span<const uint64_t> node_addresses) const;
 
   // Returns the intra-procedural ext-tsp scores for the given CFGs under the
   // original layout.
-  absl::flat_hash_map<int, CFGScore> ComputeOrigLayoutScores();
+  absl::flat_hash_map<int, CFGScore> ComputeOrigLayoutScores(
+      const ScoredEdges& scored_edges) const;
 
   // Returns the intra-procedural ext-tsp scores for the given CFGs under the
   // new layout, which is described by the 'clusters' parameter.
   absl::flat_hash_map<int, CFGScore> ComputeOptLayoutScores(
-      absl::Span<const std::unique_ptr<const ChainCluster>> clusters);
+      const ScoredEdges& scored_edges,
+      absl::Span<const std::unique_ptr<const ChainCluster>> clusters) const;
 };
 
 }  // namespace propeller
@@ -14,8 +14,11 @@
 
 #include "propeller/code_layout_scorer.h"
 
+#include <cstdint>
 #include <cstdlib>
 
+#include "absl/log/check.h"
+#include "absl/types/span.h"
 #include "propeller/cfg_edge.h"
 #include "propeller/cfg_node.h"
 #include "propeller/propeller_options.pb.h"
@@ -85,4 +88,78 @@ double PropellerCodeLayoutScorer::GetEdgeScore(const CFGEdge& edge,
   return factor * edge.weight();
 }
 
+void EdgeScoringView::AddEdge(const CFGEdge& edge, int src_index,
+                              int sink_index) {
+  src_indices_.push_back(src_index);
+  sink_indices_.push_back(sink_index);
+  weights_.push_back(edge.weight());
+  int distance_adjustment = -edge.src()->size();
+  if (edge.IsCall()) distance_adjustment += edge.src()->size() / 2;
+  if (edge.IsReturn()) distance_adjustment += edge.sink()->size() / 2;
+  distance_adjustments_.push_back(distance_adjustment);
+  kind_bits_.push_back(
+      (edge.IsBranchOrFallthrough() ? kBranchOrFallthrough : 0) |
+      (edge.IsAlwaysTaken() && !edge.IsIndirectBranch() ? kAlwaysTakenDirect
+                                                         : 0));
+}
+
+// This mirrors `GetEdgeScore`, but computes all the candidate factors and
+// selects among them instead of branching.
+void PropellerCodeLayoutScorer::GetEdgeScores(
+    const EdgeScoringView& edges, absl::Span<const uint64_t> node_addresses,
+    absl::Span<double> scores) const {
+  CHECK_EQ(scores.size(), edges.size());
+  const double fallthrough_weight = code_layout_params_.fallthrough_weight();
+  const double always_fallthrough_branch_weight =
+      code_layout_params_.always_fallthrough_branch_weight();
+  const double always_taken_nonfallthrough_branch_weight =
+      code_layout_params_.always_taken_nonfallthrough_branch_weight();
+  const double forward_jump_weight = code_layout_params_.forward_jump_weight();
+  const double forward_jump_distance =
+      code_layout_params_.forward_jump_distance();
+  const double backward_jump_weight =
+      code_layout_params_.backward_jump_weight();
+  const double backward_jump_distance =
+      code_layout_params_.backward_jump_distance();
+
+  const int* src_indices = edges.src_indices_.data();
+  const int* sink_indices = edges.sink_indices_.data();
+  const double* weights = edges.weights_.data();
+  const int* distance_adjustments = edges.distance_adjustments_.data();
+  const uint8_t* kind_bits = edges.kind_bits_.data();
+  const uint64_t* addresses = node_addresses.data();
+  double* out = scores.data();
+  for (int i = 0, n = edges.size(); i != n; ++i) {
+    const int distance =
+        static_cast<int>(static_cast<int64_t>(addresses[sink_indices[i]]) -
+                         static_cast<int64_t>(addresses[src_indices[i]])) +
+        distance_adjustments[i];
+    const bool branch_or_fallthrough =
+        kind_bits[i] & EdgeScoringView::kBranchOrFallthrough;
+    const bool always_taken_direct =
+        kind_bits[i] & EdgeScoringView::kAlwaysTakenDirect;
+    const double absolute_distance = static_cast<double>(std::abs(distance));
+    const double taken_factor =
+        always_taken_direct ? always_taken_nonfallthrough_branch_weight : 0;
+    const double fallthrough_factor =
+        fallthrough_weight +
+        (always_taken_direct ? always_fallthrough_branch_weight : 0);
+    const double forward_factor =
+        distance > 0 && absolute_distance < forward_jump_distance
+            ? forward_jump_weight *
+                  (1.0 - absolute_distance / forward_jump_distance)
+            : 0;
+    const double backward_factor =
+        distance < 0 && absolute_distance < backward_jump_distance
+            ? backward_jump_weight *
+                  (1.0 - absolute_distance / backward_jump_distance)
+            : 0;
+    const double factor = distance == 0 && branch_or_fallthrough
+                              ? fallthrough_factor
+                              : (forward_factor + backward_factor) +
+                                    taken_factor;
+    out[i] = factor * weights[i];
+  }
+}
+
 }  // namespace propeller
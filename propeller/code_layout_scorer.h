@@ -15,11 +15,44 @@
 #ifndef PROPELLER_CODE_LAYOUT_SCORER_H_
 #define PROPELLER_CODE_LAYOUT_SCORER_H_
 
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
 #include "propeller/cfg_edge.h"
 #include "propeller/propeller_options.pb.h"
 
 namespace propeller {
 
+// Structure-of-arrays view of CFG edges for scoring many edges at once by
+// `PropellerCodeLayoutScorer::GetEdgeScores`. The source and sink nodes of
+// every edge are referred to by their dense indices into an array of node
+// addresses, so the same view can be scored under different layouts.
+class EdgeScoringView {
+ public:
+  // Appends `edge`, whose source and sink nodes are at `src_index` and
+  // `sink_index` of the node address array.
+  void AddEdge(const CFGEdge& edge, int src_index, int sink_index);
+
+  int size() const { return src_indices_.size(); }
+
+ private:
+  friend class PropellerCodeLayoutScorer;
+
+  // Bits in `kind_bits_`.
+  static constexpr uint8_t kBranchOrFallthrough = 1;
+  static constexpr uint8_t kAlwaysTakenDirect = 2;
+
+  std::vector<int> src_indices_;
+  std::vector<int> sink_indices_;
+  std::vector<double> weights_;
+  // Adjustment added to the distance between the source and sink addresses:
+  // the negated source size, plus the call and return approximations of
+  // `PropellerCodeLayoutScorer::GetEdgeScore`.
+  std::vector<int> distance_adjustments_;
+  std::vector<uint8_t> kind_bits_;
+};
+
 // This class is used to calculate the layout's extended TSP score as described
 // in https://ieeexplore.ieee.org/document/9050435. Specifically, it calculates
 // the contribution of a single edge with a given distance based on the
@@ -29,6 +62,14 @@ class PropellerCodeLayoutScorer {
   explicit PropellerCodeLayoutScorer(
       const PropellerCodeLayoutParameters& params);
   double GetEdgeScore(const CFGEdge& edge, int src_sink_distance) const;
+
+  // Writes the score of every edge in `edges` into `scores`, where the address
+  // of every node is given by `node_addresses`. This gives the same result as
+  // calling `GetEdgeScore` for every edge, but uses no per-edge indirections or
+  // branches, which allows the loop to be vectorized.
+  void GetEdgeScores(const EdgeScoringView& edges,
+                     absl::Span<const uint64_t> node_addresses,
+                     absl::Span<double> scores) const;
   const PropellerCodeLayoutParameters& code_layout_params() const {
     return code_layout_params_;
   }
@@ -14,6 +14,7 @@
 
 #include "propeller/code_layout.h"
 
+#include <cstdint>
 #include <iterator>
 #include <memory>
 #include <optional>
@@ -30,15 +31,18 @@
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "llvm/ADT/StringRef.h"
 #include "propeller/cfg.h"
 #include "propeller/cfg_edge.h"
 #include "propeller/cfg_edge_kind.h"
 #include "propeller/cfg_id.h"
 #include "propeller/cfg_matchers.h"
 #include "propeller/cfg_node.h"
+#include "propeller/cfg_testutil.h"
 #include "propeller/chain_cluster_builder.h"
 #include "propeller/chain_merge_order.h"
 #include "propeller/code_layout_scorer.h"
@@ -308,9 +312,58 @@ TEST(CodeLayoutScorerTest, GetEdgeScore) {
   }
 }
 
+TEST(CodeLayoutScorerTest, GetEdgeScoresMatchesGetEdgeScore) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ProtoProgramCfg> proto_program_cfg,
+                       BuildFromCfgProtoPath(
+                           GetTestInputPath("_main/propeller/testdata/"
+                                            "simple_multi_function.protobuf")));
+  PropellerCodeLayoutParameters params;
+  params.set_fallthrough_weight(10);
+  params.set_forward_jump_weight(2);
+  params.set_backward_jump_weight(1);
+  params.set_forward_jump_distance(200);
+  params.set_backward_jump_distance(100);
+  params.set_always_fallthrough_branch_weight(3);
+  params.set_always_taken_nonfallthrough_branch_weight(0.5);
+  PropellerCodeLayoutScorer scorer(params);
+
+  // Lay out the nodes of all functions in reverse order so that the edges
+  // cover forward, backward and fallthrough distances.
+  absl::flat_hash_map<const CFGNode*, int> node_indices;
+  std::vector<uint64_t> node_addresses;
+  std::vector<const CFGEdge*> edges;
+  uint64_t address = 0;
+  for (const ControlFlowGraph* cfg :
+       proto_program_cfg->program_cfg().GetCfgs()) {
+    for (auto it = cfg->nodes().rbegin(); it != cfg->nodes().rend(); ++it) {
+      node_indices.emplace(it->get(), node_addresses.size());
+      node_addresses.push_back(address);
+      address += (*it)->size();
+    }
+    for (const auto& edge : cfg->intra_edges()) edges.push_back(edge.get());
+    for (const auto& edge : cfg->inter_edges()) edges.push_back(edge.get());
+  }
+  EdgeScoringView view;
+  for (const CFGEdge* edge : edges) {
+    view.AddEdge(*edge, node_indices.at(edge->src()),
+                 node_indices.at(edge->sink()));
+  }
+  ASSERT_EQ(view.size(), edges.size());
+  std::vector<double> scores(edges.size());
+  scorer.GetEdgeScores(view, node_addresses, absl::MakeSpan(scores));
+  for (int i = 0; i != edges.size(); ++i) {
+    const CFGEdge& edge = *edges[i];
+    const int distance =
+        static_cast<int64_t>(node_addresses[node_indices.at(edge.sink())]) -
+        node_addresses[node_indices.at(edge.src())] - edge.src()->size();
+    EXPECT_EQ(scores[i], scorer.GetEdgeScore(edge, distance));
+  }
+}
+
 // Type-parameterized test fixture for `NodeChainBuilder` tests. This allows
-// testing `NodeChainBuilder` with both `NodeChainAssemblyIterativeQueue` and
-// and `NodeChainAssemblyBalancedTreeQueue` implementations.
+// testing `NodeChainBuilder` with `NodeChainAssemblyIterativeQueue`,
+// `NodeChainAssemblyBalancedTreeQueue`, and `NodeChainAssemblyHeapQueue`
+// implementations.
 template <typename NodeChainAssemblyQueueImpl>
 class NodeChainBuilderTest : public testing::Test {
  protected:
@@ -333,7 +386,8 @@ class NodeChainBuilderTest : public testing::Test {
 
 using NodeChainAssemblyQueueTypes =
     testing::Types<NodeChainAssemblyIterativeQueue,
-                   NodeChainAssemblyBalancedTreeQueue>;
+                   NodeChainAssemblyBalancedTreeQueue,
+                   NodeChainAssemblyHeapQueue>;
 TYPED_TEST_SUITE(NodeChainBuilderTest, NodeChainAssemblyQueueTypes);
 
 // Check that MergeChain(NodeChain&, NodeChain&) properly updates the chain
@@ -519,6 +573,63 @@ TYPED_TEST(NodeChainBuilderTest, MergeChainsWithAssemblyUpdatesChainEdges) {
               UnorderedElementsAre(ChainIdIs(InterCfgId{10, {1, 0}})));
 }
 
+// Check that precomputed intra-chain edge scores give exactly the same score
+// gains as rescoring the edges crossing the splitting position.
+TYPED_TEST(NodeChainBuilderTest,
+           CachedIntraChainEdgeScoresMatchRescoredEdges) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ProtoProgramCfg> proto_program_cfg,
+                       BuildFromCfgProtoPath(GetTestInputPath(
+                           "_main/propeller/testdata/"
+                           "simple_conditionals_join.protobuf")));
+  ASSERT_THAT(proto_program_cfg->program_cfg().cfgs_by_index(),
+              UnorderedElementsAre(Key(10)));
+
+  PropellerStats::CodeLayoutStats stats;
+  NodeChainBuilder chain_builder = this->InitializeNodeChainBuilderForCfgs(
+      proto_program_cfg->program_cfg(), /*function_indices=*/{10},
+      PropellerCodeLayoutParameters(), stats);
+  chain_builder.InitNodeChains();
+  chain_builder.InitChainEdges();
+  const absl::flat_hash_map<InterCfgId, std::unique_ptr<NodeChain>>& chains =
+      chain_builder.chains();
+  chain_builder.MergeChains(*chains.at({10, {1, 0}}), *chains.at({10, {3, 0}}));
+  chain_builder.MergeChains(*chains.at({10, {1, 0}}), *chains.at({10, {2, 0}}));
+  NodeChain& split_chain = *chains.at({10, {1, 0}});
+  NodeChain& unsplit_chain = *chains.at({10, {4, 0}});
+  ASSERT_THAT(split_chain.node_bundles(), SizeIs(3));
+
+  NodeChain::IntraChainEdgeScores split_chain_edge_scores =
+      split_chain.ComputeIntraChainEdgeScores(
+          chain_builder.node_to_bundle_mapper(),
+          chain_builder.code_layout_scorer());
+  ASSERT_THAT(split_chain_edge_scores.bundle_offsets, SizeIs(3));
+  EXPECT_EQ(split_chain_edge_scores.bundle_offsets[0], 0);
+  for (ChainMergeOrder merge_order :
+       {ChainMergeOrder::kS1US2, ChainMergeOrder::kS2S1U,
+        ChainMergeOrder::kUS2S1, ChainMergeOrder::kS2US1}) {
+    for (int slice_pos : {1, 2}) {
+      absl::StatusOr<NodeChainAssembly> rescored_assembly =
+          NodeChainAssembly::BuildNodeChainAssembly(
+              chain_builder.node_to_bundle_mapper(),
+              chain_builder.code_layout_scorer(), split_chain, unsplit_chain,
+              {.merge_order = merge_order,
+               .slice_pos = slice_pos,
+               .error_on_zero_score_gain = false});
+      absl::StatusOr<NodeChainAssembly> assembly =
+          NodeChainAssembly::BuildNodeChainAssembly(
+              chain_builder.node_to_bundle_mapper(),
+              chain_builder.code_layout_scorer(), split_chain, unsplit_chain,
+              {.merge_order = merge_order,
+               .slice_pos = slice_pos,
+               .error_on_zero_score_gain = false,
+               .split_chain_edge_scores = &split_chain_edge_scores});
+      ASSERT_EQ(assembly.ok(), rescored_assembly.ok());
+      if (!assembly.ok()) continue;
+      EXPECT_EQ(assembly->score_gain(), rescored_assembly->score_gain());
+    }
+  }
+}
+
 // Test GetForcedPaths and its two separate steps (GetForcedEdges and
 // BreakCycles) in a CFG with a loop.
 TEST(CodeLayoutTest, GetForcedPathsWithLoop) {
@@ -828,6 +939,78 @@ INSTANTIATE_TEST_SUITE_P(
     [](const testing::TestParamInfo<ChainBuilderSplitThresholdTest::ParamType>&
            info) { return info.param.test_name; });
 
+// Returns the node ids of every bundle of every chain in `chains`.
+std::vector<std::vector<std::vector<InterCfgId>>> GetBundledNodeIds(
+    absl::Span<const std::unique_ptr<NodeChain>> chains) {
+  std::vector<std::vector<std::vector<InterCfgId>>> bundled_node_ids;
+  for (const std::unique_ptr<NodeChain>& chain : chains) {
+    std::vector<std::vector<InterCfgId>>& chain_node_ids =
+        bundled_node_ids.emplace_back();
+    for (const std::unique_ptr<CFGNodeBundle>& bundle : chain->node_bundles())
+      chain_node_ids.push_back(GetOrderedNodeIds(*bundle));
+  }
+  return bundled_node_ids;
+}
+
+// Parameterized on `parallel_chain_split_scoring`.
+class ParallelChainSplitScoringTest : public testing::TestWithParam<bool> {};
+
+// Returns a program with a single hot function "foo" (function index 0) in
+// ".text" with `num_nodes` blocks. Every block has a heavy edge to the next
+// block and a light edge to a pseudo-random block, so no edge is forced and
+// every block starts in its own bundle.
+std::unique_ptr<ProgramCfg> BuildCfgWithManyBundles(int num_nodes) {
+  std::vector<NodeArg> node_args;
+  std::vector<IntraEdgeArg> edge_args;
+  for (int i = 0; i < num_nodes; ++i) {
+    node_args.push_back({0x1000 + 0x10 * static_cast<uint64_t>(i), i, 0x10});
+    if (i + 1 < num_nodes) {
+      edge_args.push_back({i, i + 1, 100 + (i * 37) % 50,
+                           CFGEdgeKind::kBranchOrFallthough});
+    }
+    const int jump_target = (i * 7 + 3) % num_nodes;
+    if (jump_target != i && jump_target != i + 1) {
+      edge_args.push_back({i, jump_target, 10 + (i * 13) % 20,
+                           CFGEdgeKind::kBranchOrFallthough});
+    }
+  }
+  return BuildFromCfgArg(
+      {.cfg_args = {{".text", 0, "foo", node_args, edge_args}}});
+}
+
+TEST_P(ParallelChainSplitScoringTest, BuildsSameChainsAsSequentialScoring) {
+  // The heavy edges from each node to the next make one chain grow by one
+  // bundle at a time. Once it has 65 bundles, merging it with another chain
+  // considers 4 * 64 = 256 splitting assemblies, which is enough for them to
+  // be scored in parallel.
+  constexpr int kNumNodes = 160;
+  std::unique_ptr<ProgramCfg> program_cfg = BuildCfgWithManyBundles(kNumNodes);
+
+  PropellerCodeLayoutParameters code_layout_params;
+  code_layout_params.set_chain_split_threshold(kNumNodes);
+  PropellerStats::CodeLayoutStats sequential_stats;
+  std::vector<std::unique_ptr<NodeChain>> sequential_chains =
+      CreateNodeChainBuilderForCfgs(*program_cfg, /*function_indices=*/{0},
+                                    code_layout_params, sequential_stats)
+          .BuildChains();
+  ASSERT_THAT(sequential_chains,
+              ElementsAre(Pointee(Property(&NodeChain::node_bundles,
+                                           SizeIs(kNumNodes)))));
+
+  code_layout_params.set_parallel_chain_split_scoring(GetParam());
+  PropellerStats::CodeLayoutStats stats;
+  std::vector<std::unique_ptr<NodeChain>> chains =
+      CreateNodeChainBuilderForCfgs(*program_cfg, /*function_indices=*/{0},
+                                    code_layout_params, stats)
+          .BuildChains();
+  EXPECT_EQ(GetBundledNodeIds(chains), GetBundledNodeIds(sequential_chains));
+  EXPECT_EQ(stats.n_assemblies_by_merge_order,
+            sequential_stats.n_assemblies_by_merge_order);
+}
+
+INSTANTIATE_TEST_SUITE_P(ParallelChainSplitScoringTests,
+                         ParallelChainSplitScoringTest, testing::Bool());
+
 // This tests NodeChainBuilder::BuildChains on a single CFG (with
 // non-inter-procedural layout).
 TYPED_TEST(NodeChainBuilderTest, BuildChainsSingleCfg) {
@@ -1426,7 +1609,8 @@ TEST(CodeLayoutTest, BuildClusters) {
   PropellerCodeLayoutParameters params;
   params.set_call_chain_clustering(true);
   EXPECT_THAT(
-      ChainClusterBuilder(params, std::move(built_chains)).BuildClusters(),
+      ChainClusterBuilder(params, std::move(built_chains), stats)
+          .BuildClusters(),
       // Chains of foo and bar are merged into one cluster.
       ElementsAre(
           Pointee(ResultOf(
@@ -1443,6 +1627,52 @@ TEST(CodeLayoutTest, BuildClusters) {
                            ElementsAre(InterCfgId{4, {0, 0}})))));
 }
 
+// Test for PackClustersIntoPages on the clusters of three functions.
+TEST(CodeLayoutTest, PackClustersIntoPages) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ProtoProgramCfg> proto_program_cfg,
+                       BuildFromCfgProtoPath(
+                           GetTestInputPath("_main/propeller/testdata/"
+                                            "simple_multi_function.protobuf")));
+
+  std::vector<std::unique_ptr<const NodeChain>> built_chains;
+  PropellerStats::CodeLayoutStats stats;
+  for (const ControlFlowGraph* cfg :
+       proto_program_cfg->program_cfg().GetCfgs()) {
+    absl::c_move(NodeChainBuilder::CreateNodeChainBuilder(
+                     PropellerCodeLayoutScorer(PropellerCodeLayoutParameters()),
+                     {cfg}, /*initial_chains=*/{}, stats)
+                     .BuildChains(),
+                 std::back_inserter(built_chains));
+  }
+
+  // Without call chain clustering, the clusters of foo (20 bytes), bar (40
+  // bytes), baz (8 bytes, cold) and qux (12 bytes) are in the original order.
+  PropellerCodeLayoutParameters params;
+  params.set_call_chain_clustering(false);
+  std::vector<std::unique_ptr<const ChainCluster>> clusters =
+      ChainClusterBuilder(params, std::move(built_chains), stats)
+          .BuildClusters();
+  ASSERT_THAT(clusters,
+              ElementsAre(Pointee(Property(&ChainCluster::size, 20)),
+                          Pointee(Property(&ChainCluster::size, 40)),
+                          Pointee(Property(&ChainCluster::size, 8)),
+                          Pointee(Property(&ChainCluster::size, 12))));
+  const int n_hot_pages_before_packing = CountHotPages(clusters, 32);
+
+  // Bar does not fit in the 12 bytes remaining in the first page after foo, so
+  // they are filled by qux. Baz is cold and is not used to fill the page.
+  clusters = PackClustersIntoPages(std::move(clusters), 32);
+  EXPECT_THAT(clusters, ElementsAre(Pointee(Property(&ChainCluster::id,
+                                                     InterCfgId{0, {0, 0}})),
+                                    Pointee(Property(&ChainCluster::id,
+                                                     InterCfgId{100, {0, 0}})),
+                                    Pointee(Property(&ChainCluster::id,
+                                                     InterCfgId{1, {0, 0}})),
+                                    Pointee(Property(&ChainCluster::id,
+                                                     InterCfgId{4, {0, 0}}))));
+  EXPECT_LE(CountHotPages(clusters, 32), n_hot_pages_before_packing);
+}
+
 TEST(CodeLayoutTest, FindOptimalFallthroughNoSplitChains) {
   ASSERT_OK_AND_ASSIGN(std::unique_ptr<ProtoProgramCfg> proto_program_cfg,
                        BuildFromCfgProtoPath(GetTestInputPath(
@@ -1672,6 +1902,47 @@ TEST(CodeLayoutTest, FindOptimalMultiFunctionLayoutInterFunction) {
                         CfgScoreIsNear(9.91176, 0, kEpsilon), 2))));
 }
 
+TEST(CodeLayoutTest,
+     FindOptimalMultiFunctionLayoutInterFunctionWithCommunities) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ProtoProgramCfg> proto_program_cfg,
+                       BuildFromCfgProtoPath(
+                           GetTestInputPath("_main/propeller/testdata/"
+                                            "simple_multi_function.protobuf")));
+
+  PropellerCodeLayoutParameters params;
+  params.set_call_chain_clustering(true);
+  params.set_inter_function_reordering(true);
+  // All CFGs fit into a single community, which must give the same layout as
+  // laying out the whole section together.
+  params.set_inter_function_community_max_nodes(1000);
+  SectionLayoutInfo layout_info =
+      CodeLayout(params, proto_program_cfg->program_cfg().GetCfgs())
+          .GenerateLayout();
+
+  EXPECT_THAT(
+      layout_info.layouts_by_function_index,
+      UnorderedElementsAre(
+          Pair(0, FunctionLayoutInfoIs(
+                      ElementsAre(
+                          BbChainIs(1, ElementsAre(BbBundleIs(ElementsAre(
+                                           BbIdIs(0), BbIdIs(2), BbIdIs(1)))))),
+                      CfgScoreIsNear(98.82353, 0, kEpsilon),
+                      CfgScoreIsNear(819.88281, 0, kEpsilon), 1)),
+          Pair(1, FunctionLayoutInfoIs(
+                      ElementsAre(
+                          BbChainIs(0, ElementsAre(BbBundleIs(ElementsAre(
+                                           BbIdIs(0), BbIdIs(1), BbIdIs(3))))),
+                          BbChainIs(3, ElementsAre(BbBundleIs(ElementsAre(
+                                           BbIdIs(2), BbIdIs(4)))))),
+                      CfgScoreIsNear(199.62353, 99.55882, kEpsilon),
+                      CfgScoreIsNear(2020.00000, 99.12109, kEpsilon), 0)),
+          Pair(100, FunctionLayoutInfoIs(
+                        ElementsAre(BbChainIs(2, ElementsAre(BbBundleIs(
+                                                     ElementsAre(BbIdIs(0)))))),
+                        CfgScoreIsNear(9.91176, 0, kEpsilon),
+                        CfgScoreIsNear(9.91176, 0, kEpsilon), 2))));
+}
+
 TEST(CodeLayoutTest, PlacesBlocksBeforeEntryInInterFunctionOrdering) {
   std::unique_ptr<ProgramCfg> program_cfg = BuildFromCfgArg(
       {.cfg_args = {{".foo_section",
@@ -2158,5 +2429,225 @@ TEST(CodeLayoutTest, PrioritizesFallthroughWithAlwaysFallthroughBonus) {
                    _, _, _))));
   }
 }
+
+// Returns the sorted ids of the blocks laid out for every function in
+// `layout_info`.
+absl::btree_map<int, std::vector<int>> GetSortedBbIdsByFunctionIndex(
+    const SectionLayoutInfo& layout_info) {
+  absl::btree_map<int, std::vector<int>> bb_ids_by_function_index;
+  for (const auto& [function_index, func_layout_info] :
+       layout_info.layouts_by_function_index) {
+    std::vector<int>& bb_ids = bb_ids_by_function_index[function_index];
+    for (const FunctionLayoutInfo::BbChain& bb_chain :
+         func_layout_info.bb_chains) {
+      for (const FullIntraCfgId& bb_id : bb_chain.GetAllBbs())
+        bb_ids.push_back(bb_id.bb_id);
+    }
+    absl::c_sort(bb_ids);
+  }
+  return bb_ids_by_function_index;
+}
+
+// Expects every function in `layout_info` to be laid out as a single chain
+// starting with its entry block, as the coalesced chains of intra-function
+// layout are.
+void ExpectCoalescedLayouts(const SectionLayoutInfo& layout_info) {
+  for (const auto& [function_index, func_layout_info] :
+       layout_info.layouts_by_function_index) {
+    ASSERT_THAT(func_layout_info.bb_chains, SizeIs(1))
+        << "function index: " << function_index;
+    EXPECT_EQ(func_layout_info.bb_chains.front().GetFirstBb().bb_id, 0)
+        << "function index: " << function_index;
+  }
+}
+
+TEST(CodeLayoutTest, BuildsValidLayoutWithExpiredDeadline) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ProtoProgramCfg> proto_program_cfg,
+                       BuildFromCfgProtoPath(
+                           GetTestInputPath("_main/propeller/testdata/"
+                                            "simple_multi_function.protobuf")));
+
+  PropellerCodeLayoutParameters params;
+  params.set_call_chain_clustering(true);
+  CodeLayout unbudgeted_code_layout(params,
+                                    proto_program_cfg->program_cfg().GetCfgs());
+  const SectionLayoutInfo unbudgeted_layout_info =
+      unbudgeted_code_layout.GenerateLayout();
+  EXPECT_EQ(unbudgeted_code_layout.stats().n_chain_builds_over_budget, 0);
+  EXPECT_EQ(unbudgeted_code_layout.stats().n_cluster_builds_over_budget, 0);
+
+  // With an expired deadline, no chains or clusters are merged, but the
+  // chains of every function are still coalesced with the entry block first.
+  CodeLayout code_layout(params, proto_program_cfg->program_cfg().GetCfgs(),
+                         /*initial_chains=*/{},
+                         /*deadline=*/absl::InfinitePast());
+  const SectionLayoutInfo layout_info = code_layout.GenerateLayout();
+  EXPECT_EQ(code_layout.stats().n_chain_builds_over_budget,
+            code_layout.stats().n_hot_functions);
+  EXPECT_EQ(code_layout.stats().n_cluster_builds_over_budget, 1);
+  ExpectCoalescedLayouts(layout_info);
+  EXPECT_EQ(GetSortedBbIdsByFunctionIndex(layout_info),
+            GetSortedBbIdsByFunctionIndex(unbudgeted_layout_info));
+}
+
+// Returns the ids of blocks 0 to `num_nodes - 1`.
+std::vector<int> GetBbIdRange(int num_nodes) {
+  std::vector<int> bb_ids(num_nodes);
+  for (int i = 0; i < num_nodes; ++i) bb_ids[i] = i;
+  return bb_ids;
+}
+
+TEST(CodeLayoutTest, StopsChainBuildAtFunctionLayoutTimeBudget) {
+  constexpr int kNumNodes = 10;
+  std::unique_ptr<ProgramCfg> program_cfg = BuildCfgWithManyBundles(kNumNodes);
+
+  // Without a function budget, a start time in the past does not stop the
+  // chain build.
+  PropellerCodeLayoutParameters params;
+  PropellerStats::CodeLayoutStats unbudgeted_stats;
+  std::vector<std::unique_ptr<NodeChain>> unbudgeted_chains =
+      CreateNodeChainBuilderForCfgs(*program_cfg, /*function_indices=*/{0},
+                                    params, unbudgeted_stats)
+          .BuildChains(/*start_time=*/absl::InfinitePast());
+  EXPECT_EQ(unbudgeted_stats.n_chain_builds_over_budget, 0);
+  EXPECT_THAT(unbudgeted_chains, SizeIs(1));
+
+  // The function budget is exhausted as soon as the chain build starts, so no
+  // chains are merged, but the chains of the single function are coalesced.
+  params.set_function_layout_time_budget_ms(1);
+  PropellerStats::CodeLayoutStats stats;
+  std::vector<std::unique_ptr<NodeChain>> chains =
+      CreateNodeChainBuilderForCfgs(*program_cfg, /*function_indices=*/{0},
+                                    params, stats)
+          .BuildChains(/*start_time=*/absl::InfinitePast());
+  EXPECT_EQ(stats.n_chain_builds_over_budget, 1);
+  ASSERT_THAT(chains, SizeIs(1));
+  EXPECT_EQ(chains.front()->GetFirstNode()->inter_cfg_id(),
+            (InterCfgId{0, {0, 0}}));
+}
+
+TEST(CodeLayoutTest, StopsLayoutAtLayoutTimeBudget) {
+  constexpr int kNumNodes = 10;
+  std::unique_ptr<ProgramCfg> program_cfg = BuildCfgWithManyBundles(kNumNodes);
+
+  PropellerCodeLayoutParameters params;
+  params.set_layout_time_budget_ms(1);
+  PropellerStats::CodeLayoutStats stats;
+  absl::btree_map<llvm::StringRef, SectionLayoutInfo> layout_by_section =
+      GenerateLayoutBySection(*program_cfg, params, stats,
+                              /*reused_layouts=*/{},
+                              /*start_time=*/absl::InfinitePast());
+  EXPECT_EQ(stats.n_chain_builds_over_budget, 1);
+  // The budget is exhausted when clustering starts, but the single chain has
+  // no predecessor cluster to merge with, so clustering does not stop early.
+  EXPECT_EQ(stats.n_cluster_builds_over_budget, 0);
+  ASSERT_THAT(layout_by_section, ElementsAre(Key(".text")));
+  ExpectCoalescedLayouts(layout_by_section.begin()->second);
+  EXPECT_THAT(GetSortedBbIdsByFunctionIndex(layout_by_section.begin()->second),
+              ElementsAre(Pair(0, GetBbIdRange(kNumNodes))));
+}
+
+TEST(CodeLayoutTest, IgnoresCallsAcrossCommunities) {
+  // Each function has 2 blocks and communities have at most 4 blocks, so the
+  // heavy calls put foo and bar in one community and baz and qux in another.
+  // The lighter call from bar to baz crosses the two communities.
+  std::unique_ptr<ProgramCfg> program_cfg = BuildFromCfgArg(
+      {.cfg_args = {{".text",
+                     0,
+                     "foo",
+                     {{0x1000, 0, 0x10}, {0x1010, 1, 0x10}},
+                     {{0, 1, 100, CFGEdgeKind::kBranchOrFallthough}}},
+                    {".text",
+                     1,
+                     "bar",
+                     {{0x2000, 0, 0x10}, {0x2010, 1, 0x10}},
+                     {{0, 1, 100, CFGEdgeKind::kBranchOrFallthough}}},
+                    {".text",
+                     2,
+                     "baz",
+                     {{0x3000, 0, 0x10}, {0x3010, 1, 0x10}},
+                     {{0, 1, 100, CFGEdgeKind::kBranchOrFallthough}}},
+                    {".text",
+                     3,
+                     "qux",
+                     {{0x4000, 0, 0x10}, {0x4010, 1, 0x10}},
+                     {{0, 1, 100, CFGEdgeKind::kBranchOrFallthough}}}},
+       .inter_edge_args = {{0, 1, 1, 0, 100, CFGEdgeKind::kCall},
+                           {2, 1, 3, 0, 100, CFGEdgeKind::kCall},
+                           {1, 1, 2, 0, 50, CFGEdgeKind::kCall}}});
+
+  PropellerCodeLayoutParameters params;
+  params.set_call_chain_clustering(true);
+  params.set_inter_function_reordering(true);
+  params.set_inter_function_community_max_nodes(4);
+  SectionLayoutInfo layout_info =
+      CodeLayout(params, program_cfg->GetCfgs()).GenerateLayout();
+  EXPECT_THAT(GetSortedBbIdsByFunctionIndex(layout_info),
+              ElementsAre(Pair(0, ElementsAre(0, 1)),
+                          Pair(1, ElementsAre(0, 1)),
+                          Pair(2, ElementsAre(0, 1)),
+                          Pair(3, ElementsAre(0, 1))));
+}
+
+TEST(CodeLayoutTest, IgnoresNonCallEdgesAcrossCommunities) {
+  // Same as above, except that bar reaches the middle of baz through a
+  // non-call edge, which crosses the two communities.
+  std::unique_ptr<ProgramCfg> program_cfg = BuildFromCfgArg(
+      {.cfg_args = {{".text",
+                     0,
+                     "foo",
+                     {{0x1000, 0, 0x10}, {0x1010, 1, 0x10}},
+                     {{0, 1, 100, CFGEdgeKind::kBranchOrFallthough}}},
+                    {".text",
+                     1,
+                     "bar",
+                     {{0x2000, 0, 0x10}, {0x2010, 1, 0x10}},
+                     {{0, 1, 100, CFGEdgeKind::kBranchOrFallthough}}},
+                    {".text",
+                     2,
+                     "baz",
+                     {{0x3000, 0, 0x10}, {0x3010, 1, 0x10}},
+                     {{0, 1, 100, CFGEdgeKind::kBranchOrFallthough}}},
+                    {".text",
+                     3,
+                     "qux",
+                     {{0x4000, 0, 0x10}, {0x4010, 1, 0x10}},
+                     {{0, 1, 100, CFGEdgeKind::kBranchOrFallthough}}}},
+       .inter_edge_args = {
+           {0, 1, 1, 0, 100, CFGEdgeKind::kCall},
+           {2, 1, 3, 0, 100, CFGEdgeKind::kCall},
+           {1, 1, 2, 1, 50, CFGEdgeKind::kBranchOrFallthough}}});
+
+  PropellerCodeLayoutParameters params;
+  params.set_call_chain_clustering(true);
+  params.set_inter_function_reordering(true);
+  params.set_inter_function_community_max_nodes(4);
+  SectionLayoutInfo layout_info =
+      CodeLayout(params, program_cfg->GetCfgs()).GenerateLayout();
+  EXPECT_THAT(GetSortedBbIdsByFunctionIndex(layout_info),
+              ElementsAre(Pair(0, ElementsAre(0, 1)),
+                          Pair(1, ElementsAre(0, 1)),
+                          Pair(2, ElementsAre(0, 1)),
+                          Pair(3, ElementsAre(0, 1))));
+}
+
+TEST(CodeLayoutTest, SkipsHotPagePackingWithZeroPageSize) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ProtoProgramCfg> proto_program_cfg,
+                       BuildFromCfgProtoPath(
+                           GetTestInputPath("_main/propeller/testdata/"
+                                            "simple_multi_function.protobuf")));
+
+  PropellerCodeLayoutParameters params;
+  params.set_pack_hot_pages(true);
+  params.set_hot_page_size(0);
+  CodeLayout code_layout(params, proto_program_cfg->program_cfg().GetCfgs());
+  const SectionLayoutInfo layout_info = code_layout.GenerateLayout();
+  EXPECT_EQ(code_layout.stats().n_hot_pages_before_packing, 0);
+  EXPECT_EQ(code_layout.stats().n_hot_pages_after_packing, 0);
+  ExpectCoalescedLayouts(layout_info);
+  EXPECT_THAT(layout_info.layouts_by_function_index,
+              ElementsAre(Key(0), Key(1), Key(100)));
+}
+
 }  // namespace
 }  // namespace propeller
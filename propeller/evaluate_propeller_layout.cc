@@ -0,0 +1,184 @@
+// Copyright 2026 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A standalone tool to evaluate the Propeller code layout of a binary offline.
+// It computes the layout from the binary and input perf LBR profiles (as
+// `generate_propeller_profiles` does), then replays the LBR paths of the same
+// profiles under the original and the new layout through simulated L1i and L2
+// caches and iTLB, and prints the estimated misses under both layouts.
+//
+// Usage:
+// ```
+//   ./evaluate_propeller_layout \
+//     --binary=sample.bin \
+//     --profile=sample.perfdata \
+//     [--propeller_options='code_layout_params { ... }']
+// ```
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/btree_map.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/functional/bind_front.h"
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "llvm/ADT/StringRef.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/binary_content.h"
+#include "propeller/code_layout.h"
+#include "propeller/file_perf_data_provider.h"
+#include "propeller/layout_simulator.h"
+#include "propeller/perf_data_path_reader.h"
+#include "propeller/perf_data_provider.h"
+#include "propeller/perfdata_reader.h"
+#include "propeller/profile.h"
+#include "propeller/profile_computer.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/propeller_statistics.h"
+#include "propeller/resolve_mmap_name.h"
+#include "propeller/status_macros.h"
+#include "propeller/text_proto_flag.h"
+
+ABSL_FLAG(std::string, binary, "", "Path to the binary.");
+ABSL_FLAG(std::vector<std::string>, profile, {},
+          "Comma-separated file paths of the input perf LBR profiles.");
+ABSL_FLAG(propeller::TextProtoFlag<propeller::PropellerOptions>,
+          propeller_options, {},
+          "Override for propeller options, e.g. the code layout parameters to "
+          "evaluate.");
+ABSL_FLAG(int64_t, l1i_cache_size, 32 * 1024, "L1i cache size in bytes.");
+ABSL_FLAG(int64_t, l1i_cache_line_size, 64, "L1i cache line size in bytes.");
+ABSL_FLAG(int, l1i_cache_associativity, 8, "L1i cache associativity.");
+ABSL_FLAG(int64_t, l2_cache_size, 1024 * 1024, "L2 cache size in bytes.");
+ABSL_FLAG(int64_t, l2_cache_line_size, 64, "L2 cache line size in bytes.");
+ABSL_FLAG(int, l2_cache_associativity, 16, "L2 cache associativity.");
+ABSL_FLAG(int64_t, itlb_entries, 64, "Number of iTLB entries.");
+ABSL_FLAG(int64_t, itlb_page_size, 4096, "Page size in bytes for the iTLB.");
+ABSL_FLAG(int, itlb_associativity, 8, "iTLB associativity.");
+
+namespace {
+using ::propeller::BinaryAddressMapper;
+using ::propeller::BinaryContent;
+using ::propeller::GenericFilePerfDataProvider;
+using ::propeller::LayoutSimulationParameters;
+using ::propeller::LayoutSimulator;
+using ::propeller::PerfDataPathReader;
+using ::propeller::PerfDataProvider;
+using ::propeller::PerfDataReader;
+using ::propeller::PropellerOptions;
+using ::propeller::PropellerProfile;
+using ::propeller::PropellerProfileComputer;
+using ::propeller::PropellerStats;
+using ::propeller::SectionLayoutInfo;
+
+LayoutSimulationParameters GetLayoutSimulationParameters() {
+  return {.l1i_cache = {.size = absl::GetFlag(FLAGS_l1i_cache_size),
+                        .line_size = absl::GetFlag(FLAGS_l1i_cache_line_size),
+                        .associativity =
+                            absl::GetFlag(FLAGS_l1i_cache_associativity)},
+          .l2_cache = {.size = absl::GetFlag(FLAGS_l2_cache_size),
+                       .line_size = absl::GetFlag(FLAGS_l2_cache_line_size),
+                       .associativity =
+                           absl::GetFlag(FLAGS_l2_cache_associativity)},
+          .itlb = {.size = absl::GetFlag(FLAGS_itlb_entries) *
+                           absl::GetFlag(FLAGS_itlb_page_size),
+                   .line_size = absl::GetFlag(FLAGS_itlb_page_size),
+                   .associativity = absl::GetFlag(FLAGS_itlb_associativity)}};
+}
+
+absl::Status EvaluateLayout(const PropellerOptions& options) {
+  // Cloning changes the CFGs which the layout is computed on, while the LBR
+  // paths are replayed on the original binary.
+  if (options.path_profile_options().enable_cloning()) {
+    return absl::InvalidArgumentError(
+        "evaluating layouts with cloning is not supported");
+  }
+  ASSIGN_OR_RETURN(std::unique_ptr<BinaryContent> binary_content,
+                   propeller::GetBinaryContent(options.binary_name()));
+  // The address mapper used for replaying the paths is built separately, since
+  // `ComputeProfile` consumes the profile computer.
+  PropellerStats binary_address_mapper_stats;
+  ASSIGN_OR_RETURN(std::unique_ptr<BinaryAddressMapper> binary_address_mapper,
+                   propeller::BuildBinaryAddressMapper(
+                       options, *binary_content, binary_address_mapper_stats));
+  ASSIGN_OR_RETURN(
+      std::unique_ptr<PropellerProfileComputer> profile_computer,
+      PropellerProfileComputer::Create(options, binary_content.get()));
+  ASSIGN_OR_RETURN(PropellerProfile profile,
+                   std::move(*profile_computer).ComputeProfile());
+  LOG(INFO) << profile.stats.code_layout_stats.DebugString();
+
+  absl::btree_map<llvm::StringRef, SectionLayoutInfo>
+      layout_info_by_section_name;
+  for (const auto& [section_name, section_profile_info] :
+       profile.profile_infos_by_section_name) {
+    for (const auto& [function_index, profile_info] :
+         section_profile_info.profile_infos_by_function_index) {
+      layout_info_by_section_name[section_name]
+          .layouts_by_function_index[function_index] = profile_info.layout_info;
+    }
+  }
+  LayoutSimulator simulator(profile.program_cfg.get(),
+                            layout_info_by_section_name,
+                            GetLayoutSimulationParameters());
+
+  std::vector<std::string> profile_names;
+  for (const auto& input_profile : options.input_profiles())
+    profile_names.push_back(input_profile.name());
+  GenericFilePerfDataProvider perf_data_provider(std::move(profile_names));
+  while (true) {
+    ASSIGN_OR_RETURN(std::optional<PerfDataProvider::BufferHandle> perf_data,
+                     perf_data_provider.GetNext());
+    if (!perf_data.has_value()) break;
+    ASSIGN_OR_RETURN(PerfDataReader perf_data_reader,
+                     propeller::BuildPerfDataReader(
+                         *std::move(perf_data), binary_content.get(),
+                         propeller::ResolveMmapName(options)));
+    PerfDataPathReader(&perf_data_reader, binary_address_mapper.get())
+        .ReadPathsAndApplyCallBack(
+            absl::bind_front(&LayoutSimulator::SimulatePaths, &simulator));
+  }
+
+  std::cout << "Original layout: "
+            << simulator.original_layout_stats().DebugString() << "\n"
+            << "Optimized layout: "
+            << simulator.optimized_layout_stats().DebugString() << "\n";
+  return absl::OkStatus();
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  PropellerOptions options = absl::GetFlag(FLAGS_propeller_options).message;
+  options.set_binary_name(absl::GetFlag(FLAGS_binary));
+  for (const std::string& profile : absl::GetFlag(FLAGS_profile)) {
+    propeller::InputProfile* input_profile = options.add_input_profiles();
+    input_profile->set_name(profile);
+    input_profile->set_type(propeller::ProfileType::PERF_LBR);
+  }
+
+  QCHECK_OK(EvaluateLayout(options));
+}
@@ -0,0 +1,353 @@
+// Copyright 2026 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/incremental_layout.h"
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "propeller/cfg.h"
+#include "propeller/cfg_edge.h"
+#include "propeller/cfg_id.h"
+#include "propeller/cfg_node.h"
+#include "propeller/function_layout_info.h"
+#include "propeller/program_cfg.h"
+#include "propeller/status_macros.h"
+
+namespace propeller {
+
+namespace {
+// Parses the profile bb id in `token` and returns the bb id, or
+// `std::nullopt` if it refers to a cloned block ("<bb_id>.<clone_number>").
+absl::StatusOr<std::optional<int>> ParseProfileBbId(absl::string_view token) {
+  if (absl::StrContains(token, '.')) return std::nullopt;
+  int bb_id;
+  if (!absl::SimpleAtoi(token, &bb_id)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid basic block id: \"", token, "\""));
+  }
+  return bb_id;
+}
+
+// Splits `token` of the form "<bb_id>:<value>" and returns its parts.
+absl::StatusOr<std::pair<absl::string_view, absl::string_view>> SplitBbEntry(
+    absl::string_view token) {
+  std::vector<absl::string_view> parts = absl::StrSplit(token, ':');
+  if (parts.size() != 2) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Expected \"<bb_id>:<value>\", but got \"", token, "\""));
+  }
+  return std::make_pair(parts[0], parts[1]);
+}
+
+// Parses the clusters of a "c" line into `function_profile`.
+absl::Status ParseClusterLine(absl::string_view line,
+                              PreviousFunctionProfile& function_profile) {
+  std::vector<int> cluster;
+  for (absl::string_view token : absl::StrSplit(line, ' ', absl::SkipEmpty())) {
+    ASSIGN_OR_RETURN(std::optional<int> bb_id, ParseProfileBbId(token));
+    if (!bb_id.has_value()) {
+      function_profile.has_clones = true;
+      return absl::OkStatus();
+    }
+    cluster.push_back(*bb_id);
+  }
+  function_profile.clusters.push_back(std::move(cluster));
+  return absl::OkStatus();
+}
+
+// Parses the edge profile of a "g" line into `function_profile`. Every token
+// is of the form "<bb>:<bb_freq>,<succ_bb_1>:<edge_freq_1>,...".
+absl::Status ParseCfgProfileLine(absl::string_view line,
+                                 PreviousFunctionProfile& function_profile) {
+  for (absl::string_view token : absl::StrSplit(line, ' ', absl::SkipEmpty())) {
+    std::vector<absl::string_view> entries = absl::StrSplit(token, ',');
+    std::optional<int> src_bb_id;
+    for (int i = 0; i != entries.size(); ++i) {
+      ASSIGN_OR_RETURN(auto bb_entry, SplitBbEntry(entries[i]));
+      ASSIGN_OR_RETURN(std::optional<int> bb_id,
+                       ParseProfileBbId(bb_entry.first));
+      int64_t frequency;
+      if (!absl::SimpleAtoi(bb_entry.second, &frequency)) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Invalid frequency: \"", entries[i], "\""));
+      }
+      if (!bb_id.has_value()) {
+        function_profile.has_clones = true;
+        return absl::OkStatus();
+      }
+      if (i == 0) {
+        src_bb_id = bb_id;
+        function_profile.node_frequencies[*bb_id] = frequency;
+      } else {
+        function_profile.edge_weights[{*src_bb_id, *bb_id}] += frequency;
+      }
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Parses the basic block hashes of an "h" line into `function_profile`.
+absl::Status ParseBbHashLine(absl::string_view line,
+                             PreviousFunctionProfile& function_profile) {
+  for (absl::string_view token : absl::StrSplit(line, ' ', absl::SkipEmpty())) {
+    ASSIGN_OR_RETURN(auto bb_entry, SplitBbEntry(token));
+    ASSIGN_OR_RETURN(std::optional<int> bb_id,
+                     ParseProfileBbId(bb_entry.first));
+    uint64_t hash;
+    if (!absl::SimpleHexAtoi(bb_entry.second, &hash)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid basic block hash: \"", token, "\""));
+    }
+    if (!bb_id.has_value()) {
+      function_profile.has_clones = true;
+      return absl::OkStatus();
+    }
+    function_profile.bb_hashes[*bb_id] = hash;
+  }
+  return absl::OkStatus();
+}
+
+// Returns the branch and fallthrough edge weights of `cfg` keyed by the bb ids
+// of their source and sink, as written in the "g" lines of the cluster
+// profile.
+absl::flat_hash_map<std::pair<int, int>, int64_t> GetEdgeWeights(
+    const ControlFlowGraph& cfg) {
+  absl::flat_hash_map<std::pair<int, int>, int64_t> edge_weights;
+  cfg.ForEachNodeRef([&](const CFGNode& node) {
+    node.ForEachOutEdgeInOrder([&](const CFGEdge& edge) {
+      if (!edge.IsBranchOrFallthrough()) return;
+      edge_weights[{node.bb_id(), edge.sink()->bb_id()}] += edge.weight();
+    });
+  });
+  return edge_weights;
+}
+
+// Returns the previous layout of `cfg` if it can be reused. See
+// `GetReusableLayouts`.
+std::optional<std::vector<FunctionLayoutInfo::BbChain>> GetReusableLayout(
+    const ControlFlowGraph& cfg,
+    const PreviousFunctionProfile& previous_profile, double max_edge_distance,
+    bool inter_function_reordering) {
+  if (previous_profile.has_clones || previous_profile.clusters.empty() ||
+      !cfg.clone_paths().empty() || !cfg.is_hot()) {
+    return std::nullopt;
+  }
+  // The function must have the same basic blocks as before.
+  if (previous_profile.node_frequencies.size() != cfg.nodes().size())
+    return std::nullopt;
+  absl::flat_hash_map<int, const CFGNode*> node_by_bb_id;
+  for (const auto& node : cfg.nodes()) {
+    if (!previous_profile.node_frequencies.contains(node->bb_id()))
+      return std::nullopt;
+    if (!previous_profile.bb_hashes.empty()) {
+      auto it = previous_profile.bb_hashes.find(node->bb_id());
+      if (it == previous_profile.bb_hashes.end() || it->second != node->hash())
+        return std::nullopt;
+    }
+    node_by_bb_id.emplace(node->bb_id(), node.get());
+  }
+  if (GetEdgeDistance(cfg, previous_profile) > max_edge_distance)
+    return std::nullopt;
+
+  std::vector<FunctionLayoutInfo::BbChain> chains;
+  absl::flat_hash_set<int> laid_out_bb_ids;
+  for (const std::vector<int>& cluster : previous_profile.clusters) {
+    if (cluster.empty()) continue;
+    FunctionLayoutInfo::BbChain& chain = chains.emplace_back(chains.size());
+    FunctionLayoutInfo::BbBundle& bundle = chain.bb_bundles.emplace_back();
+    for (int i = 0; i != cluster.size(); ++i) {
+      auto it = node_by_bb_id.find(cluster[i]);
+      if (it == node_by_bb_id.end()) return std::nullopt;
+      if (!laid_out_bb_ids.insert(cluster[i]).second) return std::nullopt;
+      // The entry block must start its chain.
+      if (i != 0 && it->second->is_entry()) return std::nullopt;
+      bundle.full_bb_ids.push_back(it->second->full_intra_cfg_id());
+    }
+  }
+  if (!laid_out_bb_ids.contains(cfg.GetEntryNode()->bb_id()))
+    return std::nullopt;
+  // Without inter-function reordering, every function is laid out as a single
+  // chain starting with its entry block.
+  if (!inter_function_reordering &&
+      (chains.size() != 1 ||
+       chains.front().GetFirstBb().bb_id != cfg.GetEntryNode()->bb_id())) {
+    return std::nullopt;
+  }
+  // Every hot block must be laid out, since the chains of the other functions
+  // are clustered along the edges of the hot blocks.
+  for (const auto& node : cfg.nodes()) {
+    if (node->CalculateFrequency() != 0 &&
+        !laid_out_bb_ids.contains(node->bb_id())) {
+      return std::nullopt;
+    }
+  }
+  return chains;
+}
+}  // namespace
+
+absl::StatusOr<PreviousClusterProfile> ParsePreviousClusterProfile(
+    absl::string_view cluster_profile) {
+  PreviousClusterProfile previous_profile;
+  absl::flat_hash_set<std::pair<std::string, std::string>> duplicate_keys;
+  std::string module_name;
+  PreviousFunctionProfile* function_profile = nullptr;
+  int line_number = 0;
+  for (absl::string_view line : absl::StrSplit(cluster_profile, '\n')) {
+    ++line_number;
+    line = absl::StripAsciiWhitespace(line);
+    // Skip comments, empty lines, and the version specifier.
+    if (line.empty() || line[0] == '#' || line == "v1") continue;
+    // Every line starts with a single-character specifier. The module and
+    // function names are separated from it by a space, but the clusters and
+    // clone paths follow it directly (e.g. "c0 2 1").
+    const char specifier = line[0];
+    const absl::string_view contents = line.substr(1);
+    if (specifier == 'm') {
+      module_name = std::string(absl::StripLeadingAsciiWhitespace(contents));
+      continue;
+    }
+    if (specifier == 'f') {
+      // The primary name is the first of the function's alias names.
+      std::vector<absl::string_view> names =
+          absl::StrSplit(contents, ' ', absl::SkipEmpty());
+      if (names.empty()) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Invalid line ", line_number,
+                         " in cluster profile: \"", line, "\""));
+      }
+      std::pair<std::string, std::string> key(std::move(module_name),
+                                              std::string(names.front()));
+      module_name.clear();
+      auto [it, inserted] = previous_profile.try_emplace(key);
+      if (!inserted) duplicate_keys.insert(key);
+      it->second = {};
+      function_profile = &it->second;
+      continue;
+    }
+    // Prefetch hints and targets do not affect the layout.
+    if (specifier == 'i' || specifier == 't') continue;
+    if (specifier != 'c' && specifier != 'g' && specifier != 'h' &&
+        specifier != 'p') {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Invalid line ", line_number, " in cluster profile: \"", line, "\""));
+    }
+    if (function_profile == nullptr) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Line ", line_number,
+                       " in cluster profile precedes any function: \"", line,
+                       "\""));
+    }
+    absl::Status status = absl::OkStatus();
+    switch (specifier) {
+      case 'c':
+        status = ParseClusterLine(contents, *function_profile);
+        break;
+      case 'g':
+        status = ParseCfgProfileLine(contents, *function_profile);
+        break;
+      case 'h':
+        status = ParseBbHashLine(contents, *function_profile);
+        break;
+      case 'p':
+        function_profile->has_clones = true;
+        break;
+    }
+    if (!status.ok()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid line ", line_number,
+                       " in cluster profile: ", status.message()));
+    }
+  }
+  for (const auto& key : duplicate_keys) previous_profile.erase(key);
+  return previous_profile;
+}
+
+absl::StatusOr<PreviousClusterProfile> ReadPreviousClusterProfile(
+    absl::string_view cluster_profile_path) {
+  std::ifstream infile((std::string(cluster_profile_path)));
+  if (!infile.is_open()) {
+    return absl::NotFoundError(
+        absl::StrCat("Could not open file: ", cluster_profile_path));
+  }
+  std::stringstream contents;
+  contents << infile.rdbuf();
+  return ParsePreviousClusterProfile(contents.str());
+}
+
+double GetEdgeDistance(const ControlFlowGraph& cfg,
+                       const PreviousFunctionProfile& previous_profile) {
+  const absl::flat_hash_map<std::pair<int, int>, int64_t> edge_weights =
+      GetEdgeWeights(cfg);
+  int64_t total_weight = 0;
+  for (const auto& [unused, weight] : edge_weights) total_weight += weight;
+  int64_t previous_total_weight = 0;
+  for (const auto& [unused, weight] : previous_profile.edge_weights)
+    previous_total_weight += weight;
+  if (total_weight == 0 || previous_total_weight == 0)
+    return total_weight == previous_total_weight ? 0 : 1;
+
+  double distance = 0;
+  for (const auto& [edge, weight] : edge_weights) {
+    auto it = previous_profile.edge_weights.find(edge);
+    const int64_t previous_weight =
+        it == previous_profile.edge_weights.end() ? 0 : it->second;
+    distance += std::abs(static_cast<double>(weight) / total_weight -
+                         static_cast<double>(previous_weight) /
+                             previous_total_weight);
+  }
+  for (const auto& [edge, previous_weight] : previous_profile.edge_weights) {
+    if (edge_weights.contains(edge)) continue;
+    distance += static_cast<double>(previous_weight) / previous_total_weight;
+  }
+  return distance / 2;
+}
+
+absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>
+GetReusableLayouts(const ProgramCfg& program_cfg,
+                   const PreviousClusterProfile& previous_profile,
+                   double max_edge_distance, bool inter_function_reordering) {
+  absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>
+      reusable_layouts;
+  for (const ControlFlowGraph* cfg : program_cfg.GetCfgs()) {
+    auto it = previous_profile.find(
+        std::make_pair(cfg->module_name().value_or("").str(),
+                       cfg->GetPrimaryName().str()));
+    if (it == previous_profile.end()) continue;
+    std::optional<std::vector<FunctionLayoutInfo::BbChain>> layout =
+        GetReusableLayout(*cfg, it->second, max_edge_distance,
+                          inter_function_reordering);
+    if (layout.has_value())
+      reusable_layouts.emplace(cfg->function_index(), *std::move(layout));
+  }
+  return reusable_layouts;
+}
+
+}  // namespace propeller
@@ -0,0 +1,89 @@
+// Copyright 2026 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROPELLER_INCREMENTAL_LAYOUT_H_
+#define PROPELLER_INCREMENTAL_LAYOUT_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "propeller/cfg.h"
+#include "propeller/function_layout_info.h"
+#include "propeller/program_cfg.h"
+
+namespace propeller {
+
+// The layout and the edge profile of a function, as written in a `VERSION_1`
+// cluster profile by a previous run.
+struct PreviousFunctionProfile {
+  // The basic block ids of every cluster ("c" line), in order.
+  std::vector<std::vector<int>> clusters;
+  // The frequency of every basic block ("g" line), keyed by bb id.
+  absl::flat_hash_map<int, int64_t> node_frequencies;
+  // The weight of every branch or fallthrough edge ("g" line), keyed by the bb
+  // ids of its source and sink.
+  absl::flat_hash_map<std::pair<int, int>, int64_t> edge_weights;
+  // The hash of every basic block ("h" line), keyed by bb id. Empty if the
+  // profile was written without `write_bb_hash`.
+  absl::flat_hash_map<int, uint64_t> bb_hashes;
+  // Whether the function had cloning paths or cloned blocks. The layouts of
+  // such functions are never reused.
+  bool has_clones = false;
+};
+
+// Previous function profiles keyed by module name (empty if not written) and
+// primary function name. Functions which appear more than once under the same
+// key are dropped.
+using PreviousClusterProfile =
+    absl::flat_hash_map<std::pair<std::string, std::string>,
+                        PreviousFunctionProfile>;
+
+// Parses the contents of a `VERSION_1` cluster profile, as written by
+// `PropellerProfileWriter`. Prefetch hints are ignored. Returns an error if a
+// line is malformed.
+absl::StatusOr<PreviousClusterProfile> ParsePreviousClusterProfile(
+    absl::string_view cluster_profile);
+
+// Reads and parses the `VERSION_1` cluster profile at `cluster_profile_path`.
+absl::StatusOr<PreviousClusterProfile> ReadPreviousClusterProfile(
+    absl::string_view cluster_profile_path);
+
+// Returns the distance between the normalized branch and fallthrough edge
+// weights of `cfg` and those of `previous_profile`: half the sum of the
+// absolute differences between the relative weights of every edge. This is 0
+// for identical distributions and 1 for disjoint ones.
+double GetEdgeDistance(const ControlFlowGraph& cfg,
+                       const PreviousFunctionProfile& previous_profile);
+
+// Returns the previous layouts which can be reused verbatim for the hot
+// functions in `program_cfg`, keyed by function index. The layout of a function
+// is reused iff the function has the same basic blocks (and hashes, if
+// available) as in `previous_profile`, neither has clones, the distance
+// between their edge distributions is at most `max_edge_distance`, and the
+// previous layout includes all the currently hot blocks. Without
+// `inter_function_reordering`, the previous layout must also be a single
+// cluster starting with the entry block.
+absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>
+GetReusableLayouts(const ProgramCfg& program_cfg,
+                   const PreviousClusterProfile& previous_profile,
+                   double max_edge_distance, bool inter_function_reordering);
+
+}  // namespace propeller
+
+#endif  // PROPELLER_INCREMENTAL_LAYOUT_H_
@@ -0,0 +1,318 @@
+// Copyright 2026 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/incremental_layout.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/status_matchers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "propeller/cfg_edge_kind.h"
+#include "propeller/cfg_id.h"
+#include "propeller/cfg_testutil.h"
+#include "propeller/code_layout.h"
+#include "propeller/function_layout_info.h"
+#include "propeller/mock_program_cfg_builder.h"
+#include "propeller/program_cfg.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/status_testing_macros.h"
+
+namespace propeller {
+namespace {
+using ::absl_testing::StatusIs;
+using ::testing::Contains;
+using ::testing::DoubleEq;
+using ::testing::ElementsAre;
+using ::testing::Field;
+using ::testing::IsEmpty;
+using ::testing::Key;
+using ::testing::Pair;
+using ::testing::UnorderedElementsAre;
+
+constexpr absl::string_view kPreviousClusterProfile = R"(v1
+#Profiled binary build ID: 1234
+f foo foo_alias
+c0 2 1 3
+i1,0 bar,0,0
+t2,0
+g 0:110,1:100,2:10 1:100,3:100 2:10 3:100
+h 0:a 1:b 2:c 3:d
+m module.o
+f bar
+c0 1
+g 0:10,1:10 1:10 2:0
+f baz
+c0 1
+g 0:10,1:10 1:10
+h 0:a 1:b
+f qux
+p0 1
+c0 1 1.1
+g 0:10,1:10 1:10 1.1:0
+)";
+
+MATCHER_P(BbIdIs, bb_id, "") { return arg.bb_id == bb_id; }
+
+std::string GetTestInputPath(absl::string_view testdata_path) {
+  return absl::StrCat(::testing::SrcDir(), testdata_path);
+}
+
+// Returns a program with the functions of `kPreviousClusterProfile`, where
+// the profile of foo is scaled, the profile of bar changed, and a block of baz
+// has a new hash. The functions are connected by `inter_edge_args`.
+std::unique_ptr<ProgramCfg> BuildProgramCfg(
+    std::vector<InterEdgeArg> inter_edge_args = {}) {
+  return BuildFromCfgArg(
+      {.cfg_args = {
+           {".text",
+            1,
+            "foo",
+            {{0x1000, 0, 0x10, {.CanFallThrough = true}, 0xa},
+             {0x1010, 1, 0x10, {.CanFallThrough = true}, 0xb},
+             {0x1020, 2, 0x10, {.CanFallThrough = true}, 0xc},
+             {0x1030, 3, 0x10, {.CanFallThrough = false}, 0xd}},
+            {{0, 1, 200, CFGEdgeKind::kBranchOrFallthough},
+             {1, 3, 200, CFGEdgeKind::kBranchOrFallthough},
+             {0, 2, 20, CFGEdgeKind::kBranchOrFallthough}}},
+           {".text",
+            2,
+            "bar",
+            {{0x2000, 0, 0x10, {.CanFallThrough = true}},
+             {0x2010, 1, 0x10, {.CanFallThrough = true}},
+             {0x2020, 2, 0x10, {.CanFallThrough = false}}},
+            {{0, 2, 10, CFGEdgeKind::kBranchOrFallthough}}},
+           {".text",
+            3,
+            "baz",
+            {{0x3000, 0, 0x10, {.CanFallThrough = true}, 0xa},
+             {0x3010, 1, 0x10, {.CanFallThrough = false}, 0xe}},
+            {{0, 1, 10, CFGEdgeKind::kBranchOrFallthough}}}},
+       .inter_edge_args = std::move(inter_edge_args)});
+}
+
+TEST(IncrementalLayoutTest, ParsesPreviousClusterProfile) {
+  ASSERT_OK_AND_ASSIGN(PreviousClusterProfile previous_profile,
+                       ParsePreviousClusterProfile(kPreviousClusterProfile));
+  EXPECT_THAT(previous_profile,
+              UnorderedElementsAre(Key(Pair("", "foo")),
+                                   Key(Pair("module.o", "bar")),
+                                   Key(Pair("", "baz")), Key(Pair("", "qux"))));
+  const PreviousFunctionProfile& foo = previous_profile.at({"", "foo"});
+  EXPECT_THAT(foo.clusters, ElementsAre(ElementsAre(0, 2, 1, 3)));
+  EXPECT_THAT(foo.node_frequencies,
+              UnorderedElementsAre(Pair(0, 110), Pair(1, 100), Pair(2, 10),
+                                   Pair(3, 100)));
+  EXPECT_THAT(foo.edge_weights,
+              UnorderedElementsAre(Pair(Pair(0, 1), 100), Pair(Pair(0, 2), 10),
+                                   Pair(Pair(1, 3), 100)));
+  EXPECT_THAT(foo.bb_hashes, UnorderedElementsAre(Pair(0, 0xa), Pair(1, 0xb),
+                                                  Pair(2, 0xc), Pair(3, 0xd)));
+  EXPECT_FALSE(foo.has_clones);
+  EXPECT_THAT(previous_profile.at({"module.o", "bar"}).bb_hashes, IsEmpty());
+  EXPECT_TRUE(previous_profile.at({"", "qux"}).has_clones);
+}
+
+TEST(IncrementalLayoutTest, ReadsClusterProfileWithClonePaths) {
+  ASSERT_OK_AND_ASSIGN(
+      PreviousClusterProfile previous_profile,
+      ReadPreviousClusterProfile(GetTestInputPath(
+          "_main/propeller/testdata/bimodal_sample.cloning_cc_profile.txt")));
+  EXPECT_THAT(previous_profile,
+              UnorderedElementsAre(Key(Pair("", "foo")), Key(Pair("", "bar")),
+                                   Key(Pair("", "compute")),
+                                   Key(Pair("", "main"))));
+  EXPECT_THAT(previous_profile.at({"", "foo"}).clusters,
+              ElementsAre(ElementsAre(0)));
+  EXPECT_FALSE(previous_profile.at({"", "foo"}).has_clones);
+  EXPECT_TRUE(previous_profile.at({"", "compute"}).has_clones);
+  EXPECT_THAT(previous_profile.at({"", "main"}).clusters,
+              ElementsAre(ElementsAre(0, 2)));
+}
+
+TEST(IncrementalLayoutTest, ReadsClusterProfileWithPrefetchHints) {
+  ASSERT_OK_AND_ASSIGN(
+      PreviousClusterProfile previous_profile,
+      ReadPreviousClusterProfile(
+          GetTestInputPath("_main/propeller/testdata/"
+                           "sample_cc_directives.prefetch.golden.txt")));
+  EXPECT_THAT(previous_profile,
+              UnorderedElementsAre(Key(Pair("", "this_is_very_code")),
+                                   Key(Pair("", "compute_flag")),
+                                   Key(Pair("", "sample1_func")),
+                                   Key(Pair("", "main"))));
+  EXPECT_THAT(previous_profile.at({"", "this_is_very_code"}).clusters,
+              IsEmpty());
+  EXPECT_THAT(previous_profile.at({"", "compute_flag"}).clusters,
+              ElementsAre(ElementsAre(0)));
+  EXPECT_THAT(previous_profile.at({"", "main"}).clusters,
+              ElementsAre(ElementsAre(0, 2, 3, 5, 1)));
+}
+
+TEST(IncrementalLayoutTest, RejectsMalformedClusterProfile) {
+  EXPECT_THAT(ParsePreviousClusterProfile("v1\nc0 1\n"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParsePreviousClusterProfile("v1\nf foo\ng 0:x\n"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParsePreviousClusterProfile("v1\nf foo\nx0 1\n"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(IncrementalLayoutTest, ComputesEdgeDistance) {
+  ASSERT_OK_AND_ASSIGN(PreviousClusterProfile previous_profile,
+                       ParsePreviousClusterProfile(kPreviousClusterProfile));
+  std::unique_ptr<ProgramCfg> program_cfg = BuildProgramCfg();
+  // The profile of foo is only scaled.
+  EXPECT_THAT(GetEdgeDistance(*program_cfg->GetCfgByIndex(1),
+                              previous_profile.at({"", "foo"})),
+              DoubleEq(0));
+  // The only edge of bar moved.
+  EXPECT_THAT(GetEdgeDistance(*program_cfg->GetCfgByIndex(2),
+                              previous_profile.at({"module.o", "bar"})),
+              DoubleEq(1));
+}
+
+TEST(IncrementalLayoutTest, ReusesLayoutsOfUnchangedFunctions) {
+  ASSERT_OK_AND_ASSIGN(PreviousClusterProfile previous_profile,
+                       ParsePreviousClusterProfile(kPreviousClusterProfile));
+  std::unique_ptr<ProgramCfg> program_cfg = BuildProgramCfg();
+  // bar is not matched because its module name is unknown in the current
+  // program, and baz is not reused because a block hash changed.
+  auto reusable_layouts =
+      GetReusableLayouts(*program_cfg, previous_profile,
+                         /*max_edge_distance=*/0.05,
+                         /*inter_function_reordering=*/false);
+  ASSERT_THAT(reusable_layouts, UnorderedElementsAre(Key(1)));
+
+  PropellerCodeLayoutParameters params;
+  CodeLayout code_layout(params, program_cfg->GetCfgs(),
+                         /*initial_chains=*/{}, absl::InfiniteFuture(),
+                         std::move(reusable_layouts));
+  SectionLayoutInfo layout_info = code_layout.GenerateLayout();
+  // The layout of foo is reused verbatim, even though it is not the one which
+  // would be computed from the current profile.
+  ASSERT_TRUE(layout_info.layouts_by_function_index.contains(1));
+  ASSERT_THAT(layout_info.layouts_by_function_index.at(1).bb_chains,
+              ElementsAre(Field(&FunctionLayoutInfo::BbChain::bb_bundles,
+                                ElementsAre(Field(
+                                    &FunctionLayoutInfo::BbBundle::full_bb_ids,
+                                    ElementsAre(BbIdIs(0), BbIdIs(2),
+                                                BbIdIs(1), BbIdIs(3)))))));
+  EXPECT_EQ(code_layout.stats().n_hot_functions, 3);
+  EXPECT_EQ(code_layout.stats().n_reused_function_layouts, 1);
+}
+
+TEST(IncrementalLayoutTest, DoesNotReuseLayoutsMissingHotBlocks) {
+  // Block 2 of foo is hot in the current profile, but not laid out.
+  ASSERT_OK_AND_ASSIGN(PreviousClusterProfile previous_profile,
+                       ParsePreviousClusterProfile(R"(v1
+f foo
+c0 1 3
+g 0:110,1:100,2:10 1:100,3:100 2:10 3:100
+h 0:a 1:b 2:c 3:d
+)"));
+  std::unique_ptr<ProgramCfg> program_cfg = BuildProgramCfg();
+  EXPECT_THAT(GetReusableLayouts(*program_cfg, previous_profile,
+                                 /*max_edge_distance=*/0.05,
+                                 /*inter_function_reordering=*/false),
+              IsEmpty());
+  EXPECT_THAT(GetReusableLayouts(*program_cfg, previous_profile,
+                                 /*max_edge_distance=*/0.05,
+                                 /*inter_function_reordering=*/true),
+              IsEmpty());
+}
+
+// The previous layout of foo from inter-function reordering, where block 2 is
+// in a separate cluster.
+constexpr absl::string_view kPreviousMultiClusterProfile = R"(v1
+f foo
+c0 1 3
+c2
+g 0:110,1:100,2:10 1:100,3:100 2:10 3:100
+h 0:a 1:b 2:c 3:d
+)";
+
+TEST(IncrementalLayoutTest,
+     DoesNotReuseMultiClusterLayoutsWithoutInterFunctionReordering) {
+  ASSERT_OK_AND_ASSIGN(
+      PreviousClusterProfile previous_profile,
+      ParsePreviousClusterProfile(kPreviousMultiClusterProfile));
+  // baz calls foo.
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildProgramCfg({{3, 1, 1, 0, 10, CFGEdgeKind::kCall}});
+  auto reusable_layouts = GetReusableLayouts(
+      *program_cfg, previous_profile, /*max_edge_distance=*/0.05,
+      /*inter_function_reordering=*/false);
+  EXPECT_THAT(reusable_layouts, IsEmpty());
+
+  // foo is laid out again as a single chain starting with its entry block.
+  PropellerCodeLayoutParameters params;
+  CodeLayout code_layout(params, program_cfg->GetCfgs(),
+                         /*initial_chains=*/{}, absl::InfiniteFuture(),
+                         std::move(reusable_layouts));
+  SectionLayoutInfo layout_info = code_layout.GenerateLayout();
+  ASSERT_TRUE(layout_info.layouts_by_function_index.contains(1));
+  EXPECT_THAT(layout_info.layouts_by_function_index.at(1).bb_chains,
+              ElementsAre(Field(&FunctionLayoutInfo::BbChain::bb_bundles,
+                                Contains(Field(
+                                    &FunctionLayoutInfo::BbBundle::full_bb_ids,
+                                    Contains(BbIdIs(0)))))));
+  EXPECT_EQ(code_layout.stats().n_reused_function_layouts, 0);
+}
+
+TEST(IncrementalLayoutTest,
+     ReusesMultiClusterLayoutsWithInterFunctionReordering) {
+  ASSERT_OK_AND_ASSIGN(
+      PreviousClusterProfile previous_profile,
+      ParsePreviousClusterProfile(kPreviousMultiClusterProfile));
+  // baz calls foo, so the chain builder for the other functions sees a call
+  // into the reused function.
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildProgramCfg({{3, 1, 1, 0, 10, CFGEdgeKind::kCall}});
+  auto reusable_layouts = GetReusableLayouts(
+      *program_cfg, previous_profile, /*max_edge_distance=*/0.05,
+      /*inter_function_reordering=*/true);
+  ASSERT_THAT(reusable_layouts, UnorderedElementsAre(Key(1)));
+
+  PropellerCodeLayoutParameters params;
+  params.set_inter_function_reordering(true);
+  CodeLayout code_layout(params, program_cfg->GetCfgs(),
+                         /*initial_chains=*/{}, absl::InfiniteFuture(),
+                         std::move(reusable_layouts));
+  SectionLayoutInfo layout_info = code_layout.GenerateLayout();
+  ASSERT_TRUE(layout_info.layouts_by_function_index.contains(1));
+  // The clusters may be placed next to each other, but their blocks are kept
+  // together.
+  std::vector<std::vector<int>> bundled_bb_ids;
+  for (const FunctionLayoutInfo::BbChain& bb_chain :
+       layout_info.layouts_by_function_index.at(1).bb_chains) {
+    for (const FunctionLayoutInfo::BbBundle& bb_bundle : bb_chain.bb_bundles) {
+      std::vector<int>& bb_ids = bundled_bb_ids.emplace_back();
+      for (const FullIntraCfgId& full_bb_id : bb_bundle.full_bb_ids)
+        bb_ids.push_back(full_bb_id.bb_id);
+    }
+  }
+  EXPECT_THAT(bundled_bb_ids,
+              UnorderedElementsAre(ElementsAre(0, 1, 3), ElementsAre(2)));
+  EXPECT_EQ(code_layout.stats().n_reused_function_layouts, 1);
+}
+}  // namespace
+}  // namespace propeller
@@ -0,0 +1,248 @@
+// Copyright 2026 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/layout_simulator.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/btree_map.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
+#include "absl/log/check.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "llvm/ADT/StringRef.h"
+#include "propeller/bb_handle.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/cfg.h"
+#include "propeller/cfg_node.h"
+#include "propeller/code_layout.h"
+#include "propeller/function_layout_info.h"
+#include "propeller/program_cfg.h"
+#include "propeller/program_cfg_path_analyzer.h"
+
+namespace propeller {
+namespace {
+// Marks the lines of an empty cache and the nodes which are not yet assigned an
+// address.
+constexpr uint64_t kInvalidAddress = std::numeric_limits<uint64_t>::max();
+
+// Returns the original address of every node, keyed by function index and
+// indexed by `node_index()`.
+absl::flat_hash_map<int, std::vector<uint64_t>> GetOriginalAddresses(
+    const ProgramCfg& program_cfg) {
+  absl::flat_hash_map<int, std::vector<uint64_t>> addresses;
+  for (const ControlFlowGraph* cfg : program_cfg.GetCfgs()) {
+    std::vector<uint64_t>& cfg_addresses = addresses[cfg->function_index()];
+    cfg_addresses.reserve(cfg->nodes().size());
+    for (const auto& node : cfg->nodes()) cfg_addresses.push_back(node->addr());
+  }
+  return addresses;
+}
+
+// Returns the address of every node under the layout described by
+// `layout_info_by_section_name`, keyed by function index and indexed by
+// `node_index()`. The layout starts at the lowest original address. Every
+// section is laid out by placing its chains in the order of their layout
+// index, followed by the remaining (cold) blocks of its functions in the order
+// of their cold chain layout index. Functions without layout information are
+// placed at the end.
+absl::flat_hash_map<int, std::vector<uint64_t>> GetOptimizedAddresses(
+    const ProgramCfg& program_cfg,
+    const absl::btree_map<llvm::StringRef, SectionLayoutInfo>&
+        layout_info_by_section_name) {
+  absl::flat_hash_map<int, std::vector<uint64_t>> addresses;
+  uint64_t address = kInvalidAddress;
+  for (const ControlFlowGraph* cfg : program_cfg.GetCfgs()) {
+    addresses[cfg->function_index()].assign(cfg->nodes().size(),
+                                            kInvalidAddress);
+    for (const auto& node : cfg->nodes())
+      address = std::min(address, node->addr());
+  }
+  auto place_node = [&](const CFGNode& node) {
+    uint64_t& node_address =
+        addresses.at(node.function_index())[node.node_index()];
+    if (node_address != kInvalidAddress) return;
+    node_address = address;
+    address += node.size();
+  };
+  auto place_unplaced_nodes = [&](const ControlFlowGraph& cfg) {
+    for (const auto& node : cfg.nodes()) place_node(*node);
+  };
+
+  for (const auto& [unused_section_name, section_layout_info] :
+       layout_info_by_section_name) {
+    std::vector<std::tuple<unsigned, int, const FunctionLayoutInfo::BbChain*>>
+        chains;
+    std::vector<std::pair<unsigned, int>> cold_chains;
+    for (const auto& [function_index, layout_info] :
+         section_layout_info.layouts_by_function_index) {
+      for (const FunctionLayoutInfo::BbChain& chain : layout_info.bb_chains)
+        chains.emplace_back(chain.layout_index, function_index, &chain);
+      cold_chains.emplace_back(layout_info.cold_chain_layout_index,
+                               function_index);
+    }
+    absl::c_sort(chains, [](const auto& lhs, const auto& rhs) {
+      return std::get<0>(lhs) < std::get<0>(rhs);
+    });
+    absl::c_sort(cold_chains);
+    for (const auto& [unused, function_index, chain] : chains) {
+      const ControlFlowGraph* cfg = program_cfg.GetCfgByIndex(function_index);
+      CHECK_NE(cfg, nullptr);
+      for (const FullIntraCfgId& full_bb_id : chain->GetAllBbs())
+        place_node(cfg->GetNodeById(full_bb_id.intra_cfg_id));
+    }
+    for (const auto& [unused, function_index] : cold_chains)
+      place_unplaced_nodes(*program_cfg.GetCfgByIndex(function_index));
+  }
+  for (const ControlFlowGraph* cfg : program_cfg.GetCfgs())
+    place_unplaced_nodes(*cfg);
+  return addresses;
+}
+
+// Visits the blocks of a path and calls `fetch_node` on every one of them.
+class FetchingPathTraceHandler : public PathTraceHandler {
+ public:
+  // Does not take ownership of `cfg`, which must outlive the constructed
+  // object.
+  FetchingPathTraceHandler(const ControlFlowGraph* cfg,
+                           absl::FunctionRef<void(const CFGNode&)> fetch_node)
+      : cfg_(cfg), fetch_node_(fetch_node) {}
+
+  void VisitBlock(int flat_bb_index, absl::Time sample_time) override {
+    fetch_node_(*cfg_->nodes().at(flat_bb_index));
+  }
+  // The blocks of the callees are fetched when replaying their own paths.
+  void HandleCalls(absl::Span<const CallRetInfo> call_rets) override {}
+  void HandleReturn(const FlatBbHandle& bb_handle) override {}
+  void ResetPath() override {}
+
+ private:
+  const ControlFlowGraph* cfg_;
+  absl::FunctionRef<void(const CFGNode&)> fetch_node_;
+};
+}  // namespace
+
+CacheSimulator::CacheSimulator(const CacheParameters& params)
+    : line_size_(params.line_size),
+      associativity_(params.associativity),
+      n_sets_(params.line_size > 0 && params.associativity > 0
+                  ? params.size / (params.line_size * params.associativity)
+                  : 0) {
+  CHECK_GT(n_sets_, 0) << "Cache of size " << params.size
+                       << " cannot hold a set of " << params.associativity
+                       << " lines of size " << params.line_size << ".";
+  lines_.assign(n_sets_ * associativity_, kInvalidAddress);
+}
+
+bool CacheSimulator::Access(uint64_t address) {
+  ++accesses_;
+  const uint64_t line = address / line_size_;
+  const auto set_begin = lines_.begin() + (line % n_sets_) * associativity_;
+  const auto set_end = set_begin + associativity_;
+  auto it = std::find(set_begin, set_end, line);
+  const bool hit = it != set_end;
+  if (!hit) {
+    // Evict the least recently used line.
+    ++misses_;
+    it = set_end - 1;
+    *it = line;
+  }
+  // Move the accessed line to the most recently used position.
+  std::rotate(set_begin, it, it + 1);
+  return hit;
+}
+
+std::string LayoutSimulationStats::DebugString() const {
+  return absl::StrFormat(
+      "blocks fetched: %d, L1i misses: %d/%d, L2 misses: %d/%d, iTLB misses: "
+      "%d/%d",
+      blocks_fetched, l1i_misses, l1i_accesses, l2_misses, l2_accesses,
+      itlb_misses, itlb_accesses);
+}
+
+const std::vector<uint64_t>*
+LayoutSimulator::LayoutFetchSimulator::GetAddresses(int function_index) const {
+  auto it = addresses_.find(function_index);
+  if (it == addresses_.end()) return nullptr;
+  return &it->second;
+}
+
+void LayoutSimulator::LayoutFetchSimulator::Fetch(uint64_t address,
+                                                  int size) {
+  ++blocks_fetched_;
+  if (size == 0) return;
+  // Every L1i line of the block is translated by the iTLB and fetched through
+  // the L1i cache, and then through the L2 cache on a miss.
+  for (uint64_t line = address / l1i_line_size_;
+       line <= (address + size - 1) / l1i_line_size_; ++line) {
+    const uint64_t line_address = line * l1i_line_size_;
+    itlb_.Access(line_address);
+    if (!l1i_cache_.Access(line_address)) l2_cache_.Access(line_address);
+  }
+}
+
+LayoutSimulationStats LayoutSimulator::LayoutFetchSimulator::GetStats() const {
+  return {.blocks_fetched = blocks_fetched_,
+          .l1i_accesses = l1i_cache_.accesses(),
+          .l1i_misses = l1i_cache_.misses(),
+          .l2_accesses = l2_cache_.accesses(),
+          .l2_misses = l2_cache_.misses(),
+          .itlb_accesses = itlb_.accesses(),
+          .itlb_misses = itlb_.misses()};
+}
+
+LayoutSimulator::LayoutSimulator(
+    const ProgramCfg* program_cfg,
+    const absl::btree_map<llvm::StringRef, SectionLayoutInfo>&
+        layout_info_by_section_name,
+    const LayoutSimulationParameters& params)
+    : program_cfg_(program_cfg),
+      original_layout_(GetOriginalAddresses(*program_cfg), params),
+      optimized_layout_(
+          GetOptimizedAddresses(*program_cfg, layout_info_by_section_name),
+          params) {}
+
+void LayoutSimulator::SimulatePaths(
+    absl::Span<const FlatBbHandleBranchPath> paths) {
+  for (const FlatBbHandleBranchPath& path : paths) {
+    if (path.branches.empty()) continue;
+    const int function_index =
+        path.branches.front().from_bb.has_value()
+            ? path.branches.front().from_bb->function_index
+            : path.branches.front().to_bb->function_index;
+    const ControlFlowGraph* cfg = program_cfg_->GetCfgByIndex(function_index);
+    if (cfg == nullptr) continue;
+    const std::vector<uint64_t>& original_addresses =
+        *original_layout_.GetAddresses(function_index);
+    const std::vector<uint64_t>& optimized_addresses =
+        *optimized_layout_.GetAddresses(function_index);
+    FetchingPathTraceHandler handler(cfg, [&](const CFGNode& node) {
+      original_layout_.Fetch(original_addresses[node.node_index()],
+                             node.size());
+      optimized_layout_.Fetch(optimized_addresses[node.node_index()],
+                              node.size());
+    });
+    PathTracer(cfg, &handler).TracePath(path);
+  }
+}
+}  // namespace propeller
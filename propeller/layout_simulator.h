@@ -0,0 +1,161 @@
+// Copyright 2026 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROPELLER_LAYOUT_SIMULATOR_H_
+#define PROPELLER_LAYOUT_SIMULATOR_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/btree_map.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/types/span.h"
+#include "llvm/ADT/StringRef.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/code_layout.h"
+#include "propeller/program_cfg.h"
+
+namespace propeller {
+
+// Parameters of a set-associative cache with LRU replacement.
+struct CacheParameters {
+  // Total capacity in bytes.
+  int64_t size = 0;
+  // Size of every cache line in bytes. For a TLB, this is the page size.
+  int64_t line_size = 64;
+  int associativity = 8;
+};
+
+// Parameters of the simulated instruction fetch hierarchy.
+struct LayoutSimulationParameters {
+  CacheParameters l1i_cache = {
+      .size = 32 * 1024, .line_size = 64, .associativity = 8};
+  CacheParameters l2_cache = {
+      .size = 1024 * 1024, .line_size = 64, .associativity = 16};
+  // The iTLB is simulated as a cache of pages.
+  CacheParameters itlb = {
+      .size = 64 * 4096, .line_size = 4096, .associativity = 8};
+};
+
+// Simulates a set-associative cache with LRU replacement.
+class CacheSimulator {
+ public:
+  explicit CacheSimulator(const CacheParameters& params);
+
+  CacheSimulator(const CacheSimulator&) = default;
+  CacheSimulator& operator=(const CacheSimulator&) = default;
+  CacheSimulator(CacheSimulator&&) = default;
+  CacheSimulator& operator=(CacheSimulator&&) = default;
+
+  // Accesses the line containing `address` and returns whether it was a hit.
+  bool Access(uint64_t address);
+
+  int64_t accesses() const { return accesses_; }
+  int64_t misses() const { return misses_; }
+
+ private:
+  int64_t line_size_;
+  int associativity_;
+  int64_t n_sets_;
+  // The lines in every set, from the most to the least recently used. The set
+  // with index `i` is stored at [i * associativity_, (i + 1) * associativity_).
+  std::vector<uint64_t> lines_;
+  int64_t accesses_ = 0;
+  int64_t misses_ = 0;
+};
+
+// Estimated instruction fetch behavior of one layout.
+struct LayoutSimulationStats {
+  int64_t blocks_fetched = 0;
+  int64_t l1i_accesses = 0;
+  int64_t l1i_misses = 0;
+  int64_t l2_accesses = 0;
+  int64_t l2_misses = 0;
+  int64_t itlb_accesses = 0;
+  int64_t itlb_misses = 0;
+
+  std::string DebugString() const;
+};
+
+// Replays the intra-function paths read by `PerfDataPathReader` and simulates
+// fetching the executed basic blocks through the L1i cache, L2 cache, and iTLB
+// under two address assignments: the original addresses of the CFG nodes, and
+// the addresses under a new layout. Paths are replayed in the order they are
+// passed, and the simulated state carries over from one sample to the next, so
+// the results are estimates for comparing layouts rather than miss counts.
+class LayoutSimulator {
+ public:
+  // Does not take ownership of `program_cfg`, which must outlive the
+  // constructed object. The new layout is described by
+  // `layout_info_by_section_name`, as returned by `GenerateLayoutBySection`.
+  LayoutSimulator(const ProgramCfg* program_cfg,
+                  const absl::btree_map<llvm::StringRef, SectionLayoutInfo>&
+                      layout_info_by_section_name,
+                  const LayoutSimulationParameters& params);
+
+  LayoutSimulator(const LayoutSimulator&) = delete;
+  LayoutSimulator& operator=(const LayoutSimulator&) = delete;
+  LayoutSimulator(LayoutSimulator&&) = default;
+  LayoutSimulator& operator=(LayoutSimulator&&) = default;
+
+  // Simulates fetching the blocks of `paths` under both layouts. This can be
+  // passed as the callback of `PerfDataPathReader::ReadPathsAndApplyCallBack`.
+  void SimulatePaths(absl::Span<const FlatBbHandleBranchPath> paths);
+
+  LayoutSimulationStats original_layout_stats() const {
+    return original_layout_.GetStats();
+  }
+  LayoutSimulationStats optimized_layout_stats() const {
+    return optimized_layout_.GetStats();
+  }
+
+ private:
+  // The simulated fetch hierarchy under one address assignment.
+  class LayoutFetchSimulator {
+   public:
+    LayoutFetchSimulator(
+        absl::flat_hash_map<int, std::vector<uint64_t>> addresses,
+        const LayoutSimulationParameters& params)
+        : addresses_(std::move(addresses)),
+          l1i_line_size_(params.l1i_cache.line_size),
+          l1i_cache_(params.l1i_cache),
+          l2_cache_(params.l2_cache),
+          itlb_(params.itlb) {}
+
+    // Returns the node addresses of the function with index `function_index`,
+    // indexed by their `node_index()`, or `nullptr` if the function is unknown.
+    const std::vector<uint64_t>* GetAddresses(int function_index) const;
+
+    // Fetches the `size` bytes at `address`.
+    void Fetch(uint64_t address, int size);
+
+    LayoutSimulationStats GetStats() const;
+
+   private:
+    absl::flat_hash_map<int, std::vector<uint64_t>> addresses_;
+    int64_t l1i_line_size_;
+    CacheSimulator l1i_cache_;
+    CacheSimulator l2_cache_;
+    CacheSimulator itlb_;
+    int64_t blocks_fetched_ = 0;
+  };
+
+  const ProgramCfg* program_cfg_;
+  LayoutFetchSimulator original_layout_;
+  LayoutFetchSimulator optimized_layout_;
+};
+}  // namespace propeller
+#endif  // PROPELLER_LAYOUT_SIMULATOR_H_
@@ -0,0 +1,106 @@
+// Copyright 2026 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/layout_simulator.h"
+
+#include <memory>
+#include <vector>
+
+#include "absl/container/btree_map.h"
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "llvm/ADT/StringRef.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/cfg_edge_kind.h"
+#include "propeller/cfg_id.h"
+#include "propeller/code_layout.h"
+#include "propeller/function_layout_info.h"
+#include "propeller/mock_program_cfg_builder.h"
+#include "propeller/program_cfg.h"
+
+namespace propeller {
+namespace {
+using ::testing::AllOf;
+using ::testing::Field;
+
+TEST(CacheSimulatorTest, EvictsLeastRecentlyUsedLine) {
+  // A single set of two lines.
+  CacheSimulator cache({.size = 128, .line_size = 64, .associativity = 2});
+  EXPECT_FALSE(cache.Access(0));
+  EXPECT_FALSE(cache.Access(64));
+  EXPECT_TRUE(cache.Access(10));
+  // Evicts line 64, which is less recently used than line 0.
+  EXPECT_FALSE(cache.Access(128));
+  EXPECT_TRUE(cache.Access(0));
+  EXPECT_FALSE(cache.Access(64));
+  EXPECT_EQ(cache.accesses(), 6);
+  EXPECT_EQ(cache.misses(), 4);
+}
+
+TEST(LayoutSimulatorTest, SimulatesOriginalAndOptimizedLayouts) {
+  // Every block of foo is in a different page in the original layout.
+  std::unique_ptr<ProgramCfg> program_cfg = BuildFromCfgArg(
+      {.cfg_args = {{".text",
+                     5,
+                     "foo",
+                     {{0x1000, 0, 0x10, {.CanFallThrough = false}},
+                      {0x2000, 1, 0x10, {.CanFallThrough = false}},
+                      {0x3000, 2, 0x10, {.CanFallThrough = false}},
+                      {0x4000, 3, 0x10, {.CanFallThrough = false}}},
+                     {{0, 2, 10, CFGEdgeKind::kBranchOrFallthough},
+                      {2, 0, 10, CFGEdgeKind::kBranchOrFallthough}}}}});
+  // The new layout places all blocks of foo contiguously.
+  FunctionLayoutInfo::BbChain chain(/*_layout_index=*/0);
+  chain.bb_bundles.push_back(
+      {.full_bb_ids = {{.bb_id = 0, .intra_cfg_id = {0, 0}},
+                       {.bb_id = 2, .intra_cfg_id = {2, 0}},
+                       {.bb_id = 1, .intra_cfg_id = {1, 0}},
+                       {.bb_id = 3, .intra_cfg_id = {3, 0}}}});
+  absl::btree_map<llvm::StringRef, SectionLayoutInfo>
+      layout_info_by_section_name;
+  layout_info_by_section_name[".text"].layouts_by_function_index.emplace(
+      5, FunctionLayoutInfo{.bb_chains = {chain}});
+
+  // A single line in the L1i cache, L2 cache, and iTLB.
+  LayoutSimulator simulator(
+      program_cfg.get(), layout_info_by_section_name,
+      {.l1i_cache = {.size = 64, .line_size = 64, .associativity = 1},
+       .l2_cache = {.size = 64, .line_size = 64, .associativity = 1},
+       .itlb = {.size = 4096, .line_size = 4096, .associativity = 1}});
+  std::vector<FlatBbHandleBranchPath> paths = {
+      {.pid = 123456,
+       .sample_time = absl::FromUnixMillis(1010),
+       .branches = {{.to_bb = {{.function_index = 5, .flat_bb_index = 0}}},
+                    {.from_bb = {{.function_index = 5, .flat_bb_index = 0}},
+                     .to_bb = {{.function_index = 5, .flat_bb_index = 2}}},
+                    {.from_bb = {{.function_index = 5, .flat_bb_index = 2}},
+                     .to_bb = {{.function_index = 5, .flat_bb_index = 0}}}}}};
+  simulator.SimulatePaths(paths);
+
+  // Blocks 0, 2, and 0 are fetched, each one from a different line and page in
+  // the original layout, and all from one line in the new layout.
+  EXPECT_THAT(simulator.original_layout_stats(),
+              AllOf(Field(&LayoutSimulationStats::blocks_fetched, 3),
+                    Field(&LayoutSimulationStats::l1i_misses, 3),
+                    Field(&LayoutSimulationStats::l2_misses, 3),
+                    Field(&LayoutSimulationStats::itlb_misses, 3)));
+  EXPECT_THAT(simulator.optimized_layout_stats(),
+              AllOf(Field(&LayoutSimulationStats::blocks_fetched, 3),
+                    Field(&LayoutSimulationStats::l1i_misses, 1),
+                    Field(&LayoutSimulationStats::l2_misses, 1),
+                    Field(&LayoutSimulationStats::itlb_misses, 1)));
+}
+}  // namespace
+}  // namespace propeller
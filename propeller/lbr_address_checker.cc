@@ -0,0 +1,145 @@
+// Copyright 2026 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/lbr_address_checker.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/log/log.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/Threading.h"
+#include "propeller/binary_address_branch.h"
+#include "propeller/binary_content.h"
+#include "propeller/lbr_aggregation.h"
+#include "propeller/mini_disassembler.h"
+#include "propeller/propeller_statistics.h"
+#include "propeller/status_macros.h"  // Included for macros.
+
+namespace propeller {
+
+absl::StatusOr<PropellerStats::DisassemblyStats> CheckLbrAddress(
+    const LbrAggregation& lbr_aggregation, const BinaryContent& binary_content,
+    uint32_t address_check_budget) {
+  // Minimum number of addresses disassembled by each thread.
+  constexpr int kMinAddressesPerShard = 4096;
+
+  absl::flat_hash_map<int64_t, int64_t> counter_sum_by_source_address;
+  for (const auto& [branch, counter] : lbr_aggregation.branch_counters) {
+    if (branch.from == kInvalidBinaryAddress) continue;
+    counter_sum_by_source_address[branch.from] += counter;
+  }
+  std::vector<std::pair<int64_t, int64_t>> address_and_counter_sums(
+      counter_sum_by_source_address.begin(),
+      counter_sum_by_source_address.end());
+  const int64_t total_addresses = address_and_counter_sums.size();
+  int64_t total_counter_sum = 0;
+  for (const auto& [address, counter] : address_and_counter_sums)
+    total_counter_sum += counter;
+
+  if (address_check_budget > 0 && address_check_budget < total_addresses) {
+    // Keep the heaviest addresses, breaking ties by address for determinism.
+    absl::c_nth_element(address_and_counter_sums,
+                        address_and_counter_sums.begin() +
+                            address_check_budget,
+                        [](const auto& a, const auto& b) {
+                          return std::tie(b.second, a.first) <
+                                 std::tie(a.second, b.first);
+                        });
+    address_and_counter_sums.resize(address_check_budget);
+  }
+  const int64_t checked_addresses = address_and_counter_sums.size();
+
+  // Each shard gets its own disassembler, since `MiniDisassembler` is not
+  // thread-safe. Disassemblers are created up front as target registration is
+  // not thread-safe either.
+  const int num_shards = std::max<int64_t>(
+      1, std::min<int64_t>(
+             llvm::hardware_concurrency().compute_thread_count(),
+             checked_addresses / kMinAddressesPerShard));
+  std::vector<std::unique_ptr<MiniDisassembler>> disassemblers;
+  for (int i = 0; i < num_shards; ++i) {
+    ASSIGN_OR_RETURN(
+        std::unique_ptr<MiniDisassembler> disassembler,
+        MiniDisassembler::Create(binary_content.object_file.get()));
+    disassemblers.push_back(std::move(disassembler));
+  }
+
+  std::vector<PropellerStats::DisassemblyStats> stats_by_shard(num_shards);
+  llvm::parallelFor(0, num_shards, [&](size_t shard) {
+    MiniDisassembler& disassembler = *disassemblers[shard];
+    PropellerStats::DisassemblyStats& result = stats_by_shard[shard];
+    for (int64_t i = shard * checked_addresses / num_shards;
+         i < (shard + 1) * checked_addresses / num_shards; ++i) {
+      const auto& [address, counter] = address_and_counter_sums[i];
+      absl::StatusOr<llvm::MCInst> inst = disassembler.DisassembleOne(address);
+      if (!inst.ok()) {
+        result.could_not_disassemble.Increment(counter);
+        LOG_EVERY_N(WARNING, 100) << absl::StrFormat(
+            "not able to disassemble address: 0x%x with counter sum %d",
+            address, counter);
+        continue;
+      }
+      if (!disassembler.MayAffectControlFlow(*inst)) {
+        result.cant_affect_control_flow.Increment(counter);
+        LOG_EVERY_N(WARNING, 100) << absl::StrFormat(
+            "not a potentially-control-flow-affecting "
+            "instruction at address: "
+            "0x%x with counter sum %d, instruction name: %s",
+            address, counter, disassembler.GetInstructionName(*inst));
+      } else {
+        result.may_affect_control_flow.Increment(counter);
+      }
+    }
+  });
+
+  PropellerStats::DisassemblyStats result = {};
+  for (const PropellerStats::DisassemblyStats& shard_stats : stats_by_shard)
+    result += shard_stats;
+  if (checked_addresses == total_addresses) return result;
+
+  int64_t checked_counter_sum = 0;
+  for (const auto& [address, counter] : address_and_counter_sums)
+    checked_counter_sum += counter;
+  LOG(INFO) << "Checked " << checked_addresses << " out of " << total_addresses
+            << " LBR source addresses (" << checked_counter_sum << " out of "
+            << total_counter_sum
+            << " counters); disassembly stats are extrapolated.";
+  // Scales the counts of the checked addresses up to all addresses.
+  auto extrapolate = [&](PropellerStats::DisassemblyStats::Stat& stat) {
+    stat.absolute = static_cast<int64_t>(static_cast<double>(stat.absolute) *
+                                         total_addresses / checked_addresses);
+    if (checked_counter_sum != 0) {
+      stat.weighted = static_cast<int64_t>(static_cast<double>(stat.weighted) *
+                                           total_counter_sum /
+                                           checked_counter_sum);
+    }
+  };
+  extrapolate(result.could_not_disassemble);
+  extrapolate(result.may_affect_control_flow);
+  extrapolate(result.cant_affect_control_flow);
+  return result;
+}
+
+}  // namespace propeller
@@ -0,0 +1,41 @@
+// Copyright 2026 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROPELLER_LBR_ADDRESS_CHECKER_H_
+#define PROPELLER_LBR_ADDRESS_CHECKER_H_
+
+#include <cstdint>
+
+#include "absl/status/statusor.h"
+#include "propeller/binary_content.h"
+#include "propeller/lbr_aggregation.h"
+#include "propeller/propeller_statistics.h"
+
+// Internal to `PerfLbrAggregator`, split out so that it can be tested on a
+// hand-made `LbrAggregation`.
+namespace propeller {
+
+// Checks that `lbr_aggregation`'s source addresses are really branch, jmp,
+// call or return instructions and returns the resulting statistics. If
+// `address_check_budget` is non-zero, only that many addresses with the
+// highest counter sums (ties broken by lower address) are checked and the
+// statistics are extrapolated to all addresses. Disassembly is sharded across
+// threads.
+absl::StatusOr<PropellerStats::DisassemblyStats> CheckLbrAddress(
+    const LbrAggregation& lbr_aggregation, const BinaryContent& binary_content,
+    uint32_t address_check_budget);
+
+}  // namespace propeller
+
+#endif  // PROPELLER_LBR_ADDRESS_CHECKER_H_
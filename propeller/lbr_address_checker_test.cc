@@ -0,0 +1,116 @@
+// Copyright 2026 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/lbr_address_checker.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/status/status_matchers.h"
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "propeller/binary_content.h"
+#include "propeller/lbr_aggregation.h"
+#include "propeller/status_testing_macros.h"
+
+namespace propeller {
+namespace {
+using ::absl_testing::IsOkAndHolds;
+using ::testing::FieldsAre;
+
+// Addresses of instructions in llvm_function_samples.binary.
+constexpr int64_t kPushAddress = 0x400590;
+constexpr int64_t kBranchAddress = 0x4008b6;
+constexpr int64_t kCallAddress = 0x4008c9;
+constexpr int64_t kRetAddress = 0x4008e4;
+// An address outside of all sections, which can't be disassembled.
+constexpr int64_t kInvalidAddress = 0x999999999;
+
+std::string GetLlvmFunctionSamplesBinaryPath() {
+  return absl::StrCat(::testing::SrcDir(),
+                      "_main/propeller/testdata/llvm_function_samples.binary");
+}
+
+// Returns an aggregation where the control-flow-affecting source addresses are
+// the heaviest: 4 source addresses with a total counter sum of 153.
+LbrAggregation GetLbrAggregation() {
+  return {.branch_counters = {{{.from = kRetAddress, .to = 0x400600}, 60},
+                              {{.from = kRetAddress, .to = 0x400700}, 40},
+                              {{.from = kCallAddress, .to = 0x400800}, 50},
+                              {{.from = kPushAddress, .to = 0x400900}, 2},
+                              {{.from = kInvalidAddress, .to = 0x400a00}, 1}}};
+}
+
+TEST(LbrAddressCheckerTest, ChecksAllAddressesWithoutBudget) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(GetLlvmFunctionSamplesBinaryPath()));
+  EXPECT_THAT(CheckLbrAddress(GetLbrAggregation(), *binary_content,
+                              /*address_check_budget=*/0),
+              IsOkAndHolds(FieldsAre(/*could_not_disassemble=*/FieldsAre(1, 1),
+                                     /*may_affect_control_flow=*/
+                                     FieldsAre(2, 150),
+                                     /*cant_affect_control_flow=*/
+                                     FieldsAre(1, 2))));
+  // A budget which is not smaller than the number of addresses checks all of
+  // them.
+  EXPECT_THAT(CheckLbrAddress(GetLbrAggregation(), *binary_content,
+                              /*address_check_budget=*/4),
+              IsOkAndHolds(FieldsAre(FieldsAre(1, 1), FieldsAre(2, 150),
+                                     FieldsAre(1, 2))));
+}
+
+TEST(LbrAddressCheckerTest, ChecksHeaviestAddressesAndExtrapolates) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(GetLlvmFunctionSamplesBinaryPath()));
+  // Only the ret and call addresses (counter sums 100 and 50) are checked. The
+  // 2 addresses found are scaled to 2 * 4 / 2 = 4 and their weight to
+  // 150 * 153 / 150 = 153. The unchecked push and invalid addresses are not
+  // counted in any stat.
+  EXPECT_THAT(CheckLbrAddress(GetLbrAggregation(), *binary_content,
+                              /*address_check_budget=*/2),
+              IsOkAndHolds(FieldsAre(/*could_not_disassemble=*/FieldsAre(0, 0),
+                                     /*may_affect_control_flow=*/
+                                     FieldsAre(4, 153),
+                                     /*cant_affect_control_flow=*/
+                                     FieldsAre(0, 0))));
+  // With a budget of 3, the push address is checked as well:
+  //  * may_affect_control_flow: 2 * 4 / 3 = 2 and 150 * 153 / 152 = 150.
+  //  * cant_affect_control_flow: 1 * 4 / 3 = 1 and 2 * 153 / 152 = 2.
+  EXPECT_THAT(CheckLbrAddress(GetLbrAggregation(), *binary_content,
+                              /*address_check_budget=*/3),
+              IsOkAndHolds(FieldsAre(FieldsAre(0, 0), FieldsAre(2, 150),
+                                     FieldsAre(1, 2))));
+}
+
+TEST(LbrAddressCheckerTest, BreaksBudgetTiesByLowerAddress) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(GetLlvmFunctionSamplesBinaryPath()));
+  // All addresses have the same counter sum, so the budget selects the lowest
+  // addresses: the push and the branch.
+  EXPECT_THAT(
+      CheckLbrAddress(
+          {.branch_counters = {{{.from = kRetAddress, .to = 0x400600}, 10},
+                               {{.from = kCallAddress, .to = 0x400600}, 10},
+                               {{.from = kBranchAddress, .to = 0x400600}, 10},
+                               {{.from = kPushAddress, .to = 0x400600}, 10}}},
+          *binary_content, /*address_check_budget=*/2),
+      IsOkAndHolds(FieldsAre(/*could_not_disassemble=*/FieldsAre(0, 0),
+                             /*may_affect_control_flow=*/FieldsAre(2, 20),
+                             /*cant_affect_control_flow=*/FieldsAre(2, 20))));
+}
+
+}  // namespace
+}  // namespace propeller
@@ -282,6 +282,23 @@ double NodeChain::ComputeScore(const NodeToBundleMapper& bundle_mapper,
   return score;
 }
 
+NodeChain::IntraChainEdgeScores NodeChain::ComputeIntraChainEdgeScores(
+    const NodeToBundleMapper& bundle_mapper,
+    const PropellerCodeLayoutScorer& scorer) const {
+  IntraChainEdgeScores scores;
+  scores.bundle_offsets.reserve(node_bundles().size());
+  for (const std::unique_ptr<CFGNodeBundle>& bundle : node_bundles()) {
+    scores.bundle_offsets.push_back(scores.edge_scores.size());
+    for (const CFGEdge* edge : bundle->intra_chain_out_edges()) {
+      scores.edge_scores.push_back(scorer.GetEdgeScore(
+          *edge, bundle_mapper.GetNodeOffset(edge->sink()) -
+                     bundle_mapper.GetNodeOffset(edge->src()) -
+                     edge->src()->size()));
+    }
+  }
+  return scores;
+}
+
 std::unique_ptr<NodeToBundleMapper>
 NodeToBundleMapper::CreateNodeToBundleMapper(
     const std::vector<const ControlFlowGraph*>& cfgs) {
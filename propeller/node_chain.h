@@ -173,6 +173,21 @@ class CFGNodeBundle {
 // Represents a chain of nodes (basic blocks).
 class NodeChain {
  public:
+  // Scores of the intra-chain edges of a chain under its current layout.
+  struct IntraChainEdgeScores {
+    // Scores of all intra-chain edges, in the order of `node_bundles()` and of
+    // every bundle's `intra_chain_out_edges()`.
+    std::vector<double> edge_scores;
+    // Index in `edge_scores` of the first edge of every bundle.
+    std::vector<int> bundle_offsets;
+
+    // Returns the score of the `edge_index`th intra-chain out edge of the
+    // bundle at `chain_index`.
+    double GetEdgeScore(int chain_index, int edge_index) const {
+      return edge_scores[bundle_offsets[chain_index] + edge_index];
+    }
+  };
+
   // Constructor for building a chain from a 2D vector of nodes, where each
   // inner vector of nodes must be placed in a bundle.
   explicit NodeChain(std::vector<std::vector<const CFGNode*>> nodes)
@@ -232,6 +247,14 @@ class NodeChain {
 
   void SetScore(double score) { score_ = score; }
 
+  // Returns the score of every intra-chain edge of this chain under its
+  // current layout. This lets `NodeChainAssembly` read the original score of
+  // the edges whose distance changes by splitting, rather than rescoring them
+  // for every splitting assembly.
+  IntraChainEdgeScores ComputeIntraChainEdgeScores(
+      const NodeToBundleMapper& bundle_mapper,
+      const PropellerCodeLayoutScorer& scorer) const;
+
   const CFGNode* GetLastNode() const {
     return node_bundles_.back()->nodes().back();
   }
@@ -49,7 +49,8 @@ absl::StatusOr<NodeChainAssembly> NodeChainAssembly::BuildNodeChainAssembly(
     CHECK_GT(*options.slice_pos, 0) << "Out of bounds slice position.";
   }
   NodeChainAssembly assembly(bundle_mapper, scorer, split_chain, unsplit_chain,
-                             options.merge_order, options.slice_pos);
+                             options.merge_order, options.slice_pos,
+                             options.split_chain_edge_scores);
   // If `inter_function_ordering = false`, omit assemblies which place the entry
   // node in the middle of the chain. Placing the entry block in the middle is
   // allowed. However, it requires multiple hot function parts (sections) as the
@@ -74,7 +75,8 @@ absl::StatusOr<NodeChainAssembly> NodeChainAssembly::BuildNodeChainAssembly(
 
 double NodeChainAssembly::ComputeScoreGain(
     const NodeToBundleMapper& bundle_mapper,
-    const PropellerCodeLayoutScorer& scorer) const {
+    const PropellerCodeLayoutScorer& scorer,
+    const NodeChain::IntraChainEdgeScores* split_chain_edge_scores) const {
   // First compute the inter-chain score.
   double score_gain = ComputeInterChainScore(bundle_mapper, scorer,
                                              split_chain(), unsplit_chain()) +
@@ -84,7 +86,8 @@ double NodeChainAssembly::ComputeScoreGain(
   // exact computation of the score gain and simply return 0.
   if (score_gain == 0) return 0;
   // Consider the change in score from split_chain as well.
-  return score_gain + ComputeSplitChainScoreGain(bundle_mapper, scorer);
+  return score_gain + ComputeSplitChainScoreGain(bundle_mapper, scorer,
+                                                split_chain_edge_scores);
 }
 
 std::vector<NodeChainSlice> NodeChainAssembly::ConstructSlices() const {
@@ -223,39 +226,50 @@ double NodeChainAssembly::ComputeInterChainScore(
 // correct because intra-slice edges will see no difference in score.
 double NodeChainAssembly::ComputeSplitChainScoreGain(
     const NodeToBundleMapper& bundle_mapper,
-    const PropellerCodeLayoutScorer& scorer) const {
+    const PropellerCodeLayoutScorer& scorer,
+    const NodeChain::IntraChainEdgeScores* split_chain_edge_scores) const {
   if (!splits()) return 0;
+  if (split_chain_edge_scores != nullptr) {
+    CHECK_EQ(split_chain_edge_scores->bundle_offsets.size(),
+             split_chain().node_bundles().size());
+  }
   double score_gain = 0;
-  auto get_score_gain = [&](const CFGEdge& edge) {
-    return ComputeEdgeScore(bundle_mapper, scorer, edge) -
-           scorer.GetEdgeScore(edge,
-                               bundle_mapper.GetNodeOffset(edge.sink()) -
-                                   bundle_mapper.GetNodeOffset(edge.src()) -
-                                   edge.src()->size());
+  // Returns the score gain of `edge`, which is the `edge_index`th intra-chain
+  // out edge of the bundle at `chain_index`.
+  auto get_score_gain = [&](const CFGEdge& edge, int chain_index,
+                            int edge_index) {
+    const double original_score =
+        split_chain_edge_scores != nullptr
+            ? split_chain_edge_scores->GetEdgeScore(chain_index, edge_index)
+            : scorer.GetEdgeScore(edge,
+                                  bundle_mapper.GetNodeOffset(edge.sink()) -
+                                      bundle_mapper.GetNodeOffset(edge.src()) -
+                                      edge.src()->size());
+    return ComputeEdgeScore(bundle_mapper, scorer, edge) - original_score;
+  };
+  auto get_sink_chain_index = [&](const CFGEdge& edge) {
+    return bundle_mapper.GetBundleMappingEntry(edge.sink())
+        .bundle->chain_mapping()
+        .chain_index;
   };
   // Visit edges from the first slice (before `slice_pos_`) to the second slice.
   for (int i = 0; i < *slice_pos_; ++i) {
-    const auto& bundle = split_chain().node_bundles()[i];
-    for (auto it = bundle->intra_chain_out_edges().rbegin(),
-              it_end = bundle->intra_chain_out_edges().rend();
-         it != it_end && bundle_mapper.GetBundleMappingEntry((*it)->sink())
-                                 .bundle->chain_mapping()
-                                 .chain_index >= *slice_pos_;
-         ++it) {
-      score_gain += get_score_gain(**it);
+    const std::vector<const CFGEdge*>& edges =
+        split_chain().node_bundles()[i]->intra_chain_out_edges();
+    for (int j = edges.size() - 1;
+         j >= 0 && get_sink_chain_index(*edges[j]) >= *slice_pos_; --j) {
+      score_gain += get_score_gain(*edges[j], i, j);
     }
   }
   // Visit edges from the second slice (on and after `slice_pos_`) to the first
   // slice.
   for (int i = *slice_pos_; i < split_chain().node_bundles().size(); ++i) {
-    const auto& bundle = split_chain().node_bundles()[i];
-    for (auto it = bundle->intra_chain_out_edges().begin(),
-              it_end = bundle->intra_chain_out_edges().end();
-         it != it_end && bundle_mapper.GetBundleMappingEntry((*it)->sink())
-                                 .bundle->chain_mapping()
-                                 .chain_index < *slice_pos_;
-         ++it) {
-      score_gain += get_score_gain(**it);
+    const std::vector<const CFGEdge*>& edges =
+        split_chain().node_bundles()[i]->intra_chain_out_edges();
+    for (int j = 0;
+         j < edges.size() && get_sink_chain_index(*edges[j]) < *slice_pos_;
+         ++j) {
+      score_gain += get_score_gain(*edges[j], i, j);
     }
   }
   return score_gain;
@@ -137,6 +137,11 @@ class NodeChainAssembly {
     // Whether `NodeChainAssembly::BuildNodeChainAssembly` should return error
     // if the constructed assembly's score gain is zero.
     bool error_on_zero_score_gain = true;
+    // Optional result of `split_chain.ComputeIntraChainEdgeScores` for the
+    // current layout of `split_chain`. If provided, the original scores of the
+    // edges crossing `slice_pos` are read from it instead of being recomputed.
+    // The score gain is the same either way.
+    const NodeChain::IntraChainEdgeScores* split_chain_edge_scores = nullptr;
   };
 
   // Comparator for two NodeChainAssemblies. It compares score_gain and break
@@ -216,13 +221,16 @@ class NodeChainAssembly {
                              const PropellerCodeLayoutScorer& scorer,
                              NodeChain& split_chain, NodeChain& unsplit_chain,
                              ChainMergeOrder merge_order,
-                             std::optional<int> slice_pos)
+                             std::optional<int> slice_pos,
+                             const NodeChain::IntraChainEdgeScores*
+                                 split_chain_edge_scores)
       : chain_pair_{.split_chain = &split_chain,
                     .unsplit_chain = &unsplit_chain},
         merge_order_(merge_order),
         slice_pos_(slice_pos),
         slices_(ConstructSlices()),
-        score_gain_(ComputeScoreGain(bundle_mapper, scorer)) {}
+        score_gain_(
+            ComputeScoreGain(bundle_mapper, scorer, split_chain_edge_scores)) {}
 
   // Index of the unsplit_chain in the slices_ vector.
   int unsplit_chain_slice_index() const {
@@ -263,9 +271,12 @@ class NodeChainAssembly {
   std::vector<NodeChainSlice> ConstructSlices() const;
 
   // Returns the gain in Ext-TSP score if this assembly is applied. May return 0
-  // if the actual score gain is negative.
-  double ComputeScoreGain(const NodeToBundleMapper& bundle_mapper,
-                          const PropellerCodeLayoutScorer& scorer) const;
+  // if the actual score gain is negative. `split_chain_edge_scores` is passed
+  // to `ComputeSplitChainScoreGain`.
+  double ComputeScoreGain(
+      const NodeToBundleMapper& bundle_mapper,
+      const PropellerCodeLayoutScorer& scorer,
+      const NodeChain::IntraChainEdgeScores* split_chain_edge_scores) const;
 
   // Returns the total score contribution of edges running from `from_chain` to
   // `to_chain` for this assembly.
@@ -279,10 +290,13 @@ class NodeChainAssembly {
   // `ComputeInterChainScore(scorer, chain, chain)` since it only computes the
   // delta in score from edges which run between different slices of
   // `split_chain()` (i.e., their source-to-sink distance has changed by
-  // splitting).
+  // splitting). If `split_chain_edge_scores` is not null, the original score
+  // of these edges is read from it rather than recomputed. The same scores are
+  // summed in the same order either way, so the result is identical.
   double ComputeSplitChainScoreGain(
       const NodeToBundleMapper& bundle_mapper,
-      const PropellerCodeLayoutScorer& scorer) const;
+      const PropellerCodeLayoutScorer& scorer,
+      const NodeChain::IntraChainEdgeScores* split_chain_edge_scores) const;
 
   // Returns the score contribution of a single edge for this assembly.
   double ComputeEdgeScore(const NodeToBundleMapper& bundle_mapper,
@@ -14,8 +14,12 @@
 
 #include "propeller/node_chain_builder.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
 #include <memory>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -26,7 +30,10 @@
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/status/statusor.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
+#include "llvm/Support/Parallel.h"
 #include "propeller/cfg.h"
 #include "propeller/cfg_edge.h"
 #include "propeller/cfg_id.h"
@@ -74,13 +81,17 @@ NodeChainBuilder NodeChainBuilder::CreateNodeChainBuilder(
     const std::vector<const ControlFlowGraph*>& cfgs,
     const absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>&
         initial_chains,
-    PropellerStats::CodeLayoutStats& stats) {
+    PropellerStats::CodeLayoutStats& stats, absl::Time deadline) {
+  std::unique_ptr<NodeChainAssemblyQueue> node_chain_assemblies;
+  // The queue for `NodeChainAssemblyQueue` is created in `InitChainAssemblies`.
+  if constexpr (!std::is_same_v<AssemblyQueueImpl, NodeChainAssemblyQueue>)
+    node_chain_assemblies = std::make_unique<AssemblyQueueImpl>();
   return NodeChainBuilder(scorer, cfgs,
                           GetInitialChainsForCfgs(cfgs, initial_chains), stats,
-                          std::make_unique<AssemblyQueueImpl>());
+                          std::move(node_chain_assemblies), deadline);
 }
 
-// Explicit instantiation of CreateNodeChainBuilder for both AssemblyQueueImpl
+// Explicit instantiation of CreateNodeChainBuilder for all AssemblyQueueImpl
 // types.
 template NodeChainBuilder
 NodeChainBuilder::CreateNodeChainBuilder<NodeChainAssemblyIterativeQueue>(
@@ -88,7 +99,7 @@ NodeChainBuilder::CreateNodeChainBuilder<NodeChainAssemblyIterativeQueue>(
     const std::vector<const ControlFlowGraph*>& cfgs,
     const absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>&
         initial_chains,
-    PropellerStats::CodeLayoutStats& stats);
+    PropellerStats::CodeLayoutStats& stats, absl::Time deadline);
 
 template NodeChainBuilder
 NodeChainBuilder::CreateNodeChainBuilder<NodeChainAssemblyBalancedTreeQueue>(
@@ -96,11 +107,38 @@ NodeChainBuilder::CreateNodeChainBuilder<NodeChainAssemblyBalancedTreeQueue>(
     const std::vector<const ControlFlowGraph*>& cfgs,
     const absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>&
         initial_chains,
-    PropellerStats::CodeLayoutStats& stats);
+    PropellerStats::CodeLayoutStats& stats, absl::Time deadline);
+template NodeChainBuilder
+NodeChainBuilder::CreateNodeChainBuilder<NodeChainAssemblyHeapQueue>(
+    const PropellerCodeLayoutScorer& scorer,
+    const std::vector<const ControlFlowGraph*>& cfgs,
+    const absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>&
+        initial_chains,
+    PropellerStats::CodeLayoutStats& stats, absl::Time deadline);
+template NodeChainBuilder
+NodeChainBuilder::CreateNodeChainBuilder<NodeChainAssemblyQueue>(
+    const PropellerCodeLayoutScorer& scorer,
+    const std::vector<const ControlFlowGraph*>& cfgs,
+    const absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>&
+        initial_chains,
+    PropellerStats::CodeLayoutStats& stats, absl::Time deadline);
+
+std::unique_ptr<NodeChainAssemblyQueue> CreateNodeChainAssemblyQueue(
+    int num_chains) {
+  // Minimum number of chains for which the heap queue is used.
+  constexpr int kMinChainsForHeapQueue = 256;
+  if (num_chains >= kMinChainsForHeapQueue)
+    return std::make_unique<NodeChainAssemblyHeapQueue>();
+  return std::make_unique<NodeChainAssemblyIterativeQueue>();
+}
 
 using NodeChainAssemblyComparator =
     NodeChainAssembly::NodeChainAssemblyComparator;
 
+// Minimum number of candidate splitting assemblies for a pair of chains to be
+// scored in parallel when `parallel_chain_split_scoring` is enabled.
+constexpr int kMinCandidatesForParallelScoring = 256;
+
 absl::btree_map<const CFGNode*, const CFGNode*, CFGNodePtrComparator>
 GetForcedEdges(const ControlFlowGraph& cfg) {
   // Each node can participate in a forced edge at most one time as the source
@@ -259,7 +297,8 @@ void NodeChainBuilder::InitNodeChains() {
         cfg->n_landing_pads() > 1 && has_hot_landing_pads) {
       auto chains = CreateNodeChainBuilder(
                         code_layout_scorer_, {cfg},
-                        {{cfg->function_index(), cfg_initial_chains}}, stats_)
+                        {{cfg->function_index(), cfg_initial_chains}}, stats_,
+                        deadline_)
                         .BuildChains();
       for (const std::unique_ptr<NodeChain>& chain : chains) {
         std::vector<const CFGNode*> chain_nodes;
@@ -339,14 +378,23 @@ void NodeChainBuilder::InitNodeChains() {
 
 // This function groups nodes in chains to maximize ExtTSP score and returns the
 // constructed chains. After this returns, chains_ becomes empty.
-std::vector<std::unique_ptr<NodeChain>> NodeChainBuilder::BuildChains() {
+std::vector<std::unique_ptr<NodeChain>> NodeChainBuilder::BuildChains(
+    absl::Time start_time) {
+  if (uint32_t budget_ms =
+          code_layout_scorer_.code_layout_params()
+              .function_layout_time_budget_ms();
+      budget_ms != 0) {
+    deadline_ =
+        std::min(deadline_, start_time + absl::Milliseconds(budget_ms));
+  }
   InitNodeChains();
   InitChainEdges();
   InitChainAssemblies();
-  // Keep merging chains together until no more score gain can be achieved.
-  while (!node_chain_assemblies_->empty()) {
+  // Keep merging chains together until no more score gain can be achieved or
+  // the time budget is exhausted.
+  while (!node_chain_assemblies_->empty() && !ReachedDeadline())
     MergeChains(node_chain_assemblies_->GetBestAssembly());
-  }
+  if (reached_deadline_) ++stats_.n_chain_builds_over_budget;
 
   // Merge all chains into a if we only have a single cfg.
   if (cfgs_.size() == 1) CoalesceChains();
@@ -365,7 +413,12 @@ void NodeChainBuilder::UpdateNodeChainAssembly(NodeChain& split_chain,
           *node_to_bundle_mapper_, code_layout_scorer_, split_chain,
           unsplit_chain, {.merge_order = ChainMergeOrder::kSU});
 
-  if (code_layout_scorer_.code_layout_params().chain_split()) {
+  if (code_layout_scorer_.code_layout_params().chain_split() &&
+      split_chain.node_bundles().size() > 1) {
+    // The original scores of `split_chain`'s intra-chain edges are shared by
+    // all splitting assemblies with any `unsplit_chain`.
+    const NodeChain::IntraChainEdgeScores& split_chain_edge_scores =
+        GetIntraChainEdgeScores(split_chain);
     auto compare_and_update_best_assembly =
         [&](absl::StatusOr<NodeChainAssembly> assembly) {
           if (!assembly.ok()) return;
@@ -379,18 +432,38 @@ void NodeChainBuilder::UpdateNodeChainAssembly(NodeChain& split_chain,
     // does not exceed the splitting threshold.
     if (split_chain.node_bundles().size() <=
         code_layout_scorer_.code_layout_params().chain_split_threshold()) {
-      for (ChainMergeOrder merge_order :
-           {ChainMergeOrder::kS1US2, ChainMergeOrder::kS2S1U,
-            ChainMergeOrder::kUS2S1, ChainMergeOrder::kS2US1}) {
-        for (int slice_pos = 1; slice_pos != split_chain.node_bundles().size();
-             ++slice_pos) {
-          // Create the NodeChainAssembly representing this particular assembly.
-          compare_and_update_best_assembly(
-              NodeChainAssembly::BuildNodeChainAssembly(
-                  *node_to_bundle_mapper_, code_layout_scorer_, split_chain,
-                  unsplit_chain,
-                  {.merge_order = merge_order, .slice_pos = slice_pos}));
-        }
+      constexpr ChainMergeOrder kSplitMergeOrders[] = {
+          ChainMergeOrder::kS1US2, ChainMergeOrder::kS2S1U,
+          ChainMergeOrder::kUS2S1, ChainMergeOrder::kS2US1};
+      const int n_slice_positions = split_chain.node_bundles().size() - 1;
+      const int n_candidates =
+          std::size(kSplitMergeOrders) * n_slice_positions;
+      // Create the NodeChainAssembly representing the `i`th candidate
+      // assembly.
+      auto build_candidate_assembly = [&](int i) {
+        return NodeChainAssembly::BuildNodeChainAssembly(
+            *node_to_bundle_mapper_, code_layout_scorer_, split_chain,
+            unsplit_chain,
+            {.merge_order = kSplitMergeOrders[i / n_slice_positions],
+             .slice_pos = i % n_slice_positions + 1,
+             .split_chain_edge_scores = &split_chain_edge_scores});
+      };
+      if (code_layout_scorer_.code_layout_params()
+              .parallel_chain_split_scoring() &&
+          n_candidates >= kMinCandidatesForParallelScoring) {
+        // Building assemblies only reads the chains, so candidates can be
+        // scored in parallel. They are then compared in the same order as in
+        // the sequential case.
+        std::vector<absl::StatusOr<NodeChainAssembly>> candidate_assemblies(
+            n_candidates);
+        llvm::parallelFor(0, n_candidates, [&](size_t i) {
+          candidate_assemblies[i] = build_candidate_assembly(i);
+        });
+        for (absl::StatusOr<NodeChainAssembly>& assembly : candidate_assemblies)
+          compare_and_update_best_assembly(std::move(assembly));
+      } else {
+        for (int i = 0; i != n_candidates; ++i)
+          compare_and_update_best_assembly(build_candidate_assembly(i));
       }
     } else {
       // If split_chain is larger than the threshold, try finding splitting
@@ -406,7 +479,9 @@ void NodeChainBuilder::UpdateNodeChainAssembly(NodeChain& split_chain,
                   NodeChainAssembly::BuildNodeChainAssembly(
                       *node_to_bundle_mapper_, code_layout_scorer_, split_chain,
                       unsplit_chain,
-                      {.merge_order = merge_order, .slice_pos = slice_pos}));
+                      {.merge_order = merge_order,
+                       .slice_pos = slice_pos,
+                       .split_chain_edge_scores = &split_chain_edge_scores}));
             }
           };
 
@@ -444,9 +519,22 @@ void NodeChainBuilder::UpdateNodeChainAssembly(NodeChain& split_chain,
   }
 }
 
+const NodeChain::IntraChainEdgeScores&
+NodeChainBuilder::GetIntraChainEdgeScores(const NodeChain& chain) {
+  auto [it, inserted] = intra_chain_edge_scores_.try_emplace(&chain);
+  if (inserted) {
+    it->second = chain.ComputeIntraChainEdgeScores(*node_to_bundle_mapper_,
+                                                   code_layout_scorer_);
+  }
+  return it->second;
+}
+
 // Initializes the chain assemblies (merging candidates) across all the chains.
 void NodeChainBuilder::InitChainAssemblies() {
+  if (node_chain_assemblies_ == nullptr)
+    node_chain_assemblies_ = CreateNodeChainAssemblyQueue(chains_.size());
   for (auto& [unused, chain_ptr] : chains_) {
+    if (ReachedDeadline()) return;
     NodeChain* chain = chain_ptr.get();
     chain->VisitEachCandidateChain([&](NodeChain* other_chain) {
       // `UpdateNodeChainAssembly(*other_chain, *chain)` is invoked when
@@ -480,8 +568,11 @@ void NodeChainBuilder::MergeChains(NodeChainAssembly assembly) {
 }
 
 void NodeChainBuilder::InitChainEdges() {
-  // Set up the outgoing edges for every chain
+  // Set up the outgoing edges for every chain. Chains with partial edges are
+  // still valid for coalescing, since both ends of every added edge are
+  // recorded.
   for (auto& [unused, chain_ptr] : chains_) {
+    if (ReachedDeadline()) return;
     NodeChain* chain = chain_ptr.get();
     chain->VisitEachNodeRef([&](const CFGNode& n) {
       n.ForEachOutEdgeRef([&](const CFGEdge& edge) {
@@ -518,6 +609,10 @@ void NodeChainBuilder::InitChainEdges() {
 
 void NodeChainBuilder::UpdateAssembliesAfterMerge(NodeChain& kept_chain,
                                                   NodeChain& defunct_chain) {
+  // Both chains have changed, so their split position scores are stale.
+  intra_chain_edge_scores_.erase(&kept_chain);
+  intra_chain_edge_scores_.erase(&defunct_chain);
+
   // Remove all assemblies associated with defunct_chain.
   defunct_chain.VisitEachCandidateChain([&](NodeChain* other_chain) {
     node_chain_assemblies_->RemoveAssembly(
@@ -530,7 +625,9 @@ void NodeChainBuilder::UpdateAssembliesAfterMerge(NodeChain& kept_chain,
   chains_.erase(defunct_chain.id());
 
   // Update assemblies associated with split_chain as their score may have
-  // changed by the merge.
+  // changed by the merge. Once the deadline is reached, assemblies are no
+  // longer used, so rescoring them would be wasted work.
+  if (reached_deadline_) return;
   kept_chain.VisitEachCandidateChain([&](NodeChain* other_chain) {
     UpdateNodeChainAssembly(kept_chain, *other_chain);
     UpdateNodeChainAssembly(*other_chain, kept_chain);
@@ -24,7 +24,10 @@
 #include "absl/algorithm/container.h"
 #include "absl/container/btree_map.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/log/check.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "propeller/cfg.h"
 #include "propeller/cfg_edge.h"
 #include "propeller/cfg_id.h"
@@ -147,6 +150,107 @@ class NodeChainAssemblyIterativeQueue : public NodeChainAssemblyQueue {
   absl::flat_hash_map<NodeChainPair, NodeChainAssembly> assemblies_;
 };
 
+// Indexed binary-heap implementation of `NodeChainAssemblyQueue`.
+// `GetBestAssembly` has constant time complexity.
+// `RemoveAssembly` and `InsertAssembly` have logarithmic time complexity.
+// Unlike `NodeChainAssemblyBalancedTreeQueue`, assemblies are stored
+// contiguously, and replacing the assembly of a `NodeChain` pair updates it in
+// place (increasing or decreasing its key) instead of reallocating it.
+class NodeChainAssemblyHeapQueue : public NodeChainAssemblyQueue {
+ public:
+  bool empty() const override { return heap_.empty(); }
+
+  NodeChainAssembly GetBestAssembly() const override { return heap_.front(); }
+
+  void RemoveAssembly(NodeChainPair chain_pair) override {
+    auto it = positions_.find(chain_pair);
+    if (it == positions_.end()) return;
+    int pos = it->second;
+    positions_.erase(it);
+    if (pos == heap_.size() - 1) {
+      heap_.pop_back();
+      return;
+    }
+    heap_[pos] = std::move(heap_.back());
+    heap_.pop_back();
+    positions_[heap_[pos].chain_pair()] = pos;
+    RestoreHeapAt(pos);
+  }
+
+  void InsertAssembly(NodeChainAssembly assembly) override {
+    auto [it, inserted] =
+        positions_.try_emplace(assembly.chain_pair(), heap_.size());
+    if (inserted) {
+      heap_.push_back(std::move(assembly));
+      SiftUp(heap_.size() - 1);
+      return;
+    }
+    heap_[it->second] = std::move(assembly);
+    RestoreHeapAt(it->second);
+  }
+
+ private:
+  // Returns whether the assembly at `lhs_pos` is worse than the one at
+  // `rhs_pos`.
+  bool IsWorse(int lhs_pos, int rhs_pos) const {
+    return NodeChainAssembly::NodeChainAssemblyComparator()(heap_[lhs_pos],
+                                                            heap_[rhs_pos]);
+  }
+
+  // Swaps the assemblies at `pos1` and `pos2` and updates their positions.
+  void Swap(int pos1, int pos2) {
+    std::swap(heap_[pos1], heap_[pos2]);
+    positions_[heap_[pos1].chain_pair()] = pos1;
+    positions_[heap_[pos2].chain_pair()] = pos2;
+  }
+
+  // Moves the assembly at `pos` up until its parent is better than it.
+  void SiftUp(int pos) {
+    while (pos != 0 && IsWorse((pos - 1) / 2, pos)) {
+      Swap((pos - 1) / 2, pos);
+      pos = (pos - 1) / 2;
+    }
+  }
+
+  // Moves the assembly at `pos` down until it is better than its children.
+  void SiftDown(int pos) {
+    while (true) {
+      int best_pos = pos;
+      for (int child_pos : {2 * pos + 1, 2 * pos + 2}) {
+        if (child_pos < heap_.size() && IsWorse(best_pos, child_pos))
+          best_pos = child_pos;
+      }
+      if (best_pos == pos) return;
+      Swap(pos, best_pos);
+      pos = best_pos;
+    }
+  }
+
+  // Restores the heap property after the assembly at `pos` has changed.
+  void RestoreHeapAt(int pos) {
+    if (pos != 0 && IsWorse((pos - 1) / 2, pos)) {
+      SiftUp(pos);
+    } else {
+      SiftDown(pos);
+    }
+  }
+
+  // Max-heap of all `NodeChainAssembly` records, ordered by
+  // `NodeChainAssemblyComparator`.
+  std::vector<NodeChainAssembly> heap_;
+
+  // Map from each `NodeChain` pair to the position of its associated
+  // `NodeChainAssembly` record in `heap_`.
+  absl::flat_hash_map<NodeChainPair, int> positions_;
+};
+
+// Returns the `NodeChainAssemblyQueue` implementation to use for building
+// `num_chains` chains when the implementation is selected automatically. The
+// linear-time `GetBestAssembly` of `NodeChainAssemblyIterativeQueue` is cheaper
+// for few chains, while `NodeChainAssemblyHeapQueue` scales to many chains.
+std::unique_ptr<NodeChainAssemblyQueue> CreateNodeChainAssemblyQueue(
+    int num_chains);
+
 // TODO(b/159842094): Make NodeChainBuilder exception-block aware.
 // This class builds BB chains for one or multiple CFGs.
 class NodeChainBuilder {
@@ -154,14 +258,20 @@ class NodeChainBuilder {
   // Creates and returns a `NodeChainBuilder` for the given `cfgs` with initial
   // chains specified by `initial_chains` (as a map from function indexes to
   // their initial chains given by vectors of bb indexes), code layout scorer
-  // `scorer`, and code layout statistics handle `stats`.
+  // `scorer`, and code layout statistics handle `stats`. Chains are no longer
+  // merged after `deadline`, or after `function_layout_time_budget_ms` from the
+  // start of `BuildChains` (whichever comes first). If `AssemblyQueueImpl`
+  // is `NodeChainAssemblyQueue` itself, the implementation is selected by
+  // `CreateNodeChainAssemblyQueue` based on the number of initial chains when
+  // `InitChainAssemblies` is called.
   template <class AssemblyQueueImpl = NodeChainAssemblyIterativeQueue>
   static NodeChainBuilder CreateNodeChainBuilder(
       const PropellerCodeLayoutScorer& scorer,
       const std::vector<const ControlFlowGraph*>& cfgs,
       const absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>&
           initial_chains,
-      PropellerStats::CodeLayoutStats& stats);
+      PropellerStats::CodeLayoutStats& stats,
+      absl::Time deadline = absl::InfiniteFuture());
 
   const NodeToBundleMapper& node_to_bundle_mapper() const {
     return *node_to_bundle_mapper_;
@@ -187,7 +297,9 @@ class NodeChainBuilder {
   // This function initializes the chains and then iteratively constructs larger
   // chains by merging the best chains, to achieve the highest score.
   // Clients of this class must use this function after calling the constructor.
-  std::vector<std::unique_ptr<NodeChain>> BuildChains();
+  // `function_layout_time_budget_ms` is measured from `start_time`.
+  std::vector<std::unique_ptr<NodeChain>> BuildChains(
+      absl::Time start_time = absl::Now());
 
   // function and they are public for testing only. Clients must use the
   // BuildChains function instead.
@@ -195,11 +307,15 @@ class NodeChainBuilder {
   // Initializes the basic block chains and bundles from nodes of the CFGs.
   void InitNodeChains();
 
-  // Initializes the edges between chains from edges of the CFGs.
+  // Initializes the edges between chains from edges of the CFGs. If the
+  // deadline is reached, the edges of the remaining chains are not added.
   void InitChainEdges();
 
   // Initializes the chain assemblies, which are all profitable ways of merging
   // chains together, with their scores.
+  // Selects the assembly queue implementation first if it must be selected
+  // automatically. If the deadline is reached, the assemblies of the remaining
+  // chains are not added.
   void InitChainAssemblies();
 
   // Coalesces all the built chains together to form a single chain.
@@ -223,14 +339,22 @@ class NodeChainBuilder {
       absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>
           initial_chains,
       PropellerStats::CodeLayoutStats& stats,
-      std::unique_ptr<NodeChainAssemblyQueue> node_chain_assemblies)
+      std::unique_ptr<NodeChainAssemblyQueue> node_chain_assemblies,
+      absl::Time deadline)
       : code_layout_scorer_(scorer),
         cfgs_(cfgs),
+        function_indices_([&cfgs] {
+          absl::flat_hash_set<int> function_indices;
+          for (const ControlFlowGraph* cfg : cfgs)
+            function_indices.insert(cfg->function_index());
+          return function_indices;
+        }()),
         node_to_bundle_mapper_(
             NodeToBundleMapper::CreateNodeToBundleMapper(cfgs)),
         initial_chains_(std::move(initial_chains)),
         stats_(stats),
-        node_chain_assemblies_(std::move(node_chain_assemblies)) {
+        node_chain_assemblies_(std::move(node_chain_assemblies)),
+        deadline_(deadline) {
     // Accept only one CFG for intra-function-ordering.
     if (!code_layout_scorer_.code_layout_params().inter_function_reordering())
       CHECK_EQ(cfgs_.size(), 1);
@@ -261,13 +385,35 @@ class NodeChainBuilder {
   void UpdateNodeChainAssembly(NodeChain& split_chain,
                                NodeChain& unsplit_chain);
 
+  // Returns `chain.ComputeIntraChainEdgeScores` for the current layout of
+  // `chain`, computing it only if `chain` has changed since the last call.
+  const NodeChain::IntraChainEdgeScores& GetIntraChainEdgeScores(
+      const NodeChain& chain);
+
+  // Returns whether `deadline_` has passed. Once this returns true, it keeps
+  // returning true without reading the clock.
+  bool ReachedDeadline() {
+    if (!reached_deadline_ && deadline_ != absl::InfiniteFuture() &&
+        absl::Now() >= deadline_) {
+      reached_deadline_ = true;
+    }
+    return reached_deadline_;
+  }
+
   // Returns whether `edge` should be considered in constructing the chains.
+  // Edges are only considered when both their source and sink are in `cfgs_`,
+  // so edges into other communities or into reused layouts are ignored. Call
+  // edges are further only considered with inter-function reordering.
   bool ShouldVisitEdge(const CFGEdge& edge) {
-    return edge.weight() != 0 && !edge.IsReturn() &&
-           ((code_layout_scorer_.code_layout_params()
-                 .inter_function_reordering() &&
-             cfgs_.size() > 1 && !edge.inter_section()) ||
-            !edge.IsCall());
+    if (edge.weight() == 0 || edge.IsReturn()) return false;
+    if (!function_indices_.contains(edge.src()->function_index()) ||
+        !function_indices_.contains(edge.sink()->function_index())) {
+      return false;
+    }
+    if (!edge.IsCall()) return true;
+    return code_layout_scorer_.code_layout_params()
+               .inter_function_reordering() &&
+           cfgs_.size() > 1 && !edge.inter_section();
   }
 
   const PropellerCodeLayoutScorer code_layout_scorer_;
@@ -275,6 +421,9 @@ class NodeChainBuilder {
   // CFGs targeted for BB chaining.
   const std::vector<const ControlFlowGraph*> cfgs_;
 
+  // Function indices of `cfgs_`.
+  const absl::flat_hash_set<int> function_indices_;
+
   std::unique_ptr<NodeToBundleMapper> node_to_bundle_mapper_;
 
   // Initial node chains, specified as a map from every function index to the
@@ -292,6 +441,19 @@ class NodeChainBuilder {
   // Assembly (merge) candidates. This maps every pair of chains to its
   // (non-zero) merge score.
   std::unique_ptr<NodeChainAssemblyQueue> node_chain_assemblies_;
+
+  // Cached results of `NodeChain::ComputeIntraChainEdgeScores` for chains
+  // which have been considered for splitting. The entries for both chains of a
+  // merge are invalidated when they are merged.
+  absl::flat_hash_map<const NodeChain*, NodeChain::IntraChainEdgeScores>
+      intra_chain_edge_scores_;
+
+  // Deadline after which no more chains are merged. `BuildChains` moves it
+  // earlier to apply `function_layout_time_budget_ms`.
+  absl::Time deadline_;
+
+  // Whether `deadline_` has been reached.
+  bool reached_deadline_ = false;
 };
 
 // Returns vectors of nodes which form forced-fallthrough paths. These are
@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstddef>
 #include <memory>
 #include <optional>
 #include <utility>
@@ -29,6 +30,7 @@
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "llvm/Support/Parallel.h"
 #include "propeller/bb_handle.h"
 #include "propeller/cfg.h"
 #include "propeller/cfg_edge_kind.h"
@@ -303,9 +305,13 @@ absl::StatusOr<EvaluatedPathCloning> EvaluateCloning(
         absl::StrCat("Cloning is not acceptable with score gain: ", score_gain,
                      " < ", min_score));
   }
+  std::optional<FunctionLayoutInfo> layout_info;
+  if (path_profile_options.incremental_cloning_relayout())
+    layout_info = std::move(clone_layout_info);
   return EvaluatedPathCloning{.path_cloning = std::move(path_cloning),
                               .score = score_gain,
-                              .cfg_change = std::move(new_cfg_change)};
+                              .cfg_change = std::move(new_cfg_change),
+                              .layout_info = std::move(layout_info)};
 }
 
 void PathTreeCloneEvaluator::EvaluateCloningsForSubtree(
@@ -387,6 +393,9 @@ void PathTreeCloneEvaluator::EvaluateCloningsForPath(
         path_profile_options_.min_initial_cloning_score(), optimal_layout_info_,
         function_path_profile);
     if (!evaluated_cloning.ok()) continue;
+    // The layout is only useful when the cloning is applied, and the CFG may
+    // change before then. So don't keep it for every candidate.
+    evaluated_cloning->layout_info.reset();
     clonings.push_back(std::move(*std::move(evaluated_cloning)));
   }
 }
@@ -399,11 +408,23 @@ absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>> EvaluateAllClonings(
   CHECK(!code_layout_params.call_chain_clustering());
   CHECK(!code_layout_params.inter_function_reordering());
   LOG(INFO) << "Evaluating clonings...";
-  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
-      cloning_scores_by_function_index;
+  std::vector<const FunctionPathProfile*> function_path_profiles;
+  function_path_profiles.reserve(
+      program_path_profile->path_profiles_by_function_index().size());
   for (const auto& [function_index, function_path_profile] :
        program_path_profile->path_profiles_by_function_index()) {
-    const ControlFlowGraph* cfg = program_cfg->GetCfgByIndex(function_index);
+    function_path_profiles.push_back(&function_path_profile);
+  }
+  // Functions are evaluated independently in parallel, each into its own
+  // vector of clonings. `CodeLayout::GenerateLayout` runs sequentially inside
+  // each task since nested parallel regions are not parallelized.
+  std::vector<std::vector<EvaluatedPathCloning>> clonings_by_position(
+      function_path_profiles.size());
+  llvm::parallelFor(0, function_path_profiles.size(), [&](size_t i) {
+    const FunctionPathProfile& function_path_profile =
+        *function_path_profiles[i];
+    const ControlFlowGraph* cfg =
+        program_cfg->GetCfgByIndex(function_path_profile.function_index());
     CHECK_NE(cfg, nullptr);
     FunctionLayoutInfo fast_response_original_optimal_layout_info =
         CodeLayout(code_layout_params, {cfg},
@@ -411,14 +432,22 @@ absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>> EvaluateAllClonings(
             .GenerateLayout()
             .layouts_by_function_index.begin()
             ->second;
-    auto& clonings = cloning_scores_by_function_index[function_index];
     for (const auto& [root_bb_index, path_tree] :
          function_path_profile.path_trees_by_root_bb_index()) {
       PathTreeCloneEvaluator(cfg, &fast_response_original_optimal_layout_info,
                              &path_profile_options, &code_layout_params)
           .EvaluateCloningsForSubtree(*path_tree, /*path_length=*/1, {},
-                                      clonings, function_path_profile);
+                                      clonings_by_position[i],
+                                      function_path_profile);
     }
+  });
+  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
+      cloning_scores_by_function_index;
+  cloning_scores_by_function_index.reserve(function_path_profiles.size());
+  for (size_t i = 0; i < function_path_profiles.size(); ++i) {
+    cloning_scores_by_function_index.emplace(
+        function_path_profiles[i]->function_index(),
+        std::move(clonings_by_position[i]));
   }
   return cloning_scores_by_function_index;
 }
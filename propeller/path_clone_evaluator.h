@@ -155,6 +155,9 @@ struct EvaluatedPathCloning {
   std::optional<double> score;
   // The CFG change resulting from applying `path_cloning`.
   CfgChangeFromPathCloning cfg_change;
+  // Layout of the function with `path_cloning` applied, computed during the
+  // evaluation. Only set when `incremental_cloning_relayout` is enabled.
+  std::optional<FunctionLayoutInfo> layout_info;
 
   bool operator==(const EvaluatedPathCloning& other) const {
     return score == other.score && path_cloning == other.path_cloning;
@@ -202,7 +205,8 @@ absl::StatusOr<EvaluatedPathCloning> EvaluateCloning(
 // Evaluates and returns all applicable and profitable clonings in
 // `program_path_profile` with `code_layout_params` and `path_profile_options`.
 // Returns these clonings in a map keyed by the function index of the associated
-// CFG.
+// CFG. Functions are evaluated in parallel; the clonings of every function are
+// in the same order as when evaluated sequentially.
 absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>> EvaluateAllClonings(
     const ProgramCfg* program_cfg,
     const ProgramPathProfile* program_path_profile,
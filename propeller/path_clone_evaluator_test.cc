@@ -520,9 +520,7 @@ TEST(PathCloneEvaluator, GetsInitialChains) {
                        .at(6)
                        .path_trees_by_root_bb_index()
                        .at(3)
-                       ->children()
-                       .at(5)
-                       .get(),
+                       ->GetChild(5),
       .function_index = 6,
       .path_pred_bb_index = 1};
   ASSERT_OK_AND_ASSIGN(
@@ -637,8 +635,7 @@ TEST(EvaluateOneCloning, RejectsNonProfitableCloning) {
       .path_node = path_profile.path_profiles_by_function_index()
                        .at(6)
                        .path_trees_by_root_bb_index()
-                       .at(4)
-                       .get(),
+                       .at(4),
       .function_index = 6,
       .path_pred_bb_index = 2};
 
@@ -16,8 +16,8 @@
 #define PROPELLER_PATH_NODE_H_
 
 #include <cstdint>
+#include <deque>
 #include <iterator>
-#include <memory>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -55,6 +55,14 @@ struct PathPredInfoEntry {
   // frequency of returns into it.
   absl::flat_hash_map<propeller::FlatBbHandle, int64_t> return_to_freqs;
 
+  // Returns an estimate of the heap memory (in bytes) held by this entry.
+  int64_t GetHeapMemoryUsage() const {
+    return call_freqs.capacity() *
+               (sizeof(decltype(call_freqs)::value_type) + 1) +
+           return_to_freqs.capacity() *
+               (sizeof(decltype(return_to_freqs)::value_type) + 1);
+  }
+
   // Implementation of the `AbslStringify` interface.
   template <typename Sink>
   friend void AbslStringify(Sink& sink, const PathPredInfoEntry& e);
@@ -114,6 +122,16 @@ struct PathPredInfo {
     return &it->second;
   }
 
+  // Returns an estimate of the heap memory (in bytes) held by this info.
+  int64_t GetHeapMemoryUsage() const {
+    int64_t result = entries.capacity() *
+                         (sizeof(decltype(entries)::value_type) + 1) +
+                     missing_pred_entry.GetHeapMemoryUsage();
+    for (const auto& [unused, entry] : entries)
+      result += entry.GetHeapMemoryUsage();
+    return result;
+  }
+
   // Implementation of the `AbslStringify` interface.
   template <typename Sink>
   friend void AbslStringify(Sink& sink, const PathPredInfo& p);
@@ -174,30 +192,19 @@ struct ProgramPathProfileArg {
 // every possible path predecessor block (`freqs_by_path_pred`). It also stores
 // the frequency of every call from the corresponding ending block, given every
 // possible path predecessor block (`callee_freqs_by_path_pred`).
+// Path nodes are owned by the arena of their `FunctionPathProfile`, which is
+// also the only way to create them.
 class PathNode {
  public:
-  PathNode(int bb_index, const PathNode* parent)
+  // Children of a path node, paired with their flat bb index and sorted by it.
+  using Children = std::vector<std::pair<int, PathNode*>>;
+
+  PathNode(int bb_index,
+           ABSL_ATTRIBUTE_LIFETIME_BOUND const PathNode* absl_nullable parent)
       : node_bb_index_(bb_index),
         parent_(parent),
         path_length_(parent == nullptr ? 2 : parent->path_length() + 1) {}
 
-  // Constructor for creating a path tree from `arg` as a child of `parent`.
-  // This will recursively construct the child path nodes and places them in
-  // `this->children_`. If `parent` is `nullptr`, this will be the root of the
-  // path tree.
-  explicit PathNode(
-      const PathNodeArg& arg,
-      ABSL_ATTRIBUTE_LIFETIME_BOUND const PathNode* absl_nullable parent)
-      : node_bb_index_(arg.node_bb_index),
-        path_pred_info_(std::move(arg.path_pred_info)),
-        parent_(parent),
-        path_length_(parent == nullptr ? 2 : parent->path_length() + 1) {
-    for (const auto& [child_bb_index, child_arg] : arg.children_args) {
-      auto child = std::make_unique<PathNode>(child_arg, this);
-      children_.emplace(child->node_bb_index_, std::move(child));
-    }
-  }
-
   PathNode(const PathNode&) = delete;
   PathNode& operator=(const PathNode&) = delete;
   PathNode(PathNode&&) = default;
@@ -211,19 +218,13 @@ class PathNode {
 
   PathPredInfo& mutable_path_pred_info() { return path_pred_info_; }
 
-  const absl::flat_hash_map<int, std::unique_ptr<PathNode>>& children() const {
-    return children_;
-  }
+  const Children& children() const { return children_; }
 
   const PathNode* parent() const { return parent_; }
   const PathNode* root() const {
     return parent_ == nullptr ? this : parent_->root();
   }
 
-  absl::flat_hash_map<int, std::unique_ptr<PathNode>>& mutable_children() {
-    return children_;
-  }
-
   // Returns the path to this path node, from the root of its tree.
   std::vector<const PathNode*> path_from_root() const {
     std::vector<const PathNode*> result;
@@ -264,9 +265,9 @@ class PathNode {
   // Returns the child path node with the given flat bb index `child_bb_index`,
   // or `nullptr` if the child is not found.
   const PathNode* GetChild(int child_bb_index) const {
-    auto it = children_.find(child_bb_index);
-    if (it == children_.end()) return nullptr;
-    return it->second.get();
+    auto it = FindChild(child_bb_index);
+    if (it == children_.end() || it->first != child_bb_index) return nullptr;
+    return it->second;
   }
 
   // Implementation of the `AbslStringify` interface for logging the subtree
@@ -275,13 +276,24 @@ class PathNode {
   friend void AbslStringify(Sink& sink, const PathNode& path_node);
 
  private:
+  friend class FunctionPathProfile;
+
+  // Returns the position of the child with flat bb index `child_bb_index` in
+  // `children_`, or the position where it should be inserted.
+  Children::const_iterator FindChild(int child_bb_index) const {
+    return absl::c_lower_bound(
+        children_, child_bb_index,
+        [](const auto& child, int bb_index) { return child.first < bb_index; });
+  }
+
   // Flat bb index of the basic block associated with this path node.
   int node_bb_index_;
   // Frequency information for each path predecessor block. Keyed by the flat bb
   // index of each path predecessor block.
   PathPredInfo path_pred_info_;
-  // Children of this path node.
-  absl::flat_hash_map<int, std::unique_ptr<PathNode>> children_ = {};
+  // Children of this path node. Most path nodes have very few children, so a
+  // small sorted vector is both smaller and faster to search than a hash map.
+  Children children_ = {};
   // Parent path node of this tree (`nullptr` for root).
   const PathNode* parent_ = nullptr;
   // Length (number of basic blocks) of the paths represented by this path node
@@ -376,14 +388,14 @@ class FunctionPathProfile {
       : function_index_(arg.function_index) {
     path_trees_by_root_bb_index_.reserve(arg.path_node_args.size());
     for (const auto& [bb_index, path_node_arg] : arg.path_node_args) {
-      path_trees_by_root_bb_index_.emplace(
-          path_node_arg.node_bb_index,
-          std::make_unique<PathNode>(path_node_arg, /*parent=*/nullptr));
+      InsertSubtree(path_node_arg,
+                    GetOrInsertPathTree(path_node_arg.node_bb_index));
     }
   }
 
-  // `path_trees_by_root_bb_index_` is a map to `std::unique_ptr`s. So
-  // `FunctionPathProfile` is a move-only object.
+  // Path nodes point to each other inside `path_node_arena_`, so
+  // `FunctionPathProfile` is a move-only object. Moving keeps the addresses of
+  // the path nodes.
   FunctionPathProfile(const FunctionPathProfile&) = delete;
   FunctionPathProfile& operator=(const FunctionPathProfile&) = delete;
   FunctionPathProfile(FunctionPathProfile&&) = default;
@@ -392,8 +404,8 @@ class FunctionPathProfile {
   int function_index() const { return function_index_; }
 
   // Returns the path trees keyed by the bb_index of their root.
-  const absl::flat_hash_map<int, std::unique_ptr<PathNode>>&
-  path_trees_by_root_bb_index() const {
+  const absl::flat_hash_map<int, PathNode*>& path_trees_by_root_bb_index()
+      const {
     return path_trees_by_root_bb_index_;
   }
 
@@ -403,14 +415,44 @@ class FunctionPathProfile {
     auto [it, inserted] =
         path_trees_by_root_bb_index_.try_emplace(bb_index, nullptr);
     if (inserted)
-      it->second = std::make_unique<PathNode>(bb_index, /*parent=*/nullptr);
+      it->second = &path_node_arena_.emplace_back(bb_index, /*parent=*/nullptr);
     return *it->second;
   }
 
   const PathNode* GetPathTree(int bb_index) const {
     auto it = path_trees_by_root_bb_index_.find(bb_index);
     if (it == path_trees_by_root_bb_index_.end()) return nullptr;
-    return it->second.get();
+    return it->second;
+  }
+
+  // Returns the child of `parent` associated with the block `bb_index`.
+  // Creates the child if it doesn't exist. `parent` must be a path node of this
+  // profile.
+  PathNode& GetOrInsertChild(PathNode& parent, int bb_index) {
+    auto it = parent.FindChild(bb_index);
+    if (it != parent.children_.end() && it->first == bb_index)
+      return *it->second;
+    PathNode& child = path_node_arena_.emplace_back(bb_index, &parent);
+    parent.children_.emplace(it, bb_index, &child);
+    return child;
+  }
+
+  // Returns the number of path nodes in all path trees of this function.
+  int64_t path_node_count() const { return path_node_arena_.size(); }
+
+  // Returns an estimate of the memory (in bytes) used by the path trees of
+  // this function.
+  int64_t GetMemoryUsage() const {
+    int64_t result =
+        path_trees_by_root_bb_index_.capacity() *
+        (sizeof(decltype(path_trees_by_root_bb_index_)::value_type) + 1);
+    for (const PathNode& path_node : path_node_arena_) {
+      result += sizeof(PathNode) +
+                path_node.children_.capacity() *
+                    sizeof(PathNode::Children::value_type) +
+                path_node.path_pred_info_.GetHeapMemoryUsage();
+    }
+    return result;
   }
 
   // Implementation of the `AbslStringify` interface for logging the function
@@ -419,11 +461,23 @@ class FunctionPathProfile {
   friend void AbslStringify(Sink& sink, const FunctionPathProfile& profile);
 
  private:
+  // Copies the path information of `arg` into `path_node` and recursively
+  // inserts the children of `arg` under `path_node`.
+  void InsertSubtree(const PathNodeArg& arg, PathNode& path_node) {
+    path_node.mutable_path_pred_info() = arg.path_pred_info;
+    for (const auto& [unused, child_arg] : arg.children_args) {
+      InsertSubtree(child_arg,
+                    GetOrInsertChild(path_node, child_arg.node_bb_index));
+    }
+  }
+
   // Index of the function.
   int function_index_;
+  // Storage for all path nodes of this function. `std::deque` allocates the
+  // nodes in contiguous blocks and never moves them once inserted.
+  std::deque<PathNode> path_node_arena_;
   // Path trees for this function keyed by the bb_index of their root.
-  absl::flat_hash_map<int, std::unique_ptr<PathNode>>
-      path_trees_by_root_bb_index_;
+  absl::flat_hash_map<int, PathNode*> path_trees_by_root_bb_index_;
 };
 
 template <typename Sink>
@@ -15,8 +15,6 @@
 #ifndef PROPELLER_PATH_NODE_MATCHERS_H_
 #define PROPELLER_PATH_NODE_MATCHERS_H_
 
-#include <memory>
-
 #include "absl/container/flat_hash_map.h"
 #include "gmock/gmock.h"
 #include "propeller/bb_handle.h"
@@ -92,9 +90,8 @@ MATCHER_P4(
         " path predecessor info that ",
         DescribeMatcher<PathPredInfo>(path_pred_info_matcher, negation),
         (negation ? " or doesn't have" : " and has"), " branches that ",
-        DescribeMatcher<
-            absl::flat_hash_map<int, std::unique_ptr<propeller::PathNode>>>(
-            children_matcher, negation),
+        DescribeMatcher<propeller::PathNode::Children>(children_matcher,
+                                                       negation),
         (negation ? " or doesn't have" : " and has"),
         " children whose parent points to this node")) {
   return ExplainMatchResult(node_bb_index_matcher, arg->node_bb_index(),
@@ -109,7 +106,7 @@ MATCHER_P4(
          // PathNode.
          ExplainMatchResult(
              Each(Pair(_, Pointee(Property("parent", &PathNode::parent,
-                                           Pointer(Eq(arg.get())))))),
+                                           Pointer(Eq(&*arg)))))),
              arg->children(), result_listener);
 }
 
@@ -121,8 +118,7 @@ MATCHER_P2(
         (negation ? " doesn't have" : " has"), " function index that ",
         DescribeMatcher<int>(function_index_matcher, negation),
         (negation ? " or doesn't have" : " and has"), " path length that ",
-        DescribeMatcher<
-            absl::flat_hash_map<int, std::unique_ptr<propeller::PathNode>>>(
+        DescribeMatcher<absl::flat_hash_map<int, propeller::PathNode*>>(
             path_trees_by_root_bb_index_matcher, negation))) {
   return ExplainMatchResult(function_index_matcher, arg.function_index(),
                             result_listener) &&
@@ -21,6 +21,7 @@
 #include "propeller/path_node.h"
 #include "propeller/path_profile_options.pb.h"
 #include "propeller/program_cfg.h"
+#include "propeller/propeller_statistics.h"
 
 namespace propeller {
 // Interface for aggregating path profiles.
@@ -28,11 +29,11 @@ class PathProfileAggregator {
  public:
   virtual ~PathProfileAggregator() = default;
 
-  // Returns the aggregated path profile.
+  // Returns the aggregated path profile. Updates `stats.path_profile_stats`.
   virtual absl::StatusOr<ProgramPathProfile> Aggregate(
       const BinaryContent& binary_content,
       const BinaryAddressMapper& binary_address_mapper,
-      const ProgramCfg& program_cfg) = 0;
+      const ProgramCfg& program_cfg, PropellerStats& stats) = 0;
 };
 
 }  // namespace propeller
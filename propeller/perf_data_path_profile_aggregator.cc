@@ -31,6 +31,7 @@
 #include "propeller/perfdata_reader.h"
 #include "propeller/program_cfg.h"
 #include "propeller/program_cfg_path_analyzer.h"
+#include "propeller/propeller_statistics.h"
 #include "propeller/resolve_mmap_name.h"
 #include "propeller/status_macros.h"  // Included for macros.
 
@@ -41,7 +42,7 @@ using ::propeller::ProgramPathProfile;
 absl::StatusOr<ProgramPathProfile> PerfDataPathProfileAggregator::Aggregate(
     const BinaryContent& binary_content,
     const BinaryAddressMapper& binary_address_mapper,
-    const ProgramCfg& program_cfg) {
+    const ProgramCfg& program_cfg, PropellerStats& stats) {
   ProgramPathProfile program_path_profile;
   ProgramCfgPathAnalyzer path_analyzer(
       &propeller_options_.path_profile_options(), &program_cfg,
@@ -61,9 +62,13 @@ absl::StatusOr<ProgramPathProfile> PerfDataPathProfileAggregator::Aggregate(
       continue;
     }
 
-    PerfDataPathReader(&*perf_data_reader, &binary_address_mapper)
-        .ReadPathsAndApplyCallBack(absl::bind_front(
-            &ProgramCfgPathAnalyzer::StoreAndAnalyzePaths, &path_analyzer));
+    PerfDataPathReader path_reader(&*perf_data_reader, &binary_address_mapper);
+    path_reader.ReadPathsAndApplyCallBack(absl::bind_front(
+        &ProgramCfgPathAnalyzer::StoreAndAnalyzePaths, &path_analyzer));
+    stats.path_profile_stats.samples_read += path_reader.samples_read();
+    stats.path_profile_stats.paths_extracted += path_reader.paths_extracted();
+    stats.path_profile_stats.path_buffer_allocations +=
+        path_reader.path_buffer_allocations();
     // Analyze the remaining paths.
     path_analyzer.AnalyzePaths(/*paths_to_analyze=*/std::nullopt);
   }
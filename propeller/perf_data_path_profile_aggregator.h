@@ -27,6 +27,7 @@
 #include "propeller/path_profile_options.pb.h"
 #include "propeller/perf_data_provider.h"
 #include "propeller/program_cfg.h"
+#include "propeller/propeller_statistics.h"
 #include "propeller/propeller_options.pb.h"
 namespace propeller {
 
@@ -50,7 +51,7 @@ class PerfDataPathProfileAggregator : public PathProfileAggregator {
   absl::StatusOr<propeller::ProgramPathProfile> Aggregate(
       const BinaryContent& binary_content,
       const BinaryAddressMapper& binary_address_mapper,
-      const ProgramCfg& program_cfg) override;
+      const ProgramCfg& program_cfg, PropellerStats& stats) override;
 
  private:
   const PropellerOptions& propeller_options_;
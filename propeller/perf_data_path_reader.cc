@@ -15,7 +15,6 @@
 #include "propeller/perf_data_path_reader.h"
 
 #include <cstdint>
-#include <vector>
 
 #include "absl/functional/function_ref.h"
 #include "absl/time/time.h"
@@ -29,25 +28,31 @@ namespace propeller {
 void PerfDataPathReader::ReadPathsAndApplyCallBack(
     absl::FunctionRef<void(absl::Span<const FlatBbHandleBranchPath>)>
         handle_paths_callback) {
-  std::vector<FlatBbHandleBranchPath> result;
   perf_data_reader_->ReadWithSampleCallBack(
       [&](const quipper::PerfDataProto_SampleEvent& event) {
-        std::vector<FlatBbHandleBranchPath> paths;
-        BinaryAddressBranchPath lbr_path(
-            {.pid = event.pid(),
-             .sample_time = absl::FromUnixNanos(event.sample_time_ns())});
         const auto& branch_stack = event.branch_stack();
         if (branch_stack.empty()) return;
+        ++samples_read_;
+        lbr_path_.pid = event.pid();
+        lbr_path_.sample_time = absl::FromUnixNanos(event.sample_time_ns());
+        lbr_path_.branches.clear();
+        if (lbr_path_.branches.capacity() < branch_stack.size()) {
+          lbr_path_.branches.reserve(branch_stack.size());
+          ++lbr_path_allocations_;
+        }
         for (int p = branch_stack.size() - 1; p >= 0; --p) {
           const auto& branch_entry = branch_stack.Get(p);
           uint64_t from = perf_data_reader_->RuntimeAddressToBinaryAddress(
               event.pid(), branch_entry.from_ip());
           uint64_t to = perf_data_reader_->RuntimeAddressToBinaryAddress(
               event.pid(), branch_entry.to_ip());
-          lbr_path.branches.push_back({.from = from, .to = to});
+          lbr_path_.branches.push_back({.from = from, .to = to});
         }
-        handle_paths_callback(
-            address_mapper_->ExtractIntraFunctionPaths(lbr_path));
+        absl::Span<const FlatBbHandleBranchPath> paths =
+            address_mapper_->ExtractIntraFunctionPaths(lbr_path_,
+                                                       path_buffer_);
+        paths_extracted_ += paths.size();
+        handle_paths_callback(paths);
       });
 }
 }  // namespace propeller
@@ -15,8 +15,11 @@
 #ifndef PROPELLER_PERF_DATA_PATH_READER_H_
 #define PROPELLER_PERF_DATA_PATH_READER_H_
 
+#include <cstdint>
+
 #include "absl/functional/function_ref.h"
 #include "absl/types/span.h"
+#include "propeller/binary_address_branch_path.h"
 #include "propeller/binary_address_mapper.h"
 #include "propeller/perfdata_reader.h"
 
@@ -39,13 +42,35 @@ class PerfDataPathReader {
 
   // Reads intra-function paths from every LBR sample event and calls
   // `handle_paths_callback` on the set of paths captured from each sample.
+  // The paths passed to `handle_paths_callback` are only valid during the
+  // call, as their storage is recycled for the next sample.
   void ReadPathsAndApplyCallBack(
       absl::FunctionRef<void(absl::Span<const FlatBbHandleBranchPath>)>
           handle_paths_callback);
 
+  // Returns the number of LBR samples read so far.
+  int64_t samples_read() const { return samples_read_; }
+
+  // Returns the number of intra-function paths extracted so far.
+  int64_t paths_extracted() const { return paths_extracted_; }
+
+  // Returns the number of times the recycled path storage had to allocate.
+  int64_t path_buffer_allocations() const {
+    return path_buffer_.allocations() + lbr_path_allocations_;
+  }
+
  private:
   const PerfDataReader* perf_data_reader_;
   const BinaryAddressMapper* address_mapper_;
+  // Storage for the binary-address path of the current sample, reused across
+  // samples.
+  BinaryAddressBranchPath lbr_path_;
+  // Storage for the intra-function paths of the current sample, reused across
+  // samples.
+  IntraFunctionPathBuffer path_buffer_;
+  int64_t samples_read_ = 0;
+  int64_t paths_extracted_ = 0;
+  int64_t lbr_path_allocations_ = 0;
 };
 }  // namespace propeller
 #endif  // PROPELLER_PERF_DATA_PATH_READER_H_
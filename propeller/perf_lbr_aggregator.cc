@@ -14,22 +14,17 @@
 
 #include "propeller/perf_lbr_aggregator.h"
 
-#include <cstdint>
 #include <memory>
 #include <optional>
 #include <string>
 #include <utility>
 
-#include "absl/container/flat_hash_map.h"
 #include "absl/log/log.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
-#include "absl/strings/str_format.h"
-#include "llvm/MC/MCInst.h"
-#include "propeller/binary_address_branch.h"
 #include "propeller/binary_content.h"
+#include "propeller/lbr_address_checker.h"
 #include "propeller/lbr_aggregation.h"
-#include "propeller/mini_disassembler.h"
 #include "propeller/perf_data_provider.h"
 #include "propeller/perfdata_reader.h"
 #include "propeller/propeller_options.pb.h"
@@ -75,46 +70,9 @@ absl::StatusOr<LbrAggregation> PerfLbrAggregator::AggregateLbrData(
   }
 
   ASSIGN_OR_RETURN(stats.disassembly_stats,
-                   CheckLbrAddress(lbr_aggregation, binary_content));
+                   CheckLbrAddress(lbr_aggregation, binary_content,
+                                   options.lbr_address_check_budget()));
   return lbr_aggregation;
 }
 
-absl::StatusOr<PropellerStats::DisassemblyStats>
-PerfLbrAggregator::CheckLbrAddress(const LbrAggregation& lbr_aggregation,
-                                   const BinaryContent& binary_content) {
-  PropellerStats::DisassemblyStats result = {};
-
-  ASSIGN_OR_RETURN(std::unique_ptr<MiniDisassembler> disassembler,
-                   MiniDisassembler::Create(binary_content.object_file.get()));
-
-  absl::flat_hash_map<int64_t, int64_t> counter_sum_by_source_address;
-  for (const auto& [branch, counter] : lbr_aggregation.branch_counters) {
-    if (branch.from == kInvalidBinaryAddress) continue;
-    counter_sum_by_source_address[branch.from] += counter;
-  }
-
-  for (const auto& [address, counter] : counter_sum_by_source_address) {
-    absl::StatusOr<llvm::MCInst> inst = disassembler->DisassembleOne(address);
-    if (!inst.ok()) {
-      result.could_not_disassemble.Increment(counter);
-      LOG(WARNING) << absl::StrFormat(
-          "not able to disassemble address: 0x%x with counter sum %d", address,
-          counter);
-      continue;
-    }
-    if (!disassembler->MayAffectControlFlow(*inst)) {
-      result.cant_affect_control_flow.Increment(counter);
-      LOG(WARNING) << absl::StrFormat(
-          "not a potentially-control-flow-affecting "
-          "instruction at address: "
-          "0x%x with counter sum %d, instruction name: %s",
-          address, counter, disassembler->GetInstructionName(*inst));
-    } else {
-      result.may_affect_control_flow.Increment(counter);
-    }
-  }
-
-  return result;
-}
-
 }  // namespace propeller
@@ -48,12 +48,6 @@ class PerfLbrAggregator : public LbrAggregator {
       PropellerStats& stats) override;
 
  private:
-  // Checks that AggregatedLBR's source addresses are really branch, jmp, call
-  // or return instructions and returns the resulting statistics.
-  absl::StatusOr<PropellerStats::DisassemblyStats> CheckLbrAddress(
-      const LbrAggregation& lbr_aggregation,
-      const BinaryContent& binary_content);
-
   absl_nonnull std::unique_ptr<PerfDataProvider> perf_data_provider_;
 };
 
@@ -15,6 +15,8 @@
 #include "propeller/profile_computer.h"
 
 #include <cstdint>
+#include <functional>
+#include <future>
 #include <memory>
 #include <optional>
 #include <string>
@@ -50,6 +52,7 @@
 #include "propeller/file_perf_data_provider.h"
 #include "propeller/function_layout_info.h"
 #include "propeller/function_prefetch_info.h"
+#include "propeller/incremental_layout.h"
 #include "propeller/lbr_branch_aggregator.h"
 #include "propeller/path_node.h"
 #include "propeller/path_profile_aggregator.h"
@@ -173,10 +176,24 @@ absl::StatusOr<PropellerProfile> PropellerProfileComputer::ComputeProfile() && {
         *program_path_profile_, std::move(program_cfg_), stats_.cloning_stats);
   }
 
+  // Reuse the previous layouts of the functions whose profile has not changed
+  // significantly since the previous cluster profile.
+  absl::flat_hash_map<int, std::vector<FunctionLayoutInfo::BbChain>>
+      reused_layouts;
+  if (!options_.previous_cluster_profile_path().empty()) {
+    ASSIGN_OR_RETURN(
+        PreviousClusterProfile previous_cluster_profile,
+        ReadPreviousClusterProfile(options_.previous_cluster_profile_path()));
+    reused_layouts = GetReusableLayouts(
+        *program_cfg_, previous_cluster_profile,
+        options_.code_layout_params().reuse_layout_max_edge_distance(),
+        options_.code_layout_params().inter_function_reordering());
+  }
+
   absl::btree_map<llvm::StringRef, SectionLayoutInfo>
-      layout_info_by_section_name =
-          GenerateLayoutBySection(*program_cfg_, options_.code_layout_params(),
-                                  stats_.code_layout_stats);
+      layout_info_by_section_name = GenerateLayoutBySection(
+          *program_cfg_, options_.code_layout_params(),
+          stats_.code_layout_stats, reused_layouts);
 
   absl::flat_hash_map<int, FunctionPrefetchInfo> function_prefetch_infos =
       GeneratePrefetchByFunctionIndex(*program_cfg_, *binary_address_mapper_,
@@ -259,7 +276,8 @@ PropellerProfileComputer::Create(
 }
 
 // "InitializeProgramProfile" steps:
-//   1. Calls branch_aggregator_->GetBranchEndpointAddresses().
+//   1. Calls branch_aggregator_->GetBranchEndpointAddresses(), while reading
+//      the binary's symbols and BB address map concurrently.
 //   2. Initializes `binary_address_mapper_`.
 //   3. Calls branch_aggregator_->Aggregate() to get `branch_aggregation`.
 //   4. ProgramCfgBuilder::Build to initialize `program_cfg_`.
@@ -267,6 +285,12 @@ PropellerProfileComputer::Create(
 //   ConvertPerfDataToPathProfile to
 //      initialize `program_path_profile_`.
 absl::Status PropellerProfileComputer::InitializeProgramProfile() {
+  // Reading the binary's symbols and BB address map needs nothing from the
+  // profile, so it is overlapped with perf data reading below.
+  std::future<absl::StatusOr<BinaryAddressMapperInputs>>
+      binary_address_mapper_inputs =
+          std::async(std::launch::async, ReadBinaryAddressMapperInputs,
+                     std::cref(*binary_content_));
   absl::flat_hash_set<uint64_t> unique_addresses;
   if (branch_aggregator_ != nullptr) {
     ASSIGN_OR_RETURN(unique_addresses,
@@ -282,8 +306,10 @@ absl::Status PropellerProfileComputer::InitializeProgramProfile() {
     }
   }
 
+  ASSIGN_OR_RETURN(BinaryAddressMapperInputs inputs,
+                   binary_address_mapper_inputs.get());
   ASSIGN_OR_RETURN(binary_address_mapper_,
-                   BuildBinaryAddressMapper(options_, *binary_content_, stats_,
+                   BuildBinaryAddressMapper(options_, std::move(inputs), stats_,
                                             &unique_addresses));
 
   BranchAggregation branch_aggregation;
@@ -295,7 +321,9 @@ absl::Status PropellerProfileComputer::InitializeProgramProfile() {
   std::unique_ptr<Addr2Cu> addr2cu;
   if (options_.output_module_name()) {
     if (binary_content_->dwarf_context != nullptr) {
-      addr2cu = std::make_unique<Addr2Cu>(*binary_content_->dwarf_context);
+      addr2cu = std::make_unique<Addr2Cu>(
+          *binary_content_->dwarf_context,
+          /*parallel=*/binary_content_->thread_safe_dwarf_context);
     } else {
       return absl::FailedPreconditionError(absl::StrFormat(
           "no DWARFContext is available for '%s'. Either because it does not "
@@ -310,8 +338,9 @@ absl::Status PropellerProfileComputer::InitializeProgramProfile() {
   if (path_profile_aggregator_ != nullptr) {
     ASSIGN_OR_RETURN(
         program_path_profile_,
-        path_profile_aggregator_->Aggregate(
-            *binary_content_, *binary_address_mapper_, *program_cfg_));
+        path_profile_aggregator_->Aggregate(*binary_content_,
+                                            *binary_address_mapper_,
+                                            *program_cfg_, stats_));
   }
   return absl::OkStatus();
 }
@@ -176,7 +176,9 @@ absl::Status GeneratePropellerProfiles(const PropellerOptions& opts) {
   ASSIGN_OR_RETURN(std::optional<ProfileType> profile_type,
                    GetBranchProfileType(opts));
   ASSIGN_OR_RETURN(std::unique_ptr<BinaryContent> binary_content,
-                   GetBinaryContent(opts.binary_name()));
+                   GetBinaryContent(opts.binary_name(),
+                                    /*thread_safe_dwarf_context=*/
+                                    opts.output_module_name()));
   std::unique_ptr<BranchAggregator> branch_aggregator;
   std::unique_ptr<PathProfileAggregator> path_profile_aggregator;
   if (profile_type.has_value()) {
@@ -196,7 +198,9 @@ absl::Status GeneratePropellerProfiles(
     std::unique_ptr<PerfDataProvider> perf_data_provider,
     ProfileType profile_type) {
   ASSIGN_OR_RETURN(std::unique_ptr<BinaryContent> binary_content,
-                   GetBinaryContent(opts.binary_name()));
+                   GetBinaryContent(opts.binary_name(),
+                                    /*thread_safe_dwarf_context=*/
+                                    opts.output_module_name()));
   ASSIGN_OR_RETURN(std::unique_ptr<BranchAggregator> branch_aggregator,
                    CreateBranchAggregator(profile_type, opts, *binary_content,
                                           std::move(perf_data_provider)));
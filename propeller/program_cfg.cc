@@ -15,7 +15,9 @@
 #include "propeller/program_cfg.h"
 
 #include <cstdint>
+#include <memory>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 #include "absl/algorithm/container.h"
@@ -27,24 +29,29 @@
 
 namespace propeller {
 
-std::vector<const ControlFlowGraph*> ProgramCfg::GetCfgs() const {
-  std::vector<const ControlFlowGraph*> cfgs;
-  cfgs.reserve(cfgs_.size());
-  for (const auto& [function_index, cfg] : cfgs_) cfgs.push_back(cfg.get());
-  absl::c_sort(cfgs, [](const ControlFlowGraph* a, const ControlFlowGraph* b) {
+ProgramCfg::ProgramCfg(
+    absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs) {
+  cfgs_.reserve(cfgs.size());
+  for (auto& [function_index, cfg] : cfgs) {
+    CHECK_GE(function_index, 0);
+    CHECK_EQ(function_index, cfg->function_index());
+    cfgs_.push_back(std::move(cfg));
+  }
+  absl::c_sort(cfgs_, [](const std::unique_ptr<ControlFlowGraph>& a,
+                         const std::unique_ptr<ControlFlowGraph>& b) {
     return a->function_index() < b->function_index();
   });
-  return cfgs;
-}
-
-absl::flat_hash_map<llvm::StringRef, std::vector<const ControlFlowGraph*>>
-ProgramCfg::GetCfgsBySectionName() const {
-  absl::flat_hash_map<llvm::StringRef, std::vector<const ControlFlowGraph*>>
-      result;
-  for (const auto& [function_index, cfg] : cfgs_) {
-    result[cfg->section_name()].push_back(cfg.get());
+  cfg_ptrs_.reserve(cfgs_.size());
+  if (!cfgs_.empty()) {
+    cfg_position_by_function_index_.assign(
+        cfgs_.back()->function_index() + 1, -1);
+  }
+  for (int i = 0; i < cfgs_.size(); ++i) {
+    const ControlFlowGraph* cfg = cfgs_[i].get();
+    cfg_ptrs_.push_back(cfg);
+    cfg_position_by_function_index_[cfg->function_index()] = i;
+    cfgs_by_section_name_[cfg->section_name()].push_back(cfg);
   }
-  return result;
 }
 
 int64_t ProgramCfg::GetNodeFrequencyThreshold(
@@ -57,8 +64,8 @@ int64_t ProgramCfg::GetNodeFrequencyThreshold(
     int64_t frequency;
   };
   absl::flat_hash_map<int, std::vector<int64_t>> node_frequencies;
-  for (const auto& [function_index, cfg] : cfgs_) {
-    node_frequencies.emplace(function_index, cfg->GetNodeFrequencies());
+  for (const ControlFlowGraph* cfg : cfg_ptrs_) {
+    node_frequencies.emplace(cfg->function_index(), cfg->GetNodeFrequencies());
   }
   std::vector<NodeFrequencyInfo> hot_nodes;
   for (const auto& [function_index, frequencies] : node_frequencies) {
@@ -90,12 +97,12 @@ absl::flat_hash_map<int, absl::btree_set<int>> ProgramCfg::GetHotJoinNodes(
     int64_t hot_edge_frequency_threshold) const {
   absl::flat_hash_map<int, absl::btree_set<int>> hot_join_nodes;
 
-  for (const auto& [function_index, cfg] : cfgs_) {
+  for (const ControlFlowGraph* cfg : cfg_ptrs_) {
     std::vector<int> hot_join_bbs = cfg->GetHotJoinNodes(
         hot_node_frequency_threshold, hot_edge_frequency_threshold);
     if (hot_join_bbs.empty()) continue;
     hot_join_nodes.emplace(
-        function_index,
+        cfg->function_index(),
         absl::btree_set<int>(hot_join_bbs.begin(), hot_join_bbs.end()));
   }
   return hot_join_nodes;
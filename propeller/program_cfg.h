@@ -24,7 +24,7 @@
 #include "absl/container/btree_set.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/log/check.h"
-#include "absl/memory/memory.h"
+#include "absl/types/span.h"
 #include "llvm/ADT/StringRef.h"
 #include "propeller/cfg.h"
 
@@ -34,8 +34,7 @@ class ProgramCfg {
   // This class represents the whole-program control flow graph.
  public:
   explicit ProgramCfg(
-      absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs)
-      : cfgs_(std::move(cfgs)) {}
+      absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs);
 
   ProgramCfg(const ProgramCfg&) = delete;
   ProgramCfg& operator=(const ProgramCfg&) = delete;
@@ -45,8 +44,9 @@ class ProgramCfg {
   // Builds and returns a map of cfgs keyed by their function indexes.
   absl::flat_hash_map<int, const ControlFlowGraph*> cfgs_by_index() const {
     absl::flat_hash_map<int, const ControlFlowGraph*> result;
-    for (const auto& [function_index, cfg] : cfgs_) {
-      result.emplace(function_index, cfg.get());
+    result.reserve(cfg_ptrs_.size());
+    for (const ControlFlowGraph* cfg : cfg_ptrs_) {
+      result.emplace(cfg->function_index(), cfg);
     }
     return result;
   }
@@ -55,26 +55,35 @@ class ProgramCfg {
   absl::flat_hash_map<std::string, const ControlFlowGraph*> cfgs_by_name()
       const {
     absl::flat_hash_map<std::string, const ControlFlowGraph*> result;
-    for (const auto& [function_index, cfg] : cfgs_) {
-      CHECK(result.emplace(cfg->GetPrimaryName().str(), cfg.get()).second)
+    result.reserve(cfg_ptrs_.size());
+    for (const ControlFlowGraph* cfg : cfg_ptrs_) {
+      CHECK(result.emplace(cfg->GetPrimaryName().str(), cfg).second)
           << " Duplicate function name: " << cfg->GetPrimaryName().str();
     }
     return result;
   }
 
-  // Returns the CFGs in a vector, in increasing order of their function index.
-  std::vector<const ControlFlowGraph*> GetCfgs() const;
+  // Returns the CFGs in increasing order of their function index.
+  absl::Span<const ControlFlowGraph* const> GetCfgs() const {
+    return cfg_ptrs_;
+  }
 
-  // Returns a map from section names to the CFGs associated with them.
-  absl::flat_hash_map<llvm::StringRef, std::vector<const ControlFlowGraph*>>
-  GetCfgsBySectionName() const;
+  // Returns a map from section names to the CFGs associated with them. The
+  // CFGs of every section are in increasing order of their function index.
+  const absl::flat_hash_map<llvm::StringRef,
+                            std::vector<const ControlFlowGraph*>>&
+  GetCfgsBySectionName() const {
+    return cfgs_by_section_name_;
+  }
 
   // Returns the cfg with function_index `index` or `nullptr` if it does not
   // exist.
   const ControlFlowGraph* GetCfgByIndex(int index) const {
-    auto it = cfgs_.find(index);
-    if (it == cfgs_.end()) return nullptr;
-    return it->second.get();
+    if (index < 0 || index >= cfg_position_by_function_index_.size())
+      return nullptr;
+    int position = cfg_position_by_function_index_[index];
+    if (position == -1) return nullptr;
+    return cfg_ptrs_[position];
   }
 
   // Returns the `node_frequency_cutoff_percentile` frequency percentile among
@@ -94,17 +103,29 @@ class ProgramCfg {
   absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>>
   release_cfgs_by_index() && {
     absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> ret;
-    for (auto& [function_index, cfg] : cfgs_) {
-      ret.emplace(
-          function_index,
-          absl::WrapUnique(const_cast<ControlFlowGraph*>(cfg.release())));
+    ret.reserve(cfgs_.size());
+    for (std::unique_ptr<ControlFlowGraph>& cfg : cfgs_) {
+      int function_index = cfg->function_index();
+      ret.emplace(function_index, std::move(cfg));
     }
+    cfgs_.clear();
+    cfg_ptrs_.clear();
+    cfg_position_by_function_index_.clear();
+    cfgs_by_section_name_.clear();
     return ret;
   }
 
  private:
-  // Cfgs indexed by function index.
-  absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs_;
+  // Cfgs in increasing order of their function index.
+  std::vector<std::unique_ptr<ControlFlowGraph>> cfgs_;
+  // Pointers to the cfgs in `cfgs_`, in the same order.
+  std::vector<const ControlFlowGraph*> cfg_ptrs_;
+  // Position of every cfg in `cfgs_`, indexed by function index, or -1 if no
+  // cfg exists for the function index.
+  std::vector<int> cfg_position_by_function_index_;
+  // Cfgs grouped by their section name.
+  absl::flat_hash_map<llvm::StringRef, std::vector<const ControlFlowGraph*>>
+      cfgs_by_section_name_;
 };
 }  // namespace propeller
 
@@ -15,10 +15,10 @@
 #include "propeller/program_cfg_path_analyzer.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <iterator>
-#include <memory>
 #include <optional>
 #include <utility>
 #include <vector>
@@ -30,6 +30,7 @@
 #include "absl/log/check.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
+#include "llvm/Support/Parallel.h"
 #include "propeller/bb_handle.h"
 #include "propeller/binary_address_mapper.h"
 #include "propeller/cfg.h"
@@ -132,16 +133,8 @@ class CloningPathTraceHandler : public PathTraceHandler {
       if (!path_probe.AddToNodesInPath(flat_bb_index)) return false;
 
       // Insert a child path node associated with this block.
-      PathNode& child_path_node =
-          *path_probe.path_node()
-               ->mutable_children()
-               .lazy_emplace(flat_bb_index,
-                             [&](const auto& ctor) {
-                               ctor(flat_bb_index,
-                                    std::make_unique<PathNode>(
-                                        flat_bb_index, path_probe.path_node()));
-                             })
-               ->second;
+      PathNode& child_path_node = function_path_profile_->GetOrInsertChild(
+          *path_probe.path_node(), flat_bb_index);
 
       // Increment the frequency associated with the child path node.
       ++child_path_node.mutable_path_pred_info()
@@ -263,16 +256,8 @@ class CloningPathTraceHandler : public PathTraceHandler {
         // We don't need to check for loops here. Missing predecessor path
         // nodes for looping paths will be created, but they won't be considered
         // when applying the cloning since we only clone paths with no loops.
-        missing_pred_path_node_ =
-            missing_pred_path_node_->mutable_children()
-                .lazy_emplace(
-                    flat_bb_index,
-                    [&](const auto& ctor) {
-                      ctor(flat_bb_index,
-                           std::make_unique<PathNode>(flat_bb_index,
-                                                      missing_pred_path_node_));
-                    })
-                ->second.get();
+        missing_pred_path_node_ = &function_path_profile_->GetOrInsertChild(
+            *missing_pred_path_node_, flat_bb_index);
       }
     } else if (path_length_ == 0 && flat_bb_index != 0) {
       // If the path length is 0, we are at the very first block of the path.
@@ -313,10 +298,17 @@ class CloningPathTraceHandler : public PathTraceHandler {
 void ProgramCfgPathAnalyzer::AnalyzePaths(std::optional<int> paths_to_analyze) {
   int num_paths = paths_to_analyze.value_or(bb_branch_paths_.size());
   CHECK_LE(num_paths, bb_branch_paths_.size());
-  absl::c_stable_sort(bb_branch_paths_, [](const FlatBbHandleBranchPath& lhs,
-                                           const FlatBbHandleBranchPath& rhs) {
-    return lhs.sample_time < rhs.sample_time;
-  });
+  // The paths of every function, in the order of their sample time. Every path
+  // only updates the path info and path profile of its own function, so the
+  // paths of different functions can be traced independently.
+  struct FunctionPaths {
+    int function_index;
+    FunctionPathInfo* function_path_info = nullptr;
+    FunctionPathProfile* function_path_profile = nullptr;
+    std::vector<const FlatBbHandleBranchPath*> paths;
+  };
+  std::vector<FunctionPaths> paths_by_function;
+  absl::flat_hash_map<int, int> function_pos_by_index;
   for (int i = 0; i < num_paths; ++i) {
     const FlatBbHandleBranchPath& path = bb_branch_paths_[i];
     if (i != 0) CHECK_GE(path.sample_time, bb_branch_paths_[i - 1].sample_time);
@@ -325,19 +317,49 @@ void ProgramCfgPathAnalyzer::AnalyzePaths(std::optional<int> paths_to_analyze) {
         path.branches.front().from_bb.has_value()
             ? path.branches.front().from_bb->function_index
             : path.branches.front().to_bb->function_index;
+    auto [it, inserted] = function_pos_by_index.try_emplace(
+        path_function_index, paths_by_function.size());
+    if (inserted)
+      paths_by_function.push_back({.function_index = path_function_index});
+    paths_by_function[it->second].paths.push_back(&path);
+  }
+  // Create the state of all functions before tracing, since inserting into
+  // the maps invalidates the references to their elements.
+  for (const FunctionPaths& function_paths : paths_by_function) {
     const ControlFlowGraph* cfg =
-        program_cfg_->GetCfgByIndex(path_function_index);
+        program_cfg_->GetCfgByIndex(function_paths.function_index);
     CHECK_NE(cfg, nullptr);
-    FunctionPathInfo& function_path_info =
-        all_function_path_info_
-            .try_emplace(path_function_index, cfg->nodes().size())
-            .first->second;
-    CloningPathTraceHandler handler(
-        path_profile_options_, cfg, &hot_join_bbs_.at(path_function_index),
-        &function_path_info,
+    all_function_path_info_.try_emplace(function_paths.function_index,
+                                        cfg->nodes().size());
+    program_path_profile_->GetProfileForFunctionIndex(
+        function_paths.function_index);
+  }
+  for (FunctionPaths& function_paths : paths_by_function) {
+    function_paths.function_path_info =
+        &all_function_path_info_.at(function_paths.function_index);
+    function_paths.function_path_profile =
         &program_path_profile_->GetProfileForFunctionIndex(
-            path_function_index));
-    PathTracer(cfg, &handler).TracePath(path);
+            function_paths.function_index);
+  }
+
+  auto trace_function_paths = [&](size_t pos) {
+    const FunctionPaths& function_paths = paths_by_function[pos];
+    const ControlFlowGraph* cfg =
+        program_cfg_->GetCfgByIndex(function_paths.function_index);
+    for (const FlatBbHandleBranchPath* path : function_paths.paths) {
+      CloningPathTraceHandler handler(
+          path_profile_options_, cfg,
+          &hot_join_bbs_.at(function_paths.function_index),
+          function_paths.function_path_info,
+          function_paths.function_path_profile);
+      PathTracer(cfg, &handler).TracePath(*path);
+    }
+  };
+  if (path_profile_options_->parallel_path_tracing()) {
+    llvm::parallelFor(0, paths_by_function.size(), trace_function_paths);
+  } else {
+    for (size_t pos = 0; pos != paths_by_function.size(); ++pos)
+      trace_function_paths(pos);
   }
   bb_branch_paths_.erase(bb_branch_paths_.begin(),
                          bb_branch_paths_.begin() + num_paths);
@@ -345,7 +367,29 @@ void ProgramCfgPathAnalyzer::AnalyzePaths(std::optional<int> paths_to_analyze) {
 
 void ProgramCfgPathAnalyzer::StoreAndAnalyzePaths(
     absl::Span<const FlatBbHandleBranchPath> bb_branch_paths) {
+  auto by_sample_time = [](const FlatBbHandleBranchPath& lhs,
+                           const FlatBbHandleBranchPath& rhs) {
+    return lhs.sample_time < rhs.sample_time;
+  };
+  const int old_size = bb_branch_paths_.size();
   absl::c_move(bb_branch_paths, std::back_inserter(bb_branch_paths_));
+  // Keep `bb_branch_paths_` sorted by sample time. Samples arrive in nearly
+  // increasing time order, so the new paths are usually already sorted and
+  // only overlap with the last few stored paths. We sort the new paths and
+  // merge them with the stored paths they overlap with, rather than sorting
+  // the whole buffer. Both steps are stable, so paths with equal sample times
+  // keep their arrival order.
+  const auto new_paths_begin = bb_branch_paths_.begin() + old_size;
+  if (!std::is_sorted(new_paths_begin, bb_branch_paths_.end(),
+                      by_sample_time)) {
+    std::stable_sort(new_paths_begin, bb_branch_paths_.end(), by_sample_time);
+  }
+  if (new_paths_begin != bb_branch_paths_.end()) {
+    std::inplace_merge(
+        std::upper_bound(bb_branch_paths_.begin(), new_paths_begin,
+                         *new_paths_begin, by_sample_time),
+        new_paths_begin, bb_branch_paths_.end(), by_sample_time);
+  }
   if (!bb_branch_paths_.empty() &&
       bb_branch_paths_.back().sample_time -
               bb_branch_paths_.front().sample_time >
@@ -317,15 +317,16 @@ class ProgramCfgPathAnalyzer {
     return bb_branch_paths_;
   }
 
-  // Stores the paths in `bb_branch_paths` into `bb_branch_paths_`. If the
-  // sampled times in `bb_branch_paths_` roughly exceeds
+  // Stores the paths in `bb_branch_paths` into `bb_branch_paths_`, in the
+  // order of their sample_time. If the sampled times in `bb_branch_paths_`
+  // span more than
   // `path_profile_options_->max_time_diff_in_path_buffer_millis`, analyzes and
   // purges half of them by calling `ProgramCfgPathAnalyzer::AnalyzePaths`.
   void StoreAndAnalyzePaths(
       absl::Span<const propeller::FlatBbHandleBranchPath> bb_branch_paths);
 
-  // Sorts all paths in `bb_branch_paths_` based on their sample_time. Then
-  // analyzes and removes the first `paths_to_analyze` paths and updates
+  // Analyzes and removes the first `paths_to_analyze` paths in
+  // `bb_branch_paths_` (which are the earliest sampled) and updates
   // `program_path_profile_`. Each path tree represents many paths which share
   // their second block. The shared block corresponds to the root of this
   // tree. Every path node in the tree represents all the program paths
@@ -362,7 +363,7 @@ class ProgramCfgPathAnalyzer {
   // Hot join basic blocks, stored as a map from function indexes to the set of
   // basic block indices.
   absl::flat_hash_map<int, absl::btree_set<int>> hot_join_bbs_;
-  // Paths remaining to be analyzed.
+  // Paths remaining to be analyzed, sorted by their sample_time.
   std::deque<propeller::FlatBbHandleBranchPath> bb_branch_paths_;
   // Program path profile for all functions.
   propeller::ProgramPathProfile* program_path_profile_;
@@ -15,9 +15,11 @@
 #include "propeller/program_cfg_path_analyzer.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <iterator>
 #include <memory>
 #include <optional>
+#include <utility>
 #include <vector>
 
 #include "absl/algorithm/container.h"
@@ -143,8 +145,7 @@ TEST(PathTracer, TracePathUpdatesCachePressureWithShortPaths) {
           .at(5)
           .path_trees_by_root_bb_index()
           .at(2)
-          ->children()
-          .at(3)
+          ->GetChild(3)
           ->path_pred_info()
           .entries,
       UnorderedElementsAre(Pair(0, Field(&PathPredInfoEntry::cache_pressure,
@@ -225,6 +226,41 @@ TEST(PathTracer, TracePathUpdatesCachePressureWithUnsortedSampleTimes) {
                                          DoubleNear(2.84, kEpsilon)))));
 }
 
+TEST(ProgramCfgPathAnalyzer, StoresPathsInSampleTimeOrder) {
+  std::unique_ptr<ProgramCfg> program_cfg = BuildFromCfgArg(
+      {.cfg_args = {{".anysection",
+                     5,
+                     "foo",
+                     {{0x1000, 0, 0x10, {.CanFallThrough = true}},
+                      {0x1010, 1, 0x10, {.CanFallThrough = false}}},
+                     {{0, 1, 10, CFGEdgeKind::kBranchOrFallthough}}}}});
+  auto make_path = [](int64_t pid, int64_t sample_time_millis) {
+    return FlatBbHandleBranchPath{
+        .pid = pid,
+        .sample_time = absl::FromUnixMillis(sample_time_millis),
+        .branches = {{.from_bb = {{.function_index = 5, .flat_bb_index = 0}},
+                      .to_bb = {{.function_index = 5, .flat_bb_index = 1}}}}};
+  };
+  PathProfileOptions options;
+  options.set_hot_cutoff_percentile(10);
+  ProgramPathProfile path_profile;
+  ProgramCfgPathAnalyzer path_analyzer(&options, program_cfg.get(),
+                                       &path_profile);
+  path_analyzer.StoreAndAnalyzePaths(
+      {make_path(1, 100), make_path(2, 300), make_path(3, 500)});
+  // The second batch is unsorted, overlaps with the stored paths, and has a
+  // path with the same sample time as a stored one.
+  path_analyzer.StoreAndAnalyzePaths(
+      {make_path(4, 600), make_path(5, 300), make_path(6, 200)});
+  EXPECT_THAT(path_analyzer.bb_branch_paths(),
+              ElementsAre(Field(&FlatBbHandleBranchPath::pid, 1),
+                          Field(&FlatBbHandleBranchPath::pid, 6),
+                          Field(&FlatBbHandleBranchPath::pid, 2),
+                          Field(&FlatBbHandleBranchPath::pid, 5),
+                          Field(&FlatBbHandleBranchPath::pid, 3),
+                          Field(&FlatBbHandleBranchPath::pid, 4)));
+}
+
 TEST(PathTracer, TracePathVisitsBlocksAndCalls) {
   std::unique_ptr<ProgramCfg> program_cfg = BuildFromCfgArg(
       {.cfg_args = {
@@ -282,7 +318,11 @@ TEST(PathTracer, TracePathVisitsBlocksAndCalls) {
       .TracePath(path);
 }
 
-TEST(ProgramCfgPathAnalyzer, BuildPathTree) {
+// Parameterized by whether paths are traced in parallel, which must not change
+// the path profile.
+using PathTracingModeTest = testing::TestWithParam<bool>;
+
+TEST_P(PathTracingModeTest, BuildPathTree) {
   // A realistic example from go/propeller-path-cloning. Includes a function
   // with a loop, where the header is the hot join block. Also, the return block
   // calls either of two functions depending on the path.
@@ -368,6 +408,7 @@ TEST(ProgramCfgPathAnalyzer, BuildPathTree) {
 
   PathProfileOptions options;
   options.set_hot_cutoff_percentile(30);
+  options.set_parallel_path_tracing(GetParam());
   ProgramPathProfile path_profile;
   ProgramCfgPathAnalyzer path_analyzer(&options, program_cfg.get(),
                                        &path_profile);
@@ -468,6 +509,12 @@ TEST(ProgramCfgPathAnalyzer, BuildPathTree) {
                                                IsEmpty()))))))))))))));
 }
 
+INSTANTIATE_TEST_SUITE_P(ProgramCfgPathAnalyzer, PathTracingModeTest,
+                         testing::Bool(),
+                         [](const testing::TestParamInfo<bool>& param_info) {
+                           return param_info.param ? "Parallel" : "Sequential";
+                         });
+
 TEST(ProgramCfgPathAnalyzer, HandlesPathPredecessorWithIndirectBranch) {
   std::unique_ptr<ProgramCfg> program_cfg = BuildFromCfgArg(
       {.cfg_args = {{".anysection",
@@ -1016,5 +1063,23 @@ TEST(ProgramCfgPathAnalyzer,
                                                               IsEmpty())),
                                                    IsEmpty()))))))))))))))));
 }
+
+TEST(FunctionPathProfile, StoresChildrenSortedInArena) {
+  FunctionPathProfile function_path_profile(/*function_index=*/5);
+  PathNode& path_tree = function_path_profile.GetOrInsertPathTree(1);
+  for (int bb_index : {4, 2, 3, 2})
+    function_path_profile.GetOrInsertChild(path_tree, bb_index);
+  EXPECT_THAT(path_tree.children(), ElementsAre(Key(2), Key(3), Key(4)));
+  ASSERT_NE(path_tree.GetChild(3), nullptr);
+  EXPECT_EQ(path_tree.GetChild(3)->parent(), &path_tree);
+  EXPECT_EQ(path_tree.GetChild(5), nullptr);
+  EXPECT_EQ(function_path_profile.path_node_count(), 4);
+  EXPECT_GE(function_path_profile.GetMemoryUsage(),
+            static_cast<int64_t>(4 * sizeof(PathNode)));
+
+  // Moving the profile keeps the path nodes in place.
+  FunctionPathProfile moved_path_profile = std::move(function_path_profile);
+  EXPECT_EQ(moved_path_profile.GetPathTree(1), &path_tree);
+}
 }  // namespace
 }  // namespace propeller
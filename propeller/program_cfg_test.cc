@@ -35,6 +35,8 @@ using ::testing::Gt;
 using ::testing::IsEmpty;
 using ::testing::Not;
 using ::testing::Pair;
+using ::testing::Pointee;
+using ::testing::Property;
 using ::testing::SizeIs;
 using ::testing::UnorderedElementsAre;
 
@@ -119,5 +121,29 @@ TEST(ProgramCfg, GetHotJoinNodes) {
       program_cfg->GetHotJoinNodes(30, 10),
       UnorderedElementsAre(Pair(0, ElementsAre(1)), Pair(1, ElementsAre(2))));
 }
+
+TEST(ProgramCfg, IndexesCfgsByFunctionIndexAndSection) {
+  std::unique_ptr<ProgramCfg> program_cfg = BuildFromCfgArg(
+      {.cfg_args = {{".foo_section", 5, "foo", {{0x1000, 0, 0x10}}, {}},
+                    {".bar_section", 2, "bar", {{0x2000, 0, 0x10}}, {}},
+                    {".foo_section", 0, "baz", {{0x3000, 0, 0x10}}, {}}}});
+  EXPECT_THAT(program_cfg->GetCfgs(),
+              ElementsAre(Pointee(Property(&ControlFlowGraph::function_index,
+                                           0)),
+                          Pointee(Property(&ControlFlowGraph::function_index,
+                                           2)),
+                          Pointee(Property(&ControlFlowGraph::function_index,
+                                           5))));
+  EXPECT_EQ(program_cfg->GetCfgByIndex(2)->GetPrimaryName(), "bar");
+  EXPECT_EQ(program_cfg->GetCfgByIndex(1), nullptr);
+  EXPECT_EQ(program_cfg->GetCfgByIndex(6), nullptr);
+  EXPECT_EQ(program_cfg->GetCfgByIndex(-1), nullptr);
+  EXPECT_THAT(
+      program_cfg->GetCfgsBySectionName(),
+      UnorderedElementsAre(
+          Pair(".foo_section", ElementsAre(program_cfg->GetCfgByIndex(0),
+                                           program_cfg->GetCfgByIndex(5))),
+          Pair(".bar_section", ElementsAre(program_cfg->GetCfgByIndex(2)))));
+}
 }  // namespace
 }  // namespace propeller
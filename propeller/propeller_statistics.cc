@@ -47,6 +47,17 @@ std::string PropellerStats::CodeLayoutStats::DebugString() const {
        absl::StrCat("Initial chains stats: single-node chains: [",
                     n_single_node_chains, "] multi-node chains: [",
                     n_multi_node_chains, "]"),
+       absl::StrCat("Layout time budget exceeded: chain builds: [",
+                    n_chain_builds_over_budget, "] cluster builds: [",
+                    n_cluster_builds_over_budget, "]"),
+       absl::StrCat("Hot pages: before packing: [", n_hot_pages_before_packing,
+                    "] after packing: [", n_hot_pages_after_packing, "]"),
+       absl::StrFormat(
+           "Reused function layouts: %d/%d (%.1f%%)",
+           n_reused_function_layouts, n_hot_functions,
+           n_hot_functions == 0
+               ? 0.0
+               : 100.0 * n_reused_function_layouts / n_hot_functions),
        absl::StrFormat(
            "Changed inter-function (ext-tsp) score by %+.1f%% from %f to %f.",
            inter_score_percent_change, original_inter_score,
@@ -148,7 +159,20 @@ std::string PropellerStats::CloningStats::DebugString() const {
        absl::StrCat("Added ", bbs_cloned, " cloned basic blocks."),
        absl::StrCat("Increased code size by ", bytes_cloned,
                     " bytes with cloning."),
-       absl::StrCat("Gained ", score_gain, " in cloning score.")},
+       absl::StrCat("Gained ", score_gain, " in cloning score."),
+       absl::StrCat("Dropped ", clonings_over_budget,
+                    " clonings over the code size budget."),
+       absl::StrCat("Built ", path_nodes, " path nodes using ",
+                    path_profile_bytes, " bytes.")},
+      "\n");
+}
+
+std::string PropellerStats::PathProfileStats::DebugString() const {
+  return absl::StrJoin(
+      {absl::StrCat("Read ", samples_read, " LBR samples for path profiling."),
+       absl::StrCat("Extracted ", paths_extracted, " intra-function paths."),
+       absl::StrCat("Allocated ", path_buffer_allocations,
+                    " times in path buffers.")},
       "\n");
 }
 
@@ -156,7 +180,8 @@ std::string PropellerStats::DebugString() const {
   std::vector<std::string> stat_lines = {
       profile_stats.DebugString(),     bbaddrmap_stats.DebugString(),
       cfg_stats.DebugString(),         code_layout_stats.DebugString(),
-      disassembly_stats.DebugString(), cloning_stats.DebugString()};
+      disassembly_stats.DebugString(), cloning_stats.DebugString(),
+      path_profile_stats.DebugString()};
   return absl::StrJoin(stat_lines, "\n");
 }
 }  // namespace propeller
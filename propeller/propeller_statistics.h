@@ -41,6 +41,21 @@ struct PropellerStats {
     int n_single_node_chains = 0;
     // Number of initial multi-node chains.
     int n_multi_node_chains = 0;
+    // Number of chain builds (one per function, or one per section with
+    // inter-function reordering) which stopped merging chains early because
+    // the layout time budget was exhausted.
+    int n_chain_builds_over_budget = 0;
+    // Number of sections whose chain clustering was cut short because the
+    // global layout time budget was exhausted.
+    int n_cluster_builds_over_budget = 0;
+    // Estimated number of hot pages before and after `pack_hot_pages` packs
+    // the clusters of every section into pages.
+    int n_hot_pages_before_packing = 0;
+    int n_hot_pages_after_packing = 0;
+    // Number of hot functions, and the number of those whose layout was reused
+    // from the previous cluster profile.
+    int n_hot_functions = 0;
+    int n_reused_function_layouts = 0;
 
     void operator+=(const CodeLayoutStats& other) {
       original_intra_score += other.original_intra_score;
@@ -53,6 +68,12 @@ struct PropellerStats {
       }
       n_single_node_chains += other.n_single_node_chains;
       n_multi_node_chains += other.n_multi_node_chains;
+      n_chain_builds_over_budget += other.n_chain_builds_over_budget;
+      n_cluster_builds_over_budget += other.n_cluster_builds_over_budget;
+      n_hot_pages_before_packing += other.n_hot_pages_before_packing;
+      n_hot_pages_after_packing += other.n_hot_pages_after_packing;
+      n_hot_functions += other.n_hot_functions;
+      n_reused_function_layouts += other.n_reused_function_layouts;
     }
 
     std::string DebugString() const;
@@ -175,12 +196,38 @@ struct PropellerStats {
     int bbs_cloned = 0;
     int bytes_cloned = 0;
     double score_gain = 0;
+    // Number of candidate clonings dropped to fit in the code size budget.
+    int clonings_over_budget = 0;
+    // Number of path nodes in the path profile used for cloning.
+    int64_t path_nodes = 0;
+    // Estimated memory (in bytes) used by the path profile.
+    int64_t path_profile_bytes = 0;
 
     void operator+=(const CloningStats& other) {
       paths_cloned += other.paths_cloned;
       bbs_cloned += other.bbs_cloned;
       bytes_cloned += other.bytes_cloned;
       score_gain += other.score_gain;
+      clonings_over_budget += other.clonings_over_budget;
+      path_nodes += other.path_nodes;
+      path_profile_bytes += other.path_profile_bytes;
+    }
+
+    std::string DebugString() const;
+  };
+
+  struct PathProfileStats {
+    // Number of LBR samples read for path profiling.
+    int64_t samples_read = 0;
+    // Number of intra-function paths extracted from the samples.
+    int64_t paths_extracted = 0;
+    // Number of times the recycled path storage had to allocate memory.
+    int64_t path_buffer_allocations = 0;
+
+    void operator+=(const PathProfileStats& other) {
+      samples_read += other.samples_read;
+      paths_extracted += other.paths_extracted;
+      path_buffer_allocations += other.path_buffer_allocations;
     }
 
     std::string DebugString() const;
@@ -194,6 +241,7 @@ struct PropellerStats {
   CfgStats cfg_stats;
   CodeLayoutStats code_layout_stats;
   CloningStats cloning_stats;
+  PathProfileStats path_profile_stats;
 
   void operator+=(const PropellerStats& other) {
     bbaddrmap_stats += other.bbaddrmap_stats;
@@ -202,6 +250,7 @@ struct PropellerStats {
     cfg_stats += other.cfg_stats;
     code_layout_stats += other.code_layout_stats;
     cloning_stats += other.cloning_stats;
+    path_profile_stats += other.path_profile_stats;
   }
 
   std::string DebugString() const;